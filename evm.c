@@ -1,23 +1,23 @@
 #include "dio.h"
-#include "path.h"
+#include "provider.h"
+#include "assemble.h"
 #include "scan.h"
 #include "disassemble.h"
 #include "version.h"
 
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <inttypes.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#define CONSTRUCTOR_OFFSET 0x1000
-#define PROGRAM_BUFFER_LENGTH 0x8000
-op_t ops[PROGRAM_BUFFER_LENGTH];
-
-
 static int wrapUniversalConstructor = 0;
 static int wrapMinConstructor = 0;
 static int labelJumpdests = 0;
@@ -29,72 +29,41 @@ static int includeStatus = 0;
 static int includeLogs = 0;
 static const char *configFile = NULL;
 static int updateConfigFile = 0;
+static int jobs = -1;
+static const char *resultCache = NULL;
+static bool rerun = false;
+static const char *reportFile = NULL;
+static const char *compareFile = NULL;
+static double threshold = 0;
+static uint16_t top = 10;
+static bool timing = false;
+static uint16_t benchRepeat = 0;
+// unset until --bench-warmup
+static int benchWarmup = -1;
+#define DEFAULT_BENCH_WARMUP 5
+static const char *servePath = NULL;
+static const char *batchPath = NULL;
+static const char *forkSource = NULL;
+static const char *forkCache = NULL;
+static const char *imagePath = NULL;
+static const char *saveImagePath = NULL;
+static const char *storeDir = NULL;
 
 static void assemble(const char *contents) {
-    op_t *programStart = &ops[CONSTRUCTOR_OFFSET];
-    uint32_t programLength = 0;
-    scanInit();
-    for (; scanValid(&contents); programLength++) {
-        if (programLength > (PROGRAM_BUFFER_LENGTH - CONSTRUCTOR_OFFSET)) {
-            fprintf(stderr, "Program size exceeds limit; terminating");
-            break;
-        }
-        programStart[programLength] = scanNextOp(&contents);
-    }
-    scanFinalize(programStart, &programLength);
-    if (labelJumpdests) {
-        fprintLabels(stdout);
-        return;
-    }
+    uint8_t wrap = WRAP_NONE;
     if (wrapMinConstructor) {
-        if (programLength < 0x20) {
-            // PUSHx<>3d5260xx60xxf3
-            programStart -= 1;
-            *programStart = (PUSH1 - 1) + programLength;
-            *((uint32_t *)(programStart + programLength + 1)) = 0x0060523d + (programLength << 24);
-            *((uint32_t *)(programStart + programLength + 5)) = 0xf30060 + ((32 - programLength) << 8);
-            programLength += 8;
-        } else if (programLength == 0x20) {
-            // 7f<>3d5260203df3
-            programStart -= 1;
-            *programStart = PUSH32;
-            *((uint32_t *)(programStart + programLength + 1)) = 0x2060523d;
-            *((uint16_t *)(programStart + programLength + 5)) = 0xf33d;
-            programLength += 7;
-        } else {
-            programStart -= 4;
-            *((uint32_t *)programStart) = 0xf33d393d;
-            if (programLength < 0x100) {
-                // 60xx8060093d393df3<>
-                programStart -= 3;
-                *((uint32_t *)programStart) = 0x3d096080;
-                programStart -= 2;
-                *((uint16_t *)programStart) = 0x0060 | programLength << 8;
-                programLength += 9;
-            } else if (programLength < 0x10000) {
-                // 61xxxx80600a3d393df3<>
-                programStart -= 3;
-                *((uint32_t *)programStart) = 0x3d0a6080;
-                programStart -= 3;
-                *((uint32_t *)programStart) = 0x80000061 | (programLength & 0xff) << 16 | (programLength & 0xff00);
-                programLength += 10;
-            }
-        }
+        wrap = WRAP_MIN_CONSTRUCTOR;
     } else if (wrapUniversalConstructor) {
-        // 600b380380600b3d393df3<>
-        programStart -= 4;
-        *((uint32_t *)programStart) = 0xf33d393d;
-        programStart -= 4;
-        *((uint32_t *)programStart) = 0x0b608003;
-        programStart -= 3;
-        *((uint32_t *)programStart) = 0x03380b60;
-        programLength += 11;
+        wrap = WRAP_UNIVERSAL_CONSTRUCTOR;
     }
-
-    for (; programLength--;) {
-        printf("%02x", *programStart++);
+    data_t program = assembleSource(contents, wrap);
+    if (labelJumpdests) {
+        fprintLabels(stdout);
+    } else {
+        fprintData(stdout, program);
+        putchar('\n');
     }
-    putchar('\n');
+    free(program.content);
 }
 
 static void disassemble(const char *contents) {
@@ -174,20 +143,117 @@ static void execute(const char *contents) {
 
 }
 
-#define USAGE fputs("usage: evm [ [-w json-file [-u] ] [-x [-gs] ] | [-c | -C] [-j] | -d ] [-o input] [file...]\n", stderr)
+// serves requests from stdin for -, or else from each connection to a unix socket in turn
+static void serve(const char *socketPath) {
+    if (strcmp(socketPath, "-") == 0) {
+        serveRequests(stdin, stdout, false);
+        return;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        perror("socket");
+        _exit(1);
+    }
+    struct sockaddr_un address;
+    bzero(&address, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", socketPath);
+        _exit(1);
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) || listen(listener, 16)) {
+        perror(socketPath);
+        _exit(1);
+    }
+    // a client hanging up should not end the server
+    signal(SIGPIPE, SIG_IGN);
+    while (1) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection == -1) {
+            perror("accept");
+            continue;
+        }
+        FILE *in = fdopen(connection, "r");
+        FILE *out = fdopen(dup(connection), "w");
+        serveRequests(in, out, false);
+        fclose(in);
+        fclose(out);
+    }
+}
+
+// executes the transactions of the file in order, keeping their changes
+static void batch(const char *path) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (in == NULL) {
+        perror(path);
+        _exit(1);
+    }
+    requestStats_t stats = serveRequests(in, stdout, true);
+    fclose(in);
+    fprintf(stderr, "%" PRIu64 " transactions, %" PRIu64 " gas in %.3fms", stats.transactions, stats.gasUsed, stats.nanos / 1e6);
+    if (stats.nanos) {
+        fprintf(stderr, ": %.0f tx/s, %.2f Mgas/s", stats.transactions * 1e9 / stats.nanos, stats.gasUsed * 1e3 / stats.nanos);
+    }
+    fputc('\n', stderr);
+}
+
+#define USAGE fputs("usage: evm [ [-b json-file] [-w json-file [-u] [-J jobs [-r dir [-R] ] ] [--report json-file] [--timing] [--bench-repeat n [--bench-warmup n] ] ] [--serve socket | - | --batch jsonl-file] [-x [-gs] ] [--fork dir | --fork command [--fork-cache dir] | --image file | --store dir] [--save-image file] | [-c | -C] [-j] | -d ] [-o input] [file...]\n" \
+                   "       evm --compare base-report [--threshold percent] [--top n] [report | -w json-file... --report json-file]\n", stderr)
+
+// long options without a short form
+#define OPTION_REPORT 0x100
+#define OPTION_COMPARE 0x101
+#define OPTION_THRESHOLD 0x102
+#define OPTION_TOP 0x103
+#define OPTION_TIMING 0x104
+#define OPTION_BENCH_REPEAT 0x105
+#define OPTION_BENCH_WARMUP 0x106
+#define OPTION_SERVE 0x107
+#define OPTION_BATCH 0x108
+#define OPTION_FORK 0x109
+#define OPTION_FORK_CACHE 0x10a
+#define OPTION_IMAGE 0x10b
+#define OPTION_SAVE_IMAGE 0x10c
+#define OPTION_STORE 0x10d
 
 static const struct option long_options[] = {
     {"version", no_argument, NULL, 'v'},
+    {"jobs", required_argument, NULL, 'J'},
+    {"base", required_argument, NULL, 'b'},
+    {"result-cache", required_argument, NULL, 'r'},
+    {"rerun", no_argument, NULL, 'R'},
+    {"report", required_argument, NULL, OPTION_REPORT},
+    {"compare", required_argument, NULL, OPTION_COMPARE},
+    {"threshold", required_argument, NULL, OPTION_THRESHOLD},
+    {"top", required_argument, NULL, OPTION_TOP},
+    {"timing", no_argument, NULL, OPTION_TIMING},
+    {"bench-repeat", required_argument, NULL, OPTION_BENCH_REPEAT},
+    {"bench-warmup", required_argument, NULL, OPTION_BENCH_WARMUP},
+    {"serve", required_argument, NULL, OPTION_SERVE},
+    {"batch", required_argument, NULL, OPTION_BATCH},
+    {"fork", required_argument, NULL, OPTION_FORK},
+    {"fork-cache", required_argument, NULL, OPTION_FORK_CACHE},
+    {"image", required_argument, NULL, OPTION_IMAGE},
+    {"save-image", required_argument, NULL, OPTION_SAVE_IMAGE},
+    {"store", required_argument, NULL, OPTION_STORE},
     {0, 0, 0, 0},
 };
 
 int main(int argc, char *const argv[]) {
-    pathInit(argv[0]);
-
     int option;
     char *contents = NULL;
-    while ((option = getopt_long(argc, argv, "cCdgjlo:suvw:x", long_options, NULL)) != -1) {
+    char **configFiles = calloc(argc, sizeof(char *));
+    size_t configFileCount = 0;
+    char **baseFiles = calloc(argc, sizeof(char *));
+    size_t baseFileCount = 0;
+    while ((option = getopt_long(argc, argv, "b:cCdgjJ:lo:r:Rsuvw:x", long_options, NULL)) != -1) {
         switch (option) {
+        case 'b':
+            configFile = optarg;
+            baseFiles[baseFileCount++] = optarg;
+            break;
         case 'c':
             wrapMinConstructor = 1;
             break;
@@ -200,12 +266,64 @@ int main(int argc, char *const argv[]) {
         case 'j':
             labelJumpdests = 1;
             break;
+        case 'J':
+            jobs = atoi(optarg);
+            break;
         case 'o':
             contents = optarg;
             break;
+        case 'r':
+            resultCache = optarg;
+            break;
+        case 'R':
+            rerun = true;
+            break;
         case 'x':
             runtime = 1;
             break;
+        case OPTION_REPORT:
+            reportFile = optarg;
+            break;
+        case OPTION_COMPARE:
+            compareFile = optarg;
+            break;
+        case OPTION_THRESHOLD:
+            threshold = atof(optarg);
+            break;
+        case OPTION_TOP:
+            top = atoi(optarg);
+            break;
+        case OPTION_TIMING:
+            timing = true;
+            break;
+        case OPTION_BENCH_REPEAT:
+            timing = true;
+            benchRepeat = atoi(optarg);
+            break;
+        case OPTION_BENCH_WARMUP:
+            benchWarmup = atoi(optarg);
+            break;
+        case OPTION_SERVE:
+            servePath = optarg;
+            break;
+        case OPTION_BATCH:
+            batchPath = optarg;
+            break;
+        case OPTION_FORK:
+            forkSource = optarg;
+            break;
+        case OPTION_FORK_CACHE:
+            forkCache = optarg;
+            break;
+        case OPTION_IMAGE:
+            imagePath = optarg;
+            break;
+        case OPTION_SAVE_IMAGE:
+            saveImagePath = optarg;
+            break;
+        case OPTION_STORE:
+            storeDir = optarg;
+            break;
         case 'g':
             includeGas = 1;
             break;
@@ -222,11 +340,8 @@ int main(int argc, char *const argv[]) {
             puts(evm_build_version);
             return 0;
         case 'w':
-            if (configFile == NULL) {
-                evmInit();
-            }
             configFile = optarg;
-            loadConfig(configFile, updateConfigFile);
+            configFiles[configFileCount++] = optarg;
             break;
         case '?':
         default:
@@ -274,6 +389,164 @@ int main(int argc, char *const argv[]) {
         USAGE;
         return 1;
     }
+    if (jobs >= 0 && runtime) {
+        fputs("-J cannot be used with -x\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (resultCache && jobs < 0) {
+        fputs("-r requires -J\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (rerun && !resultCache) {
+        fputs("-R requires -r\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (reportFile && !configFile) {
+        fputs("--report requires -w or -b\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (timing && !configFile) {
+        fputs("--timing requires -w or -b\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (benchWarmup >= 0 && !benchRepeat) {
+        fputs("--bench-warmup requires --bench-repeat\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (servePath && (runtime || inverse || jobs >= 0)) {
+        fputs("--serve cannot be used with -x, -d or -J\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (batchPath && (runtime || inverse || jobs >= 0)) {
+        fputs("--batch cannot be used with -x, -d or -J\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (batchPath && servePath) {
+        fputs("--batch cannot be used with --serve\n", stderr);
+        USAGE;
+        return 1;
+    }
+    struct stat forkStat;
+    bool forkDir = forkSource && stat(forkSource, &forkStat) == 0 && S_ISDIR(forkStat.st_mode);
+    if (forkSource && (inverse || (!runtime && !configFile && !servePath && !batchPath))) {
+        fputs("--fork requires -x, -w, -b, --serve or --batch\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (forkCache && (!forkSource || forkDir)) {
+        fputs("--fork-cache requires a --fork command\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (imagePath && forkSource) {
+        fputs("--image cannot be used with --fork\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (imagePath && (inverse || (!runtime && !configFile && !servePath && !batchPath))) {
+        fputs("--image requires -x, -w, -b, --serve or --batch\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (storeDir && (forkSource || imagePath)) {
+        fputs("--store cannot be used with --fork or --image\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (storeDir && (runtime || inverse || jobs >= 0 || (!configFile && !servePath && !batchPath))) {
+        fputs("--store requires -w, -b, --serve or --batch, without -J\n", stderr);
+        USAGE;
+        return 1;
+    }
+    if (saveImagePath && !baseFileCount) {
+        fputs("--save-image requires -b\n", stderr);
+        USAGE;
+        return 1;
+    }
+    stateProvider_t provider;
+    if (forkSource) {
+        // missing accounts and slots come from the fork
+        provider = forkDir ? directoryProvider(forkSource) : rpcProvider(forkSource, forkCache);
+        evmSetStateProvider(&provider);
+    }
+    if (imagePath) {
+        provider = imageProvider(imagePath);
+        evmSetStateProvider(&provider);
+    }
+    if (storeDir) {
+        // the world state persists in the store, which the configs and --batch update
+        provider = storeProvider(storeDir);
+        evmSetStateProvider(&provider);
+    }
+    if (compareFile && !reportFile) {
+        // compare existing reports
+        if (optind + 1 != argc) {
+            fputs("--compare requires one report to compare or --report\n", stderr);
+            USAGE;
+            return 1;
+        }
+        return reportCompare(compareFile, argv[optind], top, threshold);
+    }
+    if (reportFile) {
+        reportOpen(reportFile);
+    }
+    if (timing) {
+        setTiming(true, benchWarmup >= 0 ? benchWarmup : DEFAULT_BENCH_WARMUP, benchRepeat);
+    }
+    if (configFile || jobs >= 0 || servePath || batchPath) {
+        evmInit();
+        // base configs are loaded once, before any worker forks
+        for (size_t i = 0; i < baseFileCount; i++) {
+            loadConfig(baseFiles[i], updateConfigFile);
+        }
+        if (saveImagePath) {
+            FILE *image = fopen(saveImagePath, "w");
+            if (image == NULL || !evmWriteImage(image) || fclose(image)) {
+                perror(saveImagePath);
+                _exit(1);
+            }
+        }
+        if (jobs >= 0) {
+            setResultCache(resultCache, evm_build_version, rerun);
+            int failed = loadConfigsParallel(configFiles, configFileCount, updateConfigFile, jobs);
+            reportClose();
+            if (compareFile) {
+                failed |= reportCompare(compareFile, reportFile, top, threshold);
+            }
+            fflush(stdout);
+            _exit(failed);
+        }
+        for (size_t i = 0; i < configFileCount; i++) {
+            loadConfig(configFiles[i], updateConfigFile);
+        }
+        if (storeDir) {
+            storeCommit(&provider);
+        }
+        reportClose();
+        if (compareFile) {
+            return reportCompare(compareFile, reportFile, top, threshold);
+        }
+    }
+    if (servePath) {
+        // the configs are the world state for every request
+        serve(servePath);
+        return 0;
+    }
+    if (batchPath) {
+        batch(batchPath);
+        if (storeDir) {
+            storeCommit(&provider);
+        }
+        return 0;
+    }
     void (*subprogram)(const char*);
     if (inverse) {
         subprogram = disassemble;
@@ -1,3 +1,6 @@
+#ifndef ADDRESS_T
+#define ADDRESS_T
+
 #include "hex.h"
 #include "precompiles.h"
 #include "uint256.h"
@@ -22,7 +25,7 @@ static inline int AddressEqual(const address_t *expected, const address_t *actua
 }
 
 static inline int AddressZero(const address_t *address) {
-    for (uint8_t i = 0; i < 40; i++) {
+    for (uint8_t i = 0; i < 20; i++) {
         if (address->address[i] != 0) {
             return false;
         }
@@ -141,3 +144,5 @@ static inline precompile_t AddressToPrecompile(const address_t address) {
 static inline int PrecompileIsKnownPrecompile(const address_t address) {
     return address.address[19] < KNOWN_PRECOMPILES;
 }
+
+#endif // ADDRESS_T
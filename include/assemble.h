@@ -0,0 +1,14 @@
+#ifndef ASSEMBLE_H
+#define ASSEMBLE_H
+#include "scan.h"
+
+#define WRAP_NONE 0
+// the smallest constructor returning the program
+#define WRAP_MIN_CONSTRUCTOR 1
+// a constructor returning whatever follows it, including appended arguments
+#define WRAP_UNIVERSAL_CONSTRUCTOR 2
+
+// assembles the NUL-terminated source, optionally wrapped in a constructor
+// the labels of the source remain available to fprintLabels until the next scanInit
+data_t assembleSource(const char *contents, uint8_t wrap);
+#endif
@@ -0,0 +1,67 @@
+#ifndef BLS12381_H
+#define BLS12381_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// field elements are stored in Montgomery form, least significant limb first
+typedef struct fp {
+    uint64_t limbs[6];
+} fp_t;
+
+// c0 + c1 * u where u^2 = -1
+typedef struct fp2 {
+    fp_t c0;
+    fp_t c1;
+} fp2_t;
+
+// affine points
+typedef struct g1 {
+    fp_t x;
+    fp_t y;
+    bool infinity;
+} g1_t;
+
+typedef struct g2 {
+    fp2_t x;
+    fp2_t y;
+    bool infinity;
+} g2_t;
+
+// one line per doubling and addition of the Miller loop
+#define G2_PREPARED_LINES 68
+
+// a G2 point with its Miller loop lines precomputed, for points that are paired repeatedly
+typedef struct g2Prepared {
+    fp2_t slope[G2_PREPARED_LINES];
+    fp2_t intercept[G2_PREPARED_LINES];
+    bool infinity;
+} g2Prepared_t;
+
+// builds the Frobenius constants and the fixed-base table for the G1 generator; subsequent calls are no-ops
+void bls12381Init();
+
+extern const g1_t g1Generator;
+extern const g2_t g2Generator;
+
+// compressed points use the ZCash serialization
+// returns false unless the encoding is canonical and the point is in the prime order subgroup
+bool g1Decompress(g1_t *point, const uint8_t compressed[48]);
+bool g2Decompress(g2_t *point, const uint8_t compressed[96]);
+
+// scalars are 32 bytes big-endian
+void g1Mul(g1_t *out, const g1_t *point, const uint8_t scalar[32]);
+void g1MulGenerator(g1_t *out, const uint8_t scalar[32]);
+// addend + [scalar]point + [generatorScalar]G1, normalized once
+void g1LinearCombination(g1_t *out, const g1_t *addend, const g1_t *point, const uint8_t scalar[32], const uint8_t generatorScalar[32]);
+void g1Add(g1_t *out, const g1_t *a, const g1_t *b);
+void g1Neg(g1_t *out, const g1_t *point);
+bool g1Equal(const g1_t *a, const g1_t *b);
+
+void g2Prepare(g2Prepared_t *prepared, const g2_t *point);
+
+// whether the product of the pairings e(p[i], q[i]) is the identity
+bool pairingProductIsOne(const g1_t *p, const g2Prepared_t *const q[], size_t count);
+
+#endif
@@ -1,5 +1,36 @@
 #include "evm.h"
+#include "report.h"
 
 // THE WORLD!
 void applyConfig(const char *configJson);
 void loadConfig(const char *configFile, int updateConfigFile);
+
+// runs each config file in its own forked worker process, at most jobs at a time (0 for one per core)
+// each worker starts from a copy of the current world state, so a base state can be loaded once beforehand
+// the stderr of each file is printed in the order of the files; -u updates are written by each worker to its own file
+// returns nonzero if any file failed
+// with reportOpen, each worker's report records are appended in the order of the files
+int loadConfigsParallel(char *const configFiles[], size_t count, int updateConfigFile, uint16_t jobs);
+
+// with a directory, loadConfigsParallel replays the output of each config file that passed before
+// with the same build version, starting world state and contents of every file it read, instead of running it
+// rerun runs every file again, refreshing the cache
+void setResultCache(const char *directory, const char *buildVersion, bool rerun);
+
+// prints the gas, wall time and gas rate of each test
+// with a repeat count, each test first runs warmup + repeat times from its starting world state
+// and the median and p99 of the repeat runs are printed and reported instead
+void setTiming(bool enabled, uint16_t warmup, uint16_t repeat);
+
+typedef struct requestStats {
+    uint64_t transactions;
+    uint64_t gasUsed;
+    // spent executing, excluding parsing and output
+    uint64_t nanos;
+} requestStats_t;
+
+// executes each line of in as a transaction request with the keys of a test, writing one JSON result per line to out:
+// {"name":"balanceOf","gasUsed":23966,"logs":{},"status":"0x...01","returnData":"0x..."}
+// requests without "to" create
+// with commit, each request keeps its changes like the transactions of a block; otherwise each runs against the same world state, like eth_call
+requestStats_t serveRequests(FILE *in, FILE *out, bool commit);
@@ -0,0 +1,36 @@
+#include <secp256k1_recovery.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "address.h"
+#include "keccak.h"
+
+typedef struct ecrecoverStats {
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+    // time spent recovering on cache misses
+    uint64_t recoverNanos;
+} ecrecoverStats_t;
+
+// builds the long-lived secp256k1 context; subsequent calls are no-ops
+void ecrecoverInit();
+
+// input is the 128-byte ECRECOVER precompile input: hash, v, r, s
+// returns false if the signature is invalid
+bool ecrecover(const uint8_t input[128], address_t *signer);
+
+ecrecoverStats_t ecrecoverStats();
+void ecrecoverResetStats();
+
+typedef struct txSignature {
+    uint8_t hash[32];
+    // 27 or 28, y-parity 0 or 1, or EIP-155 chainId * 2 + 35 or 36
+    uint64_t v;
+    uint8_t r[32];
+    uint8_t s[32];
+} txSignature_t;
+
+// recovers the sender of each signature on a pool of threads (0 for one per core)
+// senders are written in input order; valid[i] is false if signatures[i] could not be recovered,
+// which includes s above secp256k1n / 2 (EIP-2) and an EIP-155 v for a chain other than chainId
+void txRecoverSenders(const txSignature_t *signatures, size_t count, uint64_t chainId, address_t *senders, bool *valid, uint16_t threads);
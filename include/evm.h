@@ -1,10 +1,13 @@
-#include <secp256k1_recovery.h>
+#ifndef EVM_H
+#define EVM_H
 #include <stddef.h>
 #include <stdint.h>
 
 #include "address.h"
 #include "data.h"
+#include "ecrecover.h"
 #include "keccak.h"
+#include "kzg.h"
 #include "ops.h"
 #include "uint256.h"
 
@@ -82,12 +85,16 @@ typedef struct stateChanges {
     struct stateChanges *next;
 } stateChanges_t;
 
+// frees the changes of a result once they are no longer needed; the code they reference belongs to the accounts
+void evmFreeStateChanges(stateChanges_t *stateChanges);
+
 // returns the number of items printed
 uint16_t fprintLogs(FILE *, const stateChanges_t *, int showLogIndex);
 uint16_t fprintLog(FILE *, const logChanges_t *, int showLogIndex);
 uint16_t fprintLogDiff(FILE *, const logChanges_t *, const logChanges_t *, int showLogIndex);
 
 typedef struct callResult {
+    // points into the memory of the returning frame; valid until the next transaction
     data_t returnData;
     // status is the result pushed onto the stack
     // for CREATE it is the address or zero on failure
@@ -97,10 +104,43 @@ typedef struct callResult {
     stateChanges_t *stateChanges;
 } result_t;
 
+// An evm_t owns a world state and callstack
+// Separate instances can run concurrently on separate threads but each instance must be used by one thread at a time
+// The functions without the _r suffix operate on a default instance
+typedef struct evm evm_t;
+
+// returns an initialized instance
+evm_t *evmNew();
+void evmFree(evm_t *evm);
 
 void evmInit();
+void evmInit_r(evm_t *evm);
 void evmFinalize();
 
+// Snapshots save the world state between transactions; account storage is copied on write so taking one is cheap
+// Returns the snapshot id, which increases with each nested snapshot
+uint16_t evmSnapshot();
+uint16_t evmSnapshot_r(evm_t *evm);
+// Returns the world state to the snapshot, which remains available; newer snapshots are released
+// Like evmInit, this frees account code set since the snapshot
+void evmRestore(uint16_t snapshot);
+void evmRestore_r(evm_t *evm, uint16_t snapshot);
+// Releases the snapshot and newer snapshots, keeping the current state
+void evmRelease(uint16_t snapshot);
+void evmRelease_r(evm_t *evm, uint16_t snapshot);
+// keccak of the accounts, storage and block context; equal digests mean equal states
+void evmStateDigest(uint8_t digest[32]);
+void evmStateDigest_r(evm_t *evm, uint8_t digest[32]);
+// Writes the accounts and their storage as an image, as described in image.h, which imageProvider can serve
+// Empty accounts and slots are omitted, as are those a provider has not yet supplied; returns false if writing failed
+bool evmWriteImage(FILE *file);
+bool evmWriteImage_r(evm_t *evm, FILE *file);
+// the number of ops executed so far, including the implicit STOP past the end of code
+uint64_t evmOpCount();
+uint64_t evmOpCount_r(evm_t *evm);
+// the number of distinct account codes hashed and analyzed so far, which every instance shares; the code bytes are not shared
+uint32_t evmInternedCodes();
+
 #define EVM_DEBUG_STACK 1
 #define EVM_DEBUG_MEMORY 2
 #define EVM_DEBUG_OPS (4 + 8 + 16)
@@ -109,14 +149,87 @@ void evmFinalize();
 #define EVM_DEBUG_CALLS 32
 #define EVM_DEBUG_LOGS 64
 void evmSetDebug(uint64_t flags);
+void evmSetDebug_r(evm_t *evm, uint64_t flags);
 void evmSetBlockNumber(uint64_t blockNumber);
+void evmSetBlockNumber_r(evm_t *evm, uint64_t blockNumber);
 void evmSetTimestamp(uint64_t timestamp);
+void evmSetTimestamp_r(evm_t *evm, uint64_t timestamp);
+uint64_t evmBlockNumber();
+uint64_t evmBlockNumber_r(evm_t *evm);
+uint64_t evmTimestamp();
+uint64_t evmTimestamp_r(evm_t *evm);
+
+typedef struct blockHeader {
+    uint64_t number;
+    uint64_t timestamp;
+    uint64_t gasLimit;
+    uint64_t baseFee;
+    address_t coinbase;
+    uint256_t prevRandao;
+} blockHeader_t;
+
+// Sets the block context for the transactions that follow; evmInit restores the default coinbase
+void evmSetBlock(const blockHeader_t *header);
+void evmSetBlock_r(evm_t *evm, const blockHeader_t *header);
+
+// Supplies the accounts and slots missing from the world state, such as those of a forked chain
+// The outputs start empty; the code is malloc'd and belongs to the evm afterwards
+// instances on other threads may call it concurrently
+typedef struct stateProvider {
+    void *context;
+    void (*account)(void *context, const address_t *address, val_t balance, uint64_t *nonce, data_t *code);
+    void (*storage)(void *context, const address_t *address, const uint256_t *key, uint256_t *value);
+} stateProvider_t;
+
+// Consulted on each miss until replaced, across evmInit; NULL leaves missing accounts and slots empty
+void evmSetStateProvider(const stateProvider_t *provider);
+void evmSetStateProvider_r(evm_t *evm, const stateProvider_t *provider);
+
+// Receives each account of the world state other than the precompiles, then each of its slots, including those cleared
+typedef struct stateVisitor {
+    void *context;
+    void (*account)(void *context, const address_t *address, const val_t balance, uint64_t nonce, const data_t *code);
+    void (*storage)(void *context, const address_t *address, const uint256_t *key, const uint256_t *value);
+} stateVisitor_t;
+
+// Consults no provider, so only the accounts and slots accessed or mocked so far are visited
+void evmVisitState(const stateVisitor_t *visitor);
+void evmVisitState_r(evm_t *evm, const stateVisitor_t *visitor);
 
 void evmMockBalance(address_t to, const val_t balance);
+void evmMockBalance_r(evm_t *evm, address_t to, const val_t balance);
 void evmMockCall(address_t to, val_t value, data_t inputData, result_t result);
+void evmMockCall_r(evm_t *evm, address_t to, val_t value, data_t inputData, result_t result);
 void evmMockStorage(address_t to, const uint256_t *key, const uint256_t *storedValue);
+void evmMockStorage_r(evm_t *evm, address_t to, const uint256_t *key, const uint256_t *storedValue);
+// Presizes the account storage for that many more slots before mocking them
+void evmReserveStorage(address_t to, uint32_t slots);
+void evmReserveStorage_r(evm_t *evm, address_t to, uint32_t slots);
 void evmMockNonce(address_t to, uint64_t nonce);
+void evmMockNonce_r(evm_t *evm, address_t to, uint64_t nonce);
+// The code must not change while mocked, as its hash and analysis are kept for the account
 void evmMockCode(address_t to, data_t code);
+void evmMockCode_r(evm_t *evm, address_t to, data_t code);
+
+typedef enum precompileResult {
+    PRECOMPILE_FAILED, // consumes all gas
+    PRECOMPILE_SUCCEEDED,
+    PRECOMPILE_OUTPUT_TOO_SMALL, // output->size was set to the size needed; execute will be called again
+} precompileResult_t;
+
+typedef struct precompileHandler {
+    const char *name;
+    // charged before execute
+    uint64_t (*gas)(const data_t *input);
+    // output->content is a caller-owned buffer of output->size bytes; set output->size to the length written
+    // instances on other threads may call it concurrently
+    precompileResult_t (*execute)(const data_t *input, data_t *output);
+} precompileHandler_t;
+
+// Replaces the account at the address with a native implementation until the next evmInit
+// Works for the builtin precompile addresses as well as arbitrary addresses
+void evmMockPrecompile(address_t to, precompileHandler_t handler);
+void evmMockPrecompile_r(evm_t *evm, address_t to, precompileHandler_t handler);
 
 typedef struct accessListStorage {
     uint256_t key;
@@ -130,7 +243,67 @@ typedef struct accessList {
 } accessList_t;
 
 result_t evmConstruct(address_t from, address_t to, uint64_t gas, val_t value, data_t input);
-// TODO gasPrice, basefee, blockNumber
+result_t evmConstruct_r(evm_t *evm, address_t from, address_t to, uint64_t gas, val_t value, data_t input);
+// Charges intrinsic gas but no fees; see evmExecuteBlock
 result_t txCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input, const accessList_t *accessList);
+result_t txCall_r(evm_t *evm, address_t from, uint64_t gas, address_t to, val_t value, data_t input, const accessList_t *accessList);
 // TODO accessList
 result_t txCreate(address_t from, uint64_t gas, val_t value, data_t input /*, const accessList_t *accessList*/);
+result_t txCreate_r(evm_t *evm, address_t from, uint64_t gas, val_t value, data_t input);
+// Recovers the sender of each transaction signature, as txRecoverSenders does, for the chain CHAINID reports
+#define EVM_CHAIN_ID 1
+void txSenders(const txSignature_t *signatures, size_t count, address_t *senders, bool *valid, uint16_t threads);
+
+typedef struct blockTransaction {
+    address_t from;
+    // ignored when create is set
+    address_t to;
+    bool create;
+    uint64_t gas;
+    uint64_t maxFeePerGas;
+    uint64_t maxPriorityFeePerGas;
+    val_t value;
+    data_t input;
+    // only for calls, like txCreate
+    const accessList_t *accessList;
+} blockTransaction_t;
+
+typedef struct receipt {
+    // invalid transactions are skipped without changing the state
+    bool included;
+    uint256_t status;
+    uint64_t gasUsed;
+    uint64_t cumulativeGasUsed;
+    // holds the logs; free with evmFreeStateChanges
+    stateChanges_t *stateChanges;
+} receipt_t;
+
+// Executes the transactions in order, committing each to the world state
+// Senders pay gas at the EIP-1559 effective price, the coinbase earns the priority fee and the base fee is burned
+// Writes one receipt per transaction and returns the gas used by the block
+uint64_t evmExecuteBlock(const blockHeader_t *header, const blockTransaction_t *transactions, uint32_t count, receipt_t *receipts);
+uint64_t evmExecuteBlock_r(evm_t *evm, const blockHeader_t *header, const blockTransaction_t *transactions, uint32_t count, receipt_t *receipts);
+
+typedef struct stateRequest {
+    address_t address;
+    // for the slot at key rather than the account
+    bool slot;
+    uint256_t key;
+    // the answer, which starts empty; the code is malloc'd and freed after the simulation
+    val_t balance;
+    uint64_t nonce;
+    data_t code;
+    uint256_t value;
+} stateRequest_t;
+
+// answers every request in one round trip
+typedef void (*batchFetch_t)(void *context, stateRequest_t *requests, uint32_t count);
+
+// Simulates each transaction against the current state, like txCall and txCreate, leaving the state unchanged
+// Up to width transactions, and at least one, run at once as coroutines on this thread, each suspending on an account or slot missing from the state
+// Once all are suspended their requests are fetched in one batch, and the answers are kept for the later transactions
+// The returnData of the results is malloc'd, and their stateChanges omit code changes
+void evmSimulate(const blockTransaction_t *transactions, uint32_t count, result_t *results, uint16_t width, batchFetch_t fetch, void *context);
+void evmSimulate_r(evm_t *evm, const blockTransaction_t *transactions, uint32_t count, result_t *results, uint16_t width, batchFetch_t fetch, void *context);
+
+#endif
@@ -1,5 +1,8 @@
+#ifndef HEX_H
+#define HEX_H
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #define HEXCHARS \
         HEX(a) \
@@ -53,3 +56,40 @@ static inline int isHex(char h) {
     }
     return 0;
 }
+
+#define SWAR_ONES 0x0101010101010101ull
+// each byte is 0x80 where lo <= byte <= hi, for bytes below 0x80
+#define SWAR_IN_RANGE(x, lo, hi) (((x) + (0x80 - (lo)) * SWAR_ONES) & ~((x) + (0x7f - (hi)) * SWAR_ONES) & 0x80 * SWAR_ONES)
+
+// decodes 8 hex chars into 4 bytes, returning whether they were all hex
+static inline int hexString64ToUint32(const char *hexString64, uint8_t *bytes) {
+    uint64_t chars;
+    memcpy(&chars, hexString64, 8);
+    uint64_t ascii = chars & 0x7f * SWAR_ONES;
+    uint64_t lower = ascii | 0x20 * SWAR_ONES;
+    if ((chars & 0x80 * SWAR_ONES) || (SWAR_IN_RANGE(ascii, '0', '9') | SWAR_IN_RANGE(lower, 'a', 'f')) != 0x80 * SWAR_ONES) {
+        return 0;
+    }
+    // letters have 0x40 set and their low nibble is 9 below their value
+    uint64_t nibbles = (chars & 0x0f * SWAR_ONES) + ((chars >> 6) & SWAR_ONES) * 9;
+    // the first char of each pair is the high nibble; little-endian puts it in the low byte of each lane
+    uint64_t pairs = ((nibbles & 0x000f000f000f000full) << 4) | ((nibbles >> 8) & 0x000f000f000f000full);
+    pairs = (pairs | (pairs >> 8)) & 0x0000ffff0000ffffull;
+    pairs = (pairs | (pairs >> 16)) & 0x00000000ffffffffull;
+    uint32_t decoded = pairs;
+    memcpy(bytes, &decoded, 4);
+    return 1;
+}
+
+// decodes byteCount bytes from 2 * byteCount hex chars, 4 at a time
+static inline void hexDecode(uint8_t *bytes, const char *hexString, size_t byteCount) {
+    size_t i = 0;
+    while (i + 4 <= byteCount && hexString64ToUint32(hexString + i * 2, bytes + i)) {
+        i += 4;
+    }
+    // the rest, reporting any invalid char
+    for (; i < byteCount; i++) {
+        bytes[i] = hexString16ToUint8(hexString + i * 2);
+    }
+}
+#endif
@@ -0,0 +1,41 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#include <stdint.h>
+
+// A world-state image is read in place through mmap, so its records are native-endian and aligned
+// After the header come the accounts sorted by address, the distinct codes, the slots and the code bytes
+#define IMAGE_MAGIC "evmimg1\n"
+
+typedef struct imageHeader {
+    char magic[8];
+    uint64_t accountCount;
+    uint64_t codeCount;
+    uint64_t slotCount;
+    uint64_t codeBytes;
+} imageHeader_t;
+
+typedef struct imageAccount {
+    uint8_t address[20];
+    uint32_t balance[3];
+    uint64_t nonce;
+    // the index of its code, which accounts with the same code share
+    uint64_t code;
+    // the range of its slots
+    uint64_t firstSlot;
+    uint64_t slotCount;
+} imageAccount_t;
+
+typedef struct imageCode {
+    uint8_t hash[32];
+    // into the code bytes
+    uint64_t offset;
+    uint64_t size;
+} imageCode_t;
+
+// big-endian, so the slots of an account are sorted by memcmp of the key
+typedef struct imageSlot {
+    uint8_t key[32];
+    uint8_t value[32];
+} imageSlot_t;
+
+#endif
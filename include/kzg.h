@@ -0,0 +1,35 @@
+#ifndef KZG_H
+#define KZG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bls12381.h"
+#include "sha256.h"
+
+#define KZG_FIELD_ELEMENTS_PER_BLOB 4096
+// c-kzg-4844 trusted_setup.txt format
+#define KZG_TRUSTED_SETUP_ENV "EVM_TRUSTED_SETUP"
+
+typedef struct kzgStats {
+    uint64_t verifications;
+    uint64_t verifyNanos;
+} kzgStats_t;
+
+// loads the trusted setup from $EVM_TRUSTED_SETUP on the first call, exiting if it cannot; subsequent calls are no-ops
+// without it, nothing is loaded until kzgLoadTrustedSetup, and point evaluation fails
+void kzgInit();
+// reports why on stderr if the file is not a trusted setup
+bool kzgLoadTrustedSetup(const char *path);
+bool kzgTrustedSetupLoaded();
+
+// input is the 192-byte point evaluation precompile input: versioned hash, z, y, commitment, proof
+// returns false if the proof does not verify
+bool kzgVerifyPointEvaluation(const uint8_t input[192]);
+// FIELD_ELEMENTS_PER_BLOB and BLS_MODULUS
+extern const uint8_t kzgPointEvaluationReturn[64];
+
+kzgStats_t kzgStats();
+void kzgResetStats();
+
+#endif
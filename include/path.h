@@ -1,7 +1,16 @@
-void pathInit(const char *selfPath);
+#ifndef PATH_H
+#define PATH_H
+#include "assemble.h"
+#include "keccak.h"
 
-// exec evm with currently-running evm
+// assembles the file in-process, as evm $path would
+// results are cached in memory until the file or anything it assembles is modified,
+// and on disk in $EVM_ASSEMBLY_CACHE when set
 data_t assemblePath(const char *path);
 
-// exec evm -c with currently-running evm
+// assembles the file wrapped in the smallest constructor, as evm -c $path would
 data_t defaultConstructorForPath(const char *path);
+
+// observer is called with the path and keccak of every source read for an assembly, including cache hits
+void assembleObserve(void (*observer)(const char *path, const uint8_t hash[32]));
+#endif
@@ -9,7 +9,7 @@
         PRECOMPILE(EC_MUL,0x7,0) \
         PRECOMPILE(EC_PAIRING,0x8,0) \
         PRECOMPILE(BLACK2F,0x9,0) \
-        PRECOMPILE(ZKG_POINT,0xa,0)
+        PRECOMPILE(ZKG_POINT,0xa,1)
 
 typedef enum precompile {
     #define PRECOMPILE(name,address,supported) name,
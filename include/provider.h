@@ -0,0 +1,32 @@
+#ifndef PROVIDER_H
+#define PROVIDER_H
+#include "evm.h"
+
+// Providers read files named by the lowercase address, such as 0x4838b106fce9647bdf1e7877bf73ce8b0bad5f97, with lines
+// account 0x<balance> 0x<nonce> 0x<code>
+// slot 0x<key> 0x<value>
+// accounts and slots without a line are empty
+
+// serves the files in dir
+stateProvider_t directoryProvider(const char *dir);
+// asks the command, started with sh on the first miss, with lines
+// account 0x<address>
+// slot 0x<address> 0x<key>
+// each answered on its output by a line like those of the files, with the key repeated as asked
+// when cacheDir is not NULL the answers are appended to its files, so later runs do not ask again
+stateProvider_t rpcProvider(const char *command, const char *cacheDir);
+// serves an image written by evmWriteImage in place, mapping it read-only, so opening it takes no time however large it is
+// its account table is pinned in memory when at most 64MB, and its slots and code are left to the page cache
+// the accounts and slots are found by binary search as they are first used, and the evm keeps any changes to them
+stateProvider_t imageProvider(const char *path);
+// keeps the state in dir across runs, as an image and a log of the changes committed since, which it replays when opened
+// the image is mapped like that of imageProvider, and the log is folded into a new image once it grows larger or its changes take 64MB of memory
+// a replay stops at the last complete commit, dropping any records a crash left after it
+stateProvider_t storeProvider(const char *dir);
+// appends the accounts and slots of the evm that differ from the store to its log, then a line counting them, syncing it to disk
+void storeCommit(stateProvider_t *store);
+void storeCommit_r(evm_t *evm, stateProvider_t *store);
+// stops the command or unmaps the image, and frees the provider
+void providerFree(stateProvider_t *provider);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef REPORT_H
+#define REPORT_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A report is a JSON array with one test object per line:
+// {"file":"tst/weth.json","entry":"tst/in/weth.evm","name":"withdraw","status":"pass","gasUsed":35204,"nanos":5120,"ops":212}
+// tests are matched across reports by file, entry and name
+
+// records are collected until reportClose writes them to reportFile, which is also done before exiting for failed tests
+void reportOpen(const char *reportFile);
+bool reportEnabled();
+void reportTest(const char *file, const char *entry, const char *name, bool passed, uint64_t gasUsed, uint64_t nanos, uint64_t ops);
+void reportClose();
+
+// forked workers record into their own sink, which the parent appends in order
+FILE *reportWorkerSink();
+void reportSetSink(FILE *sink);
+void reportAppendWorker(FILE *sink);
+
+// prints the top gas and time regressions of current against base
+// returns nonzero if any test started failing or used more than thresholdPercent more gas
+int reportCompare(const char *baseFile, const char *currentFile, uint16_t top, double thresholdPercent);
+
+#endif
@@ -1,10 +1,17 @@
+#ifndef SCAN_H
+#define SCAN_H
 #include "ops.h"
 #include "path.h"
 #include <stdio.h>
 
 void scanInit();
+// the scanner state is global; a nested assembly saves the enclosing scan and restores it afterward
+typedef struct scanState scanState_t;
+scanState_t *scanSave();
+void scanRestore(scanState_t *);
 op_t scanNextOp(const char **iter);
 int scanValid(const char **iter);
 void scanFinalize(op_t *begin, uint32_t *programLength);
 
 void fprintLabels(FILE *);
+#endif
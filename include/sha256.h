@@ -0,0 +1,9 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void sha256(uint8_t hash[32], const uint8_t *data, size_t size);
+
+#endif
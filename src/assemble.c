@@ -0,0 +1,75 @@
+#include "data.h"
+#include "assemble.h"
+#include "scan.h"
+
+#include <stdlib.h>
+
+// room before the program for the constructor wrappers
+#define CONSTRUCTOR_OFFSET 0x1000
+#define PROGRAM_BUFFER_LENGTH 0x8000
+
+data_t assembleSource(const char *contents, uint8_t wrap) {
+    op_t *ops = malloc(PROGRAM_BUFFER_LENGTH);
+    op_t *programStart = &ops[CONSTRUCTOR_OFFSET];
+    uint32_t programLength = 0;
+    scanInit();
+    for (; scanValid(&contents); programLength++) {
+        if (programLength > (PROGRAM_BUFFER_LENGTH - CONSTRUCTOR_OFFSET)) {
+            fprintf(stderr, "Program size exceeds limit; terminating");
+            break;
+        }
+        programStart[programLength] = scanNextOp(&contents);
+    }
+    scanFinalize(programStart, &programLength);
+    if (wrap == WRAP_MIN_CONSTRUCTOR) {
+        if (programLength < 0x20) {
+            // PUSHx<>3d5260xx60xxf3
+            programStart -= 1;
+            *programStart = (PUSH1 - 1) + programLength;
+            *((uint32_t *)(programStart + programLength + 1)) = 0x0060523d + (programLength << 24);
+            *((uint32_t *)(programStart + programLength + 5)) = 0xf30060 + ((32 - programLength) << 8);
+            programLength += 8;
+        } else if (programLength == 0x20) {
+            // 7f<>3d5260203df3
+            programStart -= 1;
+            *programStart = PUSH32;
+            *((uint32_t *)(programStart + programLength + 1)) = 0x2060523d;
+            *((uint16_t *)(programStart + programLength + 5)) = 0xf33d;
+            programLength += 7;
+        } else {
+            programStart -= 4;
+            *((uint32_t *)programStart) = 0xf33d393d;
+            if (programLength < 0x100) {
+                // 60xx8060093d393df3<>
+                programStart -= 3;
+                *((uint32_t *)programStart) = 0x3d096080;
+                programStart -= 2;
+                *((uint16_t *)programStart) = 0x0060 | programLength << 8;
+                programLength += 9;
+            } else if (programLength < 0x10000) {
+                // 61xxxx80600a3d393df3<>
+                programStart -= 3;
+                *((uint32_t *)programStart) = 0x3d0a6080;
+                programStart -= 3;
+                *((uint32_t *)programStart) = 0x80000061 | (programLength & 0xff) << 16 | (programLength & 0xff00);
+                programLength += 10;
+            }
+        }
+    } else if (wrap == WRAP_UNIVERSAL_CONSTRUCTOR) {
+        // 600b380380600b3d393df3<>
+        programStart -= 4;
+        *((uint32_t *)programStart) = 0xf33d393d;
+        programStart -= 4;
+        *((uint32_t *)programStart) = 0x0b608003;
+        programStart -= 3;
+        *((uint32_t *)programStart) = 0x03380b60;
+        programLength += 11;
+    }
+
+    data_t program;
+    program.size = programLength;
+    program.content = malloc(programLength);
+    memcpy(program.content, programStart, programLength);
+    free(ops);
+    return program;
+}
@@ -0,0 +1,1160 @@
+#include "bls12381.h"
+
+#include <string.h>
+
+typedef unsigned __int128 uint128;
+
+// p = 0x1a0111ea397fe69a4b1ba7b6434bacd764774b84f38512bf6730d2a0f6b0f6241eabfffeb153ffffb9feffffffffaaab
+static const fp_t P = {{0xb9feffffffffaaabull, 0x1eabfffeb153ffffull, 0x6730d2a0f6b0f624ull, 0x64774b84f38512bfull, 0x4b1ba7b6434bacd7ull, 0x1a0111ea397fe69aull}};
+// -p^-1 mod 2^64
+#define PINV 0x89f3fffcfffcfffdull
+// 2^384 mod p
+static const fp_t ONE = {{0x760900000002fffdull, 0xebf4000bc40c0002ull, 0x5f48985753c758baull, 0x77ce585370525745ull, 0x5c071a97a256ec6dull, 0x15f65ec3fa80e493ull}};
+// 2^768 mod p
+static const fp_t R2 = {{0xf4df1f341c341746ull, 0x0a76e6a609d104f1ull, 0x8de5476c4c95b6d5ull, 0x67eb88a9939d83c0ull, 0x9a793e85b519952dull, 0x11988fe592cae3aaull}};
+// the curve constant 4 in Montgomery form
+static const fp_t B = {{0xaa270000000cfff3ull, 0x53cc0032fc34000aull, 0x478fe97a6b0a807full, 0xb1d37ebee6ba24d7ull, 0x8ec9733bbf78ab2full, 0x09d645513d83de7eull}};
+
+// exponents
+static const uint64_t P_MINUS_2[6] = {0xb9feffffffffaaa9ull, 0x1eabfffeb153ffffull, 0x6730d2a0f6b0f624ull, 0x64774b84f38512bfull, 0x4b1ba7b6434bacd7ull, 0x1a0111ea397fe69aull};
+static const uint64_t P_PLUS_1_DIV_4[6] = {0xee7fbfffffffeaabull, 0x07aaffffac54ffffull, 0xd9cc34a83dac3d89ull, 0xd91dd2e13ce144afull, 0x92c6e9ed90d2eb35ull, 0x0680447a8e5ff9a6ull};
+static const uint64_t P_MINUS_3_DIV_4[6] = {0xee7fbfffffffeaaaull, 0x07aaffffac54ffffull, 0xd9cc34a83dac3d89ull, 0xd91dd2e13ce144afull, 0x92c6e9ed90d2eb35ull, 0x0680447a8e5ff9a6ull};
+static const uint64_t P_MINUS_1_DIV_2[6] = {0xdcff7fffffffd555ull, 0x0f55ffff58a9ffffull, 0xb39869507b587b12ull, 0xb23ba5c279c2895full, 0x258dd3db21a5d66bull, 0x0d0088f51cbff34dull};
+static const uint64_t P_MINUS_1_DIV_6[6] = {0x49aa7ffffffff1c7ull, 0x051caaaa72e35555ull, 0xe688231ad3c82906ull, 0xe613e1eb7deb831full, 0x0c849bf3b5e1f223ull, 0x045582fc5eeaa66full};
+// the group order r
+static const uint64_t R[4] = {0xffffffff00000001ull, 0x53bda402fffe5bfeull, 0x3339d80809a1d805ull, 0x73eda753299d7d48ull};
+// |x| where x = -0xd201000000010000 is the curve parameter
+#define X_ABS 0xd201000000010000ull
+
+const g1_t g1Generator = {
+    {{0x5cb38790fd530c16ull, 0x7817fc679976fff5ull, 0x154f95c7143ba1c1ull, 0xf0ae6acdf3d0e747ull, 0xedce6ecc21dbf440ull, 0x120177419e0bfb75ull}},
+    {{0xbaac93d50ce72271ull, 0x8c22631a7918fd8eull, 0xdd595f13570725ceull, 0x51ac582950405194ull, 0x0e1c8c3fad0059c0ull, 0x0bbc3efc5008a26aull}},
+    false,
+};
+
+const g2_t g2Generator = {
+    {
+        {{0xf5f28fa202940a10ull, 0xb3f5fb2687b4961aull, 0xa1a893b53e2ae580ull, 0x9894999d1a3caee9ull, 0x6f67b7631863366bull, 0x058191924350bcd7ull}},
+        {{0xa5a9c0759e23f606ull, 0xaaa0c59dbccd60c3ull, 0x3bb17e18e2867806ull, 0x1b1ab6cc8541b367ull, 0xc2b6ed0ef2158547ull, 0x11922a097360edf3ull}},
+    },
+    {
+        {{0x4c730af860494c4aull, 0x597cfa1f5e369c5aull, 0xe7e6856caa0a635aull, 0xbbefb5e96e0d495full, 0x07d3a975f0ef25a2ull, 0x0083fd8e7e80dae5ull}},
+        {{0xadc0fc92df64b05dull, 0x18aa270a2b1461dcull, 0x86adac6a3be4eba0ull, 0x79495c4ec93da33aull, 0xe7175850a43ccaedull, 0x0b2bc2a163de1bf2ull}},
+    },
+    false,
+};
+
+// Fp
+
+static inline bool fpIsZero(const fp_t *a) {
+    return (a->limbs[0] | a->limbs[1] | a->limbs[2] | a->limbs[3] | a->limbs[4] | a->limbs[5]) == 0;
+}
+
+static inline bool fpEqual(const fp_t *a, const fp_t *b) {
+    return memcmp(a, b, sizeof(fp_t)) == 0;
+}
+
+// subtracts p if a >= p
+static inline void fpReduce(fp_t *a, uint64_t carry) {
+    fp_t reduced;
+    uint64_t borrow = 0;
+    #pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+        uint128 diff = (uint128)a->limbs[i] - P.limbs[i] - borrow;
+        reduced.limbs[i] = diff;
+        borrow = (diff >> 64) & 1;
+    }
+    if (carry || !borrow) {
+        *a = reduced;
+    }
+}
+
+static inline void fpAdd(fp_t *out, const fp_t *a, const fp_t *b) {
+    uint64_t carry = 0;
+    #pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+        uint128 sum = (uint128)a->limbs[i] + b->limbs[i] + carry;
+        out->limbs[i] = sum;
+        carry = sum >> 64;
+    }
+    fpReduce(out, carry);
+}
+
+static inline void fpSub(fp_t *out, const fp_t *a, const fp_t *b) {
+    uint64_t borrow = 0;
+    #pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+        uint128 diff = (uint128)a->limbs[i] - b->limbs[i] - borrow;
+        out->limbs[i] = diff;
+        borrow = (diff >> 64) & 1;
+    }
+    if (borrow) {
+        uint64_t carry = 0;
+        #pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+            uint128 sum = (uint128)out->limbs[i] + P.limbs[i] + carry;
+            out->limbs[i] = sum;
+            carry = sum >> 64;
+        }
+    }
+}
+
+static inline void fpNeg(fp_t *out, const fp_t *a) {
+    if (fpIsZero(a)) {
+        *out = *a;
+        return;
+    }
+    uint64_t borrow = 0;
+    #pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+        uint128 diff = (uint128)P.limbs[i] - a->limbs[i] - borrow;
+        out->limbs[i] = diff;
+        borrow = (diff >> 64) & 1;
+    }
+}
+
+static inline void fpDouble(fp_t *out, const fp_t *a) {
+    fpAdd(out, a, a);
+}
+
+// Montgomery multiplication (CIOS)
+// the top limb of p leaves enough headroom that the running sum never needs a seventh limb
+static void fpMul(fp_t *out, const fp_t *a, const fp_t *b) {
+    uint64_t t[6] = {0};
+    #pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+        uint128 sum;
+        uint64_t carry = 0;
+        #pragma GCC unroll 6
+        for (int j = 0; j < 6; j++) {
+            sum = (uint128)a->limbs[j] * b->limbs[i] + t[j] + carry;
+            t[j] = sum;
+            carry = sum >> 64;
+        }
+        uint64_t high = carry;
+
+        uint64_t m = t[0] * PINV;
+        sum = (uint128)m * P.limbs[0] + t[0];
+        carry = sum >> 64;
+        #pragma GCC unroll 5
+        for (int j = 1; j < 6; j++) {
+            sum = (uint128)m * P.limbs[j] + t[j] + carry;
+            t[j - 1] = sum;
+            carry = sum >> 64;
+        }
+        t[5] = high + carry;
+    }
+    memcpy(out->limbs, t, sizeof(out->limbs));
+    fpReduce(out, 0);
+}
+
+static inline void fpSqr(fp_t *out, const fp_t *a) {
+    fpMul(out, a, a);
+}
+
+static void fpPow(fp_t *out, const fp_t *a, const uint64_t exponent[6]) {
+    fp_t result = ONE;
+    for (int i = 5; i >= 0; i--) {
+        for (int bit = 63; bit >= 0; bit--) {
+            fpSqr(&result, &result);
+            if ((exponent[i] >> bit) & 1) {
+                fpMul(&result, &result, a);
+            }
+        }
+    }
+    *out = result;
+}
+
+static inline void fpInv(fp_t *out, const fp_t *a) {
+    fpPow(out, a, P_MINUS_2);
+}
+
+// returns false if a is not a square
+static bool fpSqrt(fp_t *out, const fp_t *a) {
+    fp_t root, check;
+    fpPow(&root, a, P_PLUS_1_DIV_4);
+    fpSqr(&check, &root);
+    if (!fpEqual(&check, a)) {
+        return false;
+    }
+    *out = root;
+    return true;
+}
+
+// out of Montgomery form
+static inline void fpToInteger(uint64_t integer[6], const fp_t *a) {
+    static const fp_t one = {{1, 0, 0, 0, 0, 0}};
+    fp_t reduced;
+    fpMul(&reduced, a, &one);
+    memcpy(integer, reduced.limbs, sizeof(reduced.limbs));
+}
+
+// returns false if the big-endian integer is not less than p
+static bool fpFromBytes(fp_t *out, const uint8_t bytes[48]) {
+    fp_t integer;
+    for (int i = 0; i < 6; i++) {
+        uint64_t limb = 0;
+        for (int j = 0; j < 8; j++) {
+            limb = (limb << 8) | bytes[(5 - i) * 8 + j];
+        }
+        integer.limbs[i] = limb;
+    }
+    for (int i = 5; i >= 0; i--) {
+        if (integer.limbs[i] < P.limbs[i]) {
+            break;
+        }
+        if (integer.limbs[i] > P.limbs[i] || i == 0) {
+            return false;
+        }
+    }
+    fpMul(out, &integer, &R2);
+    return true;
+}
+
+// whether a > (p - 1) / 2, which decides the sign bit of compressed points
+static bool fpIsLexicographicallyLargest(const fp_t *a) {
+    uint64_t integer[6];
+    fpToInteger(integer, a);
+    for (int i = 5; i >= 0; i--) {
+        if (integer[i] != P_MINUS_1_DIV_2[i]) {
+            return integer[i] > P_MINUS_1_DIV_2[i];
+        }
+    }
+    return false;
+}
+
+// Fp2 = Fp[u] / (u^2 + 1)
+
+static const fp2_t FP2_ONE = {{{0x760900000002fffdull, 0xebf4000bc40c0002ull, 0x5f48985753c758baull, 0x77ce585370525745ull, 0x5c071a97a256ec6dull, 0x15f65ec3fa80e493ull}}, {{0}}};
+
+static inline bool fp2IsZero(const fp2_t *a) {
+    return fpIsZero(&a->c0) && fpIsZero(&a->c1);
+}
+
+static inline bool fp2Equal(const fp2_t *a, const fp2_t *b) {
+    return fpEqual(&a->c0, &b->c0) && fpEqual(&a->c1, &b->c1);
+}
+
+static inline void fp2Add(fp2_t *out, const fp2_t *a, const fp2_t *b) {
+    fpAdd(&out->c0, &a->c0, &b->c0);
+    fpAdd(&out->c1, &a->c1, &b->c1);
+}
+
+static inline void fp2Sub(fp2_t *out, const fp2_t *a, const fp2_t *b) {
+    fpSub(&out->c0, &a->c0, &b->c0);
+    fpSub(&out->c1, &a->c1, &b->c1);
+}
+
+static inline void fp2Neg(fp2_t *out, const fp2_t *a) {
+    fpNeg(&out->c0, &a->c0);
+    fpNeg(&out->c1, &a->c1);
+}
+
+static inline void fp2Conj(fp2_t *out, const fp2_t *a) {
+    out->c0 = a->c0;
+    fpNeg(&out->c1, &a->c1);
+}
+
+static inline void fp2Double(fp2_t *out, const fp2_t *a) {
+    fp2Add(out, a, a);
+}
+
+static void fp2Mul(fp2_t *out, const fp2_t *a, const fp2_t *b) {
+    fp_t t0, t1, sumA, sumB;
+    fpMul(&t0, &a->c0, &b->c0);
+    fpMul(&t1, &a->c1, &b->c1);
+    fpAdd(&sumA, &a->c0, &a->c1);
+    fpAdd(&sumB, &b->c0, &b->c1);
+    fpMul(&out->c1, &sumA, &sumB);
+    fpSub(&out->c1, &out->c1, &t0);
+    fpSub(&out->c1, &out->c1, &t1);
+    fpSub(&out->c0, &t0, &t1);
+}
+
+static void fp2Sqr(fp2_t *out, const fp2_t *a) {
+    fp_t sum, diff, product;
+    fpAdd(&sum, &a->c0, &a->c1);
+    fpSub(&diff, &a->c0, &a->c1);
+    fpMul(&product, &a->c0, &a->c1);
+    fpMul(&out->c0, &sum, &diff);
+    fpDouble(&out->c1, &product);
+}
+
+static inline void fp2MulFp(fp2_t *out, const fp2_t *a, const fp_t *b) {
+    fpMul(&out->c0, &a->c0, b);
+    fpMul(&out->c1, &a->c1, b);
+}
+
+// multiplication by the non-residue xi = 1 + u
+static inline void fp2MulXi(fp2_t *out, const fp2_t *a) {
+    fp_t c0;
+    fpSub(&c0, &a->c0, &a->c1);
+    fpAdd(&out->c1, &a->c0, &a->c1);
+    out->c0 = c0;
+}
+
+static void fp2Inv(fp2_t *out, const fp2_t *a) {
+    fp_t norm, t;
+    fpSqr(&norm, &a->c0);
+    fpSqr(&t, &a->c1);
+    fpAdd(&norm, &norm, &t);
+    fpInv(&norm, &norm);
+    fpMul(&out->c0, &a->c0, &norm);
+    fpMul(&t, &a->c1, &norm);
+    fpNeg(&out->c1, &t);
+}
+
+static void fp2Pow(fp2_t *out, const fp2_t *a, const uint64_t exponent[6]) {
+    fp2_t result = FP2_ONE;
+    for (int i = 5; i >= 0; i--) {
+        for (int bit = 63; bit >= 0; bit--) {
+            fp2Sqr(&result, &result);
+            if ((exponent[i] >> bit) & 1) {
+                fp2Mul(&result, &result, a);
+            }
+        }
+    }
+    *out = result;
+}
+
+// Adj and Rodríguez-Henríquez, Algorithm 9, for p = 3 mod 4
+static bool fp2Sqrt(fp2_t *out, const fp2_t *a) {
+    fp2_t a1, alpha, x0, root, check;
+    fp2Pow(&a1, a, P_MINUS_3_DIV_4);
+    fp2Mul(&x0, &a1, a);
+    fp2Mul(&alpha, &a1, &x0);
+    fp2_t minusOne;
+    fp2Neg(&minusOne, &FP2_ONE);
+    if (fp2Equal(&alpha, &minusOne)) {
+        // multiply by u
+        fpNeg(&root.c0, &x0.c1);
+        root.c1 = x0.c0;
+    } else {
+        fp2_t b;
+        fp2Add(&b, &alpha, &FP2_ONE);
+        fp2Pow(&b, &b, P_MINUS_1_DIV_2);
+        fp2Mul(&root, &b, &x0);
+    }
+    fp2Sqr(&check, &root);
+    if (!fp2Equal(&check, a)) {
+        return false;
+    }
+    *out = root;
+    return true;
+}
+
+static bool fp2IsLexicographicallyLargest(const fp2_t *a) {
+    if (fpIsZero(&a->c1)) {
+        return fpIsLexicographicallyLargest(&a->c0);
+    }
+    return fpIsLexicographicallyLargest(&a->c1);
+}
+
+// Fp6 = Fp2[v] / (v^3 - xi)
+
+typedef struct fp6 {
+    fp2_t c0;
+    fp2_t c1;
+    fp2_t c2;
+} fp6_t;
+
+static inline void fp6Add(fp6_t *out, const fp6_t *a, const fp6_t *b) {
+    fp2Add(&out->c0, &a->c0, &b->c0);
+    fp2Add(&out->c1, &a->c1, &b->c1);
+    fp2Add(&out->c2, &a->c2, &b->c2);
+}
+
+static inline void fp6Sub(fp6_t *out, const fp6_t *a, const fp6_t *b) {
+    fp2Sub(&out->c0, &a->c0, &b->c0);
+    fp2Sub(&out->c1, &a->c1, &b->c1);
+    fp2Sub(&out->c2, &a->c2, &b->c2);
+}
+
+static inline void fp6Neg(fp6_t *out, const fp6_t *a) {
+    fp2Neg(&out->c0, &a->c0);
+    fp2Neg(&out->c1, &a->c1);
+    fp2Neg(&out->c2, &a->c2);
+}
+
+static void fp6Mul(fp6_t *out, const fp6_t *a, const fp6_t *b) {
+    fp2_t t0, t1, t2, s, u;
+    fp6_t result;
+    fp2Mul(&t0, &a->c0, &b->c0);
+    fp2Mul(&t1, &a->c1, &b->c1);
+    fp2Mul(&t2, &a->c2, &b->c2);
+
+    fp2Add(&s, &a->c1, &a->c2);
+    fp2Add(&u, &b->c1, &b->c2);
+    fp2Mul(&s, &s, &u);
+    fp2Sub(&s, &s, &t1);
+    fp2Sub(&s, &s, &t2);
+    fp2MulXi(&s, &s);
+    fp2Add(&result.c0, &s, &t0);
+
+    fp2Add(&s, &a->c0, &a->c1);
+    fp2Add(&u, &b->c0, &b->c1);
+    fp2Mul(&s, &s, &u);
+    fp2Sub(&s, &s, &t0);
+    fp2Sub(&s, &s, &t1);
+    fp2MulXi(&u, &t2);
+    fp2Add(&result.c1, &s, &u);
+
+    fp2Add(&s, &a->c0, &a->c2);
+    fp2Add(&u, &b->c0, &b->c2);
+    fp2Mul(&s, &s, &u);
+    fp2Sub(&s, &s, &t0);
+    fp2Sub(&s, &s, &t2);
+    fp2Add(&result.c2, &s, &t1);
+    *out = result;
+}
+
+// multiplication by b0 + b1 * v, the shape of the constant half of a line
+static void fp6Mul01(fp6_t *out, const fp6_t *a, const fp2_t *b0, const fp2_t *b1) {
+    fp2_t t0, t1, s, u;
+    fp6_t result;
+    fp2Mul(&t0, &a->c0, b0);
+    fp2Mul(&t1, &a->c1, b1);
+
+    fp2Mul(&s, &a->c2, b1);
+    fp2MulXi(&s, &s);
+    fp2Add(&result.c0, &s, &t0);
+
+    fp2Add(&s, &a->c0, &a->c1);
+    fp2Add(&u, b0, b1);
+    fp2Mul(&s, &s, &u);
+    fp2Sub(&s, &s, &t0);
+    fp2Sub(&result.c1, &s, &t1);
+
+    fp2Mul(&s, &a->c2, b0);
+    fp2Add(&result.c2, &s, &t1);
+    *out = result;
+}
+
+// multiplication by b1 * v
+static void fp6Mul1(fp6_t *out, const fp6_t *a, const fp2_t *b1) {
+    fp6_t result;
+    fp2Mul(&result.c0, &a->c2, b1);
+    fp2MulXi(&result.c0, &result.c0);
+    fp2Mul(&result.c1, &a->c0, b1);
+    fp2Mul(&result.c2, &a->c1, b1);
+    *out = result;
+}
+
+static inline void fp6MulV(fp6_t *out, const fp6_t *a) {
+    fp2_t c2 = a->c2;
+    out->c2 = a->c1;
+    out->c1 = a->c0;
+    fp2MulXi(&out->c0, &c2);
+}
+
+static void fp6Inv(fp6_t *out, const fp6_t *a) {
+    fp2_t c0, c1, c2, t, s;
+    fp2Sqr(&c0, &a->c0);
+    fp2Mul(&t, &a->c1, &a->c2);
+    fp2MulXi(&t, &t);
+    fp2Sub(&c0, &c0, &t);
+
+    fp2Sqr(&c1, &a->c2);
+    fp2MulXi(&c1, &c1);
+    fp2Mul(&t, &a->c0, &a->c1);
+    fp2Sub(&c1, &c1, &t);
+
+    fp2Sqr(&c2, &a->c1);
+    fp2Mul(&t, &a->c0, &a->c2);
+    fp2Sub(&c2, &c2, &t);
+
+    fp2Mul(&t, &a->c2, &c1);
+    fp2Mul(&s, &a->c1, &c2);
+    fp2Add(&t, &t, &s);
+    fp2MulXi(&t, &t);
+    fp2Mul(&s, &a->c0, &c0);
+    fp2Add(&t, &t, &s);
+    fp2Inv(&t, &t);
+
+    fp2Mul(&out->c0, &c0, &t);
+    fp2Mul(&out->c1, &c1, &t);
+    fp2Mul(&out->c2, &c2, &t);
+}
+
+// Fp12 = Fp6[w] / (w^2 - v)
+
+typedef struct fp12 {
+    fp6_t c0;
+    fp6_t c1;
+} fp12_t;
+
+static inline void fp12SetOne(fp12_t *a) {
+    memset(a, 0, sizeof(fp12_t));
+    a->c0.c0 = FP2_ONE;
+}
+
+static bool fp12IsOne(const fp12_t *a) {
+    fp12_t one;
+    fp12SetOne(&one);
+    return memcmp(a, &one, sizeof(fp12_t)) == 0;
+}
+
+static void fp12Mul(fp12_t *out, const fp12_t *a, const fp12_t *b) {
+    fp6_t t0, t1, s, u;
+    fp6Mul(&t0, &a->c0, &b->c0);
+    fp6Mul(&t1, &a->c1, &b->c1);
+    fp6Add(&s, &a->c0, &a->c1);
+    fp6Add(&u, &b->c0, &b->c1);
+    fp6Mul(&s, &s, &u);
+    fp6Sub(&s, &s, &t0);
+    fp6Sub(&out->c1, &s, &t1);
+    fp6MulV(&t1, &t1);
+    fp6Add(&out->c0, &t0, &t1);
+}
+
+static void fp12Sqr(fp12_t *out, const fp12_t *a) {
+    // (c0 + c1 w)^2 = c0^2 + v c1^2 + 2 c0 c1 w
+    fp6_t product, s, t;
+    fp6Mul(&product, &a->c0, &a->c1);
+    fp6Add(&s, &a->c0, &a->c1);
+    fp6MulV(&t, &a->c1);
+    fp6Add(&t, &a->c0, &t);
+    fp6Mul(&s, &s, &t);
+    fp6Sub(&s, &s, &product);
+    fp6MulV(&t, &product);
+    fp6Sub(&out->c0, &s, &t);
+    fp6Add(&out->c1, &product, &product);
+}
+
+// multiplication by a line (l0 + l2 v) + (l3 v) w
+static void fp12MulLine(fp12_t *f, const fp2_t *l0, const fp2_t *l2, const fp2_t *l3) {
+    fp6_t t0, t1, s;
+    fp2_t sum;
+    fp6Mul01(&t0, &f->c0, l0, l2);
+    fp6Mul1(&t1, &f->c1, l3);
+    fp6Add(&s, &f->c0, &f->c1);
+    fp2Add(&sum, l2, l3);
+    fp6Mul01(&s, &s, l0, &sum);
+    fp6Sub(&s, &s, &t0);
+    fp6Sub(&f->c1, &s, &t1);
+    fp6MulV(&t1, &t1);
+    fp6Add(&f->c0, &t0, &t1);
+}
+
+static inline void fp12Conj(fp12_t *out, const fp12_t *a) {
+    out->c0 = a->c0;
+    fp6Neg(&out->c1, &a->c1);
+}
+
+static void fp12Inv(fp12_t *out, const fp12_t *a) {
+    fp6_t t0, t1;
+    fp6Mul(&t0, &a->c0, &a->c0);
+    fp6Mul(&t1, &a->c1, &a->c1);
+    fp6MulV(&t1, &t1);
+    fp6Sub(&t0, &t0, &t1);
+    fp6Inv(&t0, &t0);
+    fp6Mul(&out->c0, &a->c0, &t0);
+    fp6Mul(&t1, &a->c1, &t0);
+    fp6Neg(&out->c1, &t1);
+}
+
+// gamma[k] = xi^(k (p - 1) / 6), so that (g w^k)^p = conj(g) gamma[k] w^k
+static fp2_t frobeniusGamma[6];
+
+static void fp12Frobenius(fp12_t *out, const fp12_t *a) {
+    fp2Conj(&out->c0.c0, &a->c0.c0);
+    fp2Conj(&out->c0.c1, &a->c0.c1);
+    fp2Mul(&out->c0.c1, &out->c0.c1, frobeniusGamma + 2);
+    fp2Conj(&out->c0.c2, &a->c0.c2);
+    fp2Mul(&out->c0.c2, &out->c0.c2, frobeniusGamma + 4);
+    fp2Conj(&out->c1.c0, &a->c1.c0);
+    fp2Mul(&out->c1.c0, &out->c1.c0, frobeniusGamma + 1);
+    fp2Conj(&out->c1.c1, &a->c1.c1);
+    fp2Mul(&out->c1.c1, &out->c1.c1, frobeniusGamma + 3);
+    fp2Conj(&out->c1.c2, &a->c1.c2);
+    fp2Mul(&out->c1.c2, &out->c1.c2, frobeniusGamma + 5);
+}
+
+// (a + b t)^2 in Fp4 = Fp2[t] / (t^2 - xi)
+static inline void fp4Sqr(fp2_t *c0, fp2_t *c1, const fp2_t *a, const fp2_t *b) {
+    fp2_t t0, t1, t2;
+    fp2Sqr(&t0, a);
+    fp2Sqr(&t1, b);
+    fp2MulXi(&t2, &t1);
+    fp2Add(c0, &t2, &t0);
+    fp2Add(&t2, a, b);
+    fp2Sqr(&t2, &t2);
+    fp2Sub(&t2, &t2, &t0);
+    fp2Sub(c1, &t2, &t1);
+}
+
+// Granger and Scott, Faster squaring in the cyclotomic subgroup of sixth degree extensions
+static void fp12CyclotomicSqr(fp12_t *out, const fp12_t *a) {
+    fp2_t z0 = a->c0.c0;
+    fp2_t z4 = a->c0.c1;
+    fp2_t z3 = a->c0.c2;
+    fp2_t z2 = a->c1.c0;
+    fp2_t z1 = a->c1.c1;
+    fp2_t z5 = a->c1.c2;
+    fp2_t t0, t1, t2, t3;
+
+    fp4Sqr(&t0, &t1, &z0, &z1);
+    fp2Sub(&z0, &t0, &z0);
+    fp2Double(&z0, &z0);
+    fp2Add(&z0, &z0, &t0);
+    fp2Add(&z1, &t1, &z1);
+    fp2Double(&z1, &z1);
+    fp2Add(&z1, &z1, &t1);
+
+    fp4Sqr(&t0, &t1, &z2, &z3);
+    fp4Sqr(&t2, &t3, &z4, &z5);
+    fp2Sub(&z4, &t0, &z4);
+    fp2Double(&z4, &z4);
+    fp2Add(&z4, &z4, &t0);
+    fp2Add(&z5, &t1, &z5);
+    fp2Double(&z5, &z5);
+    fp2Add(&z5, &z5, &t1);
+
+    fp2MulXi(&t0, &t3);
+    fp2Add(&z2, &t0, &z2);
+    fp2Double(&z2, &z2);
+    fp2Add(&z2, &z2, &t0);
+    fp2Sub(&z3, &t2, &z3);
+    fp2Double(&z3, &z3);
+    fp2Add(&z3, &z3, &t2);
+
+    out->c0.c0 = z0;
+    out->c0.c1 = z4;
+    out->c0.c2 = z3;
+    out->c1.c0 = z2;
+    out->c1.c1 = z1;
+    out->c1.c2 = z5;
+}
+
+// a^x for a in the cyclotomic subgroup, where inversion is conjugation
+static void fp12ExpByX(fp12_t *out, const fp12_t *a) {
+    fp12_t result = *a;
+    for (int bit = 62; bit >= 0; bit--) {
+        fp12CyclotomicSqr(&result, &result);
+        if ((X_ABS >> bit) & 1) {
+            fp12Mul(&result, &result, a);
+        }
+    }
+    fp12Conj(out, &result);
+}
+
+static void finalExponentiation(fp12_t *f) {
+    fp12_t t, a, b, c;
+    // easy part: f^((p^6 - 1)(p^2 + 1))
+    fp12Inv(&t, f);
+    fp12Conj(f, f);
+    fp12Mul(f, f, &t);
+    fp12Frobenius(&t, f);
+    fp12Frobenius(&t, &t);
+    fp12Mul(f, f, &t);
+
+    // hard part, raised to 3 (p^4 - p^2 + 1) / r = (x - 1)^2 (x + p) (x^2 + p^2 - 1) + 3
+    // cubing is harmless since 3 does not divide r
+    fp12ExpByX(&a, f);
+    fp12Conj(&t, f);
+    fp12Mul(&a, &a, &t);
+    fp12ExpByX(&b, &a);
+    fp12Conj(&t, &a);
+    fp12Mul(&a, &b, &t);
+
+    fp12ExpByX(&b, &a);
+    fp12Frobenius(&t, &a);
+    fp12Mul(&b, &b, &t);
+
+    fp12ExpByX(&c, &b);
+    fp12ExpByX(&c, &c);
+    fp12Frobenius(&t, &b);
+    fp12Frobenius(&t, &t);
+    fp12Mul(&c, &c, &t);
+    fp12Conj(&t, &b);
+    fp12Mul(&c, &c, &t);
+
+    fp12CyclotomicSqr(&t, f);
+    fp12Mul(&t, &t, f);
+    fp12Mul(f, &c, &t);
+}
+
+// G1 in Jacobian coordinates, infinity when z is zero
+
+typedef struct g1Jacobian {
+    fp_t x;
+    fp_t y;
+    fp_t z;
+} g1Jacobian_t;
+
+static inline void g1ToJacobian(g1Jacobian_t *out, const g1_t *a) {
+    if (a->infinity) {
+        memset(out, 0, sizeof(g1Jacobian_t));
+        return;
+    }
+    out->x = a->x;
+    out->y = a->y;
+    out->z = ONE;
+}
+
+static void g1FromJacobian(g1_t *out, const g1Jacobian_t *a) {
+    if (fpIsZero(&a->z)) {
+        memset(out, 0, sizeof(g1_t));
+        out->infinity = true;
+        return;
+    }
+    fp_t zInv, zInv2, zInv3;
+    fpInv(&zInv, &a->z);
+    fpSqr(&zInv2, &zInv);
+    fpMul(&zInv3, &zInv2, &zInv);
+    fpMul(&out->x, &a->x, &zInv2);
+    fpMul(&out->y, &a->y, &zInv3);
+    out->infinity = false;
+}
+
+// dbl-2009-l
+static void g1JacobianDouble(g1Jacobian_t *out, const g1Jacobian_t *a) {
+    if (fpIsZero(&a->z)) {
+        *out = *a;
+        return;
+    }
+    fp_t A, B, C, D, E, F, t;
+    fpSqr(&A, &a->x);
+    fpSqr(&B, &a->y);
+    fpSqr(&C, &B);
+    fpAdd(&D, &a->x, &B);
+    fpSqr(&D, &D);
+    fpSub(&D, &D, &A);
+    fpSub(&D, &D, &C);
+    fpDouble(&D, &D);
+    fpDouble(&E, &A);
+    fpAdd(&E, &E, &A);
+    fpSqr(&F, &E);
+
+    fpMul(&out->z, &a->y, &a->z);
+    fpDouble(&out->z, &out->z);
+    fpDouble(&t, &D);
+    fpSub(&out->x, &F, &t);
+    fpSub(&t, &D, &out->x);
+    fpMul(&t, &E, &t);
+    fpDouble(&C, &C);
+    fpDouble(&C, &C);
+    fpDouble(&C, &C);
+    fpSub(&out->y, &t, &C);
+}
+
+// add-2007-bl
+static void g1JacobianAdd(g1Jacobian_t *out, const g1Jacobian_t *a, const g1Jacobian_t *b) {
+    if (fpIsZero(&a->z)) {
+        *out = *b;
+        return;
+    }
+    if (fpIsZero(&b->z)) {
+        *out = *a;
+        return;
+    }
+    fp_t z1z1, z2z2, u1, u2, s1, s2, h, i, j, r, v, t;
+    fpSqr(&z1z1, &a->z);
+    fpSqr(&z2z2, &b->z);
+    fpMul(&u1, &a->x, &z2z2);
+    fpMul(&u2, &b->x, &z1z1);
+    fpMul(&s1, &a->y, &b->z);
+    fpMul(&s1, &s1, &z2z2);
+    fpMul(&s2, &b->y, &a->z);
+    fpMul(&s2, &s2, &z1z1);
+    fpSub(&h, &u2, &u1);
+    fpSub(&r, &s2, &s1);
+    if (fpIsZero(&h)) {
+        if (fpIsZero(&r)) {
+            g1JacobianDouble(out, a);
+        } else {
+            memset(out, 0, sizeof(g1Jacobian_t));
+        }
+        return;
+    }
+    fpDouble(&r, &r);
+    fpDouble(&i, &h);
+    fpSqr(&i, &i);
+    fpMul(&j, &h, &i);
+    fpMul(&v, &u1, &i);
+
+    fpAdd(&t, &a->z, &b->z);
+    fpSqr(&t, &t);
+    fpSub(&t, &t, &z1z1);
+    fpSub(&t, &t, &z2z2);
+    fpMul(&out->z, &t, &h);
+
+    fpSqr(&out->x, &r);
+    fpSub(&out->x, &out->x, &j);
+    fpSub(&out->x, &out->x, &v);
+    fpSub(&out->x, &out->x, &v);
+
+    fpSub(&t, &v, &out->x);
+    fpMul(&t, &r, &t);
+    fpMul(&s1, &s1, &j);
+    fpDouble(&s1, &s1);
+    fpSub(&out->y, &t, &s1);
+}
+
+// 4-bit fixed windows
+static void g1JacobianMul(g1Jacobian_t *out, const g1Jacobian_t *a, const uint64_t scalar[4]) {
+    g1Jacobian_t multiples[16];
+    memset(multiples, 0, sizeof(g1Jacobian_t));
+    multiples[1] = *a;
+    for (int digit = 2; digit < 16; digit++) {
+        g1JacobianAdd(multiples + digit, multiples + digit - 1, a);
+    }
+    g1Jacobian_t result;
+    memset(&result, 0, sizeof(result));
+    for (int i = 3; i >= 0; i--) {
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            for (int j = 0; j < 4; j++) {
+                g1JacobianDouble(&result, &result);
+            }
+            uint8_t digit = (scalar[i] >> shift) & 0xf;
+            if (digit) {
+                g1JacobianAdd(&result, &result, multiples + digit);
+            }
+        }
+    }
+    *out = result;
+}
+
+static void g1JacobianMulByXAbs(g1Jacobian_t *out, const g1Jacobian_t *a) {
+    g1Jacobian_t result = *a;
+    for (int bit = 62; bit >= 0; bit--) {
+        g1JacobianDouble(&result, &result);
+        if ((X_ABS >> bit) & 1) {
+            g1JacobianAdd(&result, &result, a);
+        }
+    }
+    *out = result;
+}
+
+static inline void scalarFromBytes(uint64_t scalar[4], const uint8_t bytes[32]) {
+    for (int i = 0; i < 4; i++) {
+        uint64_t limb = 0;
+        for (int j = 0; j < 8; j++) {
+            limb = (limb << 8) | bytes[(3 - i) * 8 + j];
+        }
+        scalar[i] = limb;
+    }
+}
+
+// generatorTable[window][digit] = digit * 16^window * G
+#define G1_TABLE_WINDOWS 64
+static g1Jacobian_t generatorTable[G1_TABLE_WINDOWS][16];
+static bool initialized = false;
+
+void bls12381Init() {
+    if (initialized) {
+        return;
+    }
+    frobeniusGamma[0] = FP2_ONE;
+    fp2_t xi;
+    fp2MulXi(&xi, &FP2_ONE);
+    fp2Pow(frobeniusGamma + 1, &xi, P_MINUS_1_DIV_6);
+    for (int k = 2; k < 6; k++) {
+        fp2Mul(frobeniusGamma + k, frobeniusGamma + k - 1, frobeniusGamma + 1);
+    }
+
+    g1Jacobian_t base;
+    g1ToJacobian(&base, &g1Generator);
+    for (int window = 0; window < G1_TABLE_WINDOWS; window++) {
+        memset(generatorTable[window], 0, sizeof(g1Jacobian_t));
+        for (int digit = 1; digit < 16; digit++) {
+            g1JacobianAdd(generatorTable[window] + digit, generatorTable[window] + digit - 1, &base);
+        }
+        for (int i = 0; i < 4; i++) {
+            g1JacobianDouble(&base, &base);
+        }
+    }
+    initialized = true;
+}
+
+// a cube root of unity such that phi(x, y) = (beta x, y) acts on G1 as multiplication by -x^2
+static const fp_t BETA = {{0x30f1361b798a64e8ull, 0xf3b8ddab7ece5a2aull, 0x16a8ca3ac61577f7ull, 0xc26a2ff874fd029bull, 0x3636b76660701c6eull, 0x051ba4ab241b6160ull}};
+
+// Scott, A note on group membership tests for G1, G2 and GT on BLS pairing-friendly curves: P is in G1 iff phi(P) = -[x^2]P
+static bool g1IsInSubgroup(const g1_t *a) {
+    if (a->infinity) {
+        return true;
+    }
+    g1Jacobian_t point;
+    g1ToJacobian(&point, a);
+    g1JacobianMulByXAbs(&point, &point);
+    g1JacobianMulByXAbs(&point, &point);
+    if (fpIsZero(&point.z)) {
+        return false;
+    }
+    // compare (beta x, -y) with (X / Z^2, Y / Z^3)
+    fp_t z2, z3, lhs, rhs;
+    fpSqr(&z2, &point.z);
+    fpMul(&z3, &z2, &point.z);
+    fpMul(&lhs, &a->x, &BETA);
+    fpMul(&lhs, &lhs, &z2);
+    if (!fpEqual(&lhs, &point.x)) {
+        return false;
+    }
+    fpNeg(&rhs, &a->y);
+    fpMul(&rhs, &rhs, &z3);
+    return fpEqual(&rhs, &point.y);
+}
+
+#define COMPRESSION_FLAG 0x80
+#define INFINITY_FLAG 0x40
+#define SIGN_FLAG 0x20
+
+bool g1Decompress(g1_t *point, const uint8_t compressed[48]) {
+    uint8_t flags = compressed[0] & 0xe0;
+    if (!(flags & COMPRESSION_FLAG)) {
+        return false;
+    }
+    uint8_t x[48];
+    memcpy(x, compressed, 48);
+    x[0] &= 0x1f;
+    if (flags & INFINITY_FLAG) {
+        if (flags & SIGN_FLAG) {
+            return false;
+        }
+        for (int i = 0; i < 48; i++) {
+            if (x[i]) {
+                return false;
+            }
+        }
+        memset(point, 0, sizeof(g1_t));
+        point->infinity = true;
+        return true;
+    }
+    if (!fpFromBytes(&point->x, x)) {
+        return false;
+    }
+    fp_t y2;
+    fpSqr(&y2, &point->x);
+    fpMul(&y2, &y2, &point->x);
+    fpAdd(&y2, &y2, &B);
+    if (!fpSqrt(&point->y, &y2)) {
+        return false;
+    }
+    if (fpIsLexicographicallyLargest(&point->y) != !!(flags & SIGN_FLAG)) {
+        fpNeg(&point->y, &point->y);
+    }
+    point->infinity = false;
+    return g1IsInSubgroup(point);
+}
+
+void g1Mul(g1_t *out, const g1_t *point, const uint8_t scalar[32]) {
+    uint64_t limbs[4];
+    scalarFromBytes(limbs, scalar);
+    g1Jacobian_t result;
+    g1ToJacobian(&result, point);
+    g1JacobianMul(&result, &result, limbs);
+    g1FromJacobian(out, &result);
+}
+
+void g1MulGenerator(g1_t *out, const uint8_t scalar[32]) {
+    bls12381Init();
+    g1Jacobian_t result;
+    memset(&result, 0, sizeof(result));
+    for (int window = 0; window < G1_TABLE_WINDOWS; window++) {
+        uint8_t digit = (scalar[31 - window / 2] >> (4 * (window & 1))) & 0xf;
+        if (digit) {
+            g1JacobianAdd(&result, &result, generatorTable[window] + digit);
+        }
+    }
+    g1FromJacobian(out, &result);
+}
+
+void g1LinearCombination(g1_t *out, const g1_t *addend, const g1_t *point, const uint8_t scalar[32], const uint8_t generatorScalar[32]) {
+    bls12381Init();
+    uint64_t limbs[4];
+    scalarFromBytes(limbs, scalar);
+    g1Jacobian_t result, term;
+    g1ToJacobian(&result, point);
+    g1JacobianMul(&result, &result, limbs);
+    g1ToJacobian(&term, addend);
+    g1JacobianAdd(&result, &result, &term);
+    for (int window = 0; window < G1_TABLE_WINDOWS; window++) {
+        uint8_t digit = (generatorScalar[31 - window / 2] >> (4 * (window & 1))) & 0xf;
+        if (digit) {
+            g1JacobianAdd(&result, &result, generatorTable[window] + digit);
+        }
+    }
+    g1FromJacobian(out, &result);
+}
+
+void g1Add(g1_t *out, const g1_t *a, const g1_t *b) {
+    g1Jacobian_t ja, jb;
+    g1ToJacobian(&ja, a);
+    g1ToJacobian(&jb, b);
+    g1JacobianAdd(&ja, &ja, &jb);
+    g1FromJacobian(out, &ja);
+}
+
+void g1Neg(g1_t *out, const g1_t *point) {
+    *out = *point;
+    fpNeg(&out->y, &point->y);
+}
+
+bool g1Equal(const g1_t *a, const g1_t *b) {
+    if (a->infinity || b->infinity) {
+        return a->infinity == b->infinity;
+    }
+    return fpEqual(&a->x, &b->x) && fpEqual(&a->y, &b->y);
+}
+
+// G2 in affine coordinates on the twist y^2 = x^3 + 4 xi
+
+// the slope of the tangent at a or of the chord through a and b
+static void g2AddWithSlope(g2_t *out, fp2_t *slope, const g2_t *a, const g2_t *b) {
+    if (a->infinity) {
+        *out = *b;
+        return;
+    }
+    if (b->infinity) {
+        *out = *a;
+        return;
+    }
+    fp2_t numerator, denominator, x3, t;
+    if (fp2Equal(&a->x, &b->x)) {
+        if (!fp2Equal(&a->y, &b->y) || fp2IsZero(&a->y)) {
+            memset(out, 0, sizeof(g2_t));
+            out->infinity = true;
+            return;
+        }
+        fp2Sqr(&numerator, &a->x);
+        fp2Add(&t, &numerator, &numerator);
+        fp2Add(&numerator, &t, &numerator);
+        fp2Double(&denominator, &a->y);
+    } else {
+        fp2Sub(&numerator, &b->y, &a->y);
+        fp2Sub(&denominator, &b->x, &a->x);
+    }
+    fp2Inv(&denominator, &denominator);
+    fp2Mul(slope, &numerator, &denominator);
+    fp2Sqr(&x3, slope);
+    fp2Sub(&x3, &x3, &a->x);
+    fp2Sub(&x3, &x3, &b->x);
+    fp2Sub(&t, &a->x, &x3);
+    fp2Mul(&t, slope, &t);
+    fp2Sub(&out->y, &t, &a->y);
+    out->x = x3;
+    out->infinity = false;
+}
+
+static bool g2IsInSubgroup(const g2_t *a) {
+    g2_t result;
+    fp2_t slope;
+    memset(&result, 0, sizeof(result));
+    result.infinity = true;
+    for (int i = 3; i >= 0; i--) {
+        for (int bit = 63; bit >= 0; bit--) {
+            g2AddWithSlope(&result, &slope, &result, &result);
+            if ((R[i] >> bit) & 1) {
+                g2AddWithSlope(&result, &slope, &result, a);
+            }
+        }
+    }
+    return result.infinity;
+}
+
+bool g2Decompress(g2_t *point, const uint8_t compressed[96]) {
+    uint8_t flags = compressed[0] & 0xe0;
+    if (!(flags & COMPRESSION_FLAG)) {
+        return false;
+    }
+    uint8_t x[96];
+    memcpy(x, compressed, 96);
+    x[0] &= 0x1f;
+    if (flags & INFINITY_FLAG) {
+        if (flags & SIGN_FLAG) {
+            return false;
+        }
+        for (int i = 0; i < 96; i++) {
+            if (x[i]) {
+                return false;
+            }
+        }
+        memset(point, 0, sizeof(g2_t));
+        point->infinity = true;
+        return true;
+    }
+    // c1 is serialized first
+    if (!fpFromBytes(&point->x.c1, x) || !fpFromBytes(&point->x.c0, x + 48)) {
+        return false;
+    }
+    fp2_t y2, b;
+    fp2Sqr(&y2, &point->x);
+    fp2Mul(&y2, &y2, &point->x);
+    b.c0 = B;
+    b.c1 = B;
+    fp2Add(&y2, &y2, &b);
+    if (!fp2Sqrt(&point->y, &y2)) {
+        return false;
+    }
+    if (fp2IsLexicographicallyLargest(&point->y) != !!(flags & SIGN_FLAG)) {
+        fp2Neg(&point->y, &point->y);
+    }
+    point->infinity = false;
+    return g2IsInSubgroup(point);
+}
+
+// Miller loop
+
+/*
+ * Under the untwist (x, y) -> (x / w^2, y / w^3) the line through T with twist slope s, evaluated at P and scaled by w^3, is
+ *     (s xT - yT) - s xP w^2 + yP w^3
+ * and the w^3 factor lies in a subfield that the final exponentiation sends to one.
+ * The intercept s xT - yT depends only on the G2 point, so it is prepared along with the slope.
+ */
+void g2Prepare(g2Prepared_t *prepared, const g2_t *point) {
+    prepared->infinity = point->infinity;
+    if (point->infinity) {
+        return;
+    }
+    g2_t t = *point;
+    uint8_t line = 0;
+    for (int bit = 62; bit >= 0; bit--) {
+        fp2_t *slope = prepared->slope + line;
+        fp2_t *intercept = prepared->intercept + line;
+        line++;
+        g2_t doubled;
+        g2AddWithSlope(&doubled, slope, &t, &t);
+        fp2Mul(intercept, slope, &t.x);
+        fp2Sub(intercept, intercept, &t.y);
+        t = doubled;
+        if ((X_ABS >> bit) & 1) {
+            slope = prepared->slope + line;
+            intercept = prepared->intercept + line;
+            line++;
+            g2_t sum;
+            g2AddWithSlope(&sum, slope, &t, point);
+            fp2Mul(intercept, slope, &t.x);
+            fp2Sub(intercept, intercept, &t.y);
+            t = sum;
+        }
+    }
+}
+
+bool pairingProductIsOne(const g1_t *p, const g2Prepared_t *const q[], size_t count) {
+    bls12381Init();
+    fp12_t f;
+    fp12SetOne(&f);
+    uint8_t line = 0;
+    for (int bit = 62; bit >= 0; bit--) {
+        fp12Sqr(&f, &f);
+        uint8_t lines = (X_ABS >> bit) & 1 ? 2 : 1;
+        for (uint8_t l = 0; l < lines; l++, line++) {
+            for (size_t i = 0; i < count; i++) {
+                if (p[i].infinity || q[i]->infinity) {
+                    continue;
+                }
+                fp2_t l2, l3;
+                fp2MulFp(&l2, q[i]->slope + line, &p[i].x);
+                fp2Neg(&l2, &l2);
+                l3.c0 = p[i].y;
+                memset(&l3.c1, 0, sizeof(fp_t));
+                fp12MulLine(&f, q[i]->intercept + line, &l2, &l3);
+            }
+        }
+    }
+    // x is negative
+    fp12Conj(&f, &f);
+    finalExponentiation(&f);
+    return fp12IsOne(&f);
+}
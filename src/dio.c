@@ -2,11 +2,15 @@
 #include "path.h"
 #include "vector.h"
 
+#include <ctype.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <poll.h>
+#include <setjmp.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 
@@ -28,6 +32,16 @@ static inline int jsonIgnores(char ch) {
 
 static uint64_t lineNumber = 0;
 
+// set while serving, where a malformed request is answered with an error instead of exiting
+static jmp_buf *jsonRecovery = NULL;
+
+static __attribute__((noreturn)) void jsonFail() {
+    if (jsonRecovery) {
+        longjmp(*jsonRecovery, 1);
+    }
+    _exit(1);
+}
+
 static void jsonScanWaste(const char **iter) {
     for (; jsonIgnores(**iter); (*iter)++) {
         if (**iter == '\n') {
@@ -44,7 +58,7 @@ static void jsonScanChar(const char **iter, char expected) {
             }
         } else {
             fprintf(stderr, "Config: when seeking '%c' found unexpected character '%c' on line %" PRIu64 "\n", expected, ch, lineNumber);
-            _exit(1);
+            jsonFail();
         }
     }
     (*iter)++;
@@ -52,7 +66,7 @@ static void jsonScanChar(const char **iter, char expected) {
 
 static void jsonFailExpectingChar(char expected, char actual) {
     fprintf(stderr, "Config: expecting '%c', found '%c' on line %" PRIu64 "\n", expected, actual, lineNumber);
-    _exit(1);
+    jsonFail();
 }
 
 static void jsonSkipExpectedChar(const char **iter, char expected) {
@@ -73,6 +87,20 @@ static const char *jsonScanStr(const char **iter) {
     return start;
 }
 
+static bool jsonScanBool(const char **iter) {
+    jsonScanWaste(iter);
+    if (strncmp(*iter, "true", 4) == 0) {
+        *iter += 4;
+        return true;
+    }
+    if (strncmp(*iter, "false", 5) == 0) {
+        *iter += 5;
+        return false;
+    }
+    fprintf(stderr, "Config: expecting true or false on line %" PRIu64 "\n", lineNumber);
+    jsonFail();
+}
+
 // attempt to skip entry of unknown json type
 // ends at ',' or '}'
 static void jsonSkipEntryValue(const char **iter) {
@@ -125,9 +153,10 @@ static void jsonSkipEntryValue(const char **iter) {
 typedef struct storageEntry {
     uint256_t key;
     uint256_t value;
-    struct storageEntry *prev;
 } storageEntry_t;
 
+VECTOR(storageEntry, storageEntries);
+
 typedef struct logsEntry {
     address_t address;
     logChanges_t *logs;
@@ -164,11 +193,16 @@ typedef struct testEntry {
     uint64_t *blockNumber;
     uint64_t *timestamp;
     uint64_t debug;
+    // whether the world state is restored after the test
+    bool isolate;
     testResult_t result;
 
     struct testEntry *prev;
 } testEntry_t;
 
+// the entry being scanned, freed when serving a malformed request
+static testEntry_t *scanningTest = NULL;
+
 typedef struct entry {
     address_t *address;
     val_t balance;
@@ -176,14 +210,158 @@ typedef struct entry {
     address_t *creator;
     data_t initCode;
     data_t code;
-    storageEntry_t *storage;
+    // in file order
+    storageEntries_t storage;
     testEntry_t *tests;
     testEntry_t *constructTest;
     char *path;
     char *importPath;
 } entry_t;
 
+VECTOR(entry, entries);
+
+// imports are parsed once per process and applied again from their entries
+typedef struct import {
+    char *path;
+    struct timespec mtime;
+    off_t size;
+    uint8_t hash[32];
+    // the entries point into the file, which stays mapped
+    entries_t entries;
+    struct import *next;
+} import_t;
+
+static import_t *imports = NULL;
+
 static int anyTestFailure = 0;
+// the config file being applied, for reports
+static const char *currentConfigFile = "";
+
+// measures a transaction for reports
+typedef struct measurement {
+    struct timespec start;
+    uint64_t startOps;
+} measurement_t;
+
+static void measureStart(measurement_t *measurement) {
+    measurement->startOps = evmOpCount();
+    clock_gettime(CLOCK_MONOTONIC, &measurement->start);
+}
+
+static void measureEnd(measurement_t *measurement, uint64_t *nanos, uint64_t *ops) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *nanos = (end.tv_sec - measurement->start.tv_sec) * 1000000000ull + end.tv_nsec - measurement->start.tv_nsec;
+    *ops = evmOpCount() - measurement->startOps;
+}
+
+static bool timingEnabled = false;
+static uint16_t benchWarmup = 0;
+static uint16_t benchRepeat = 0;
+
+void setTiming(bool enabled, uint16_t warmup, uint16_t repeat) {
+    timingEnabled = enabled;
+    benchWarmup = warmup;
+    benchRepeat = repeat;
+}
+
+typedef struct transaction {
+    bool create;
+    address_t from;
+    address_t to;
+    uint64_t gas;
+    val_t value;
+    data_t input;
+    const accessList_t *accessList;
+} transaction_t;
+
+typedef struct timing {
+    // the median of the repeated runs when benchmarking
+    uint64_t nanos;
+    uint64_t p99;
+    uint64_t ops;
+} timing_t;
+
+static result_t transact(transaction_t *tx) {
+    if (tx->create) {
+        return evmConstruct(tx->from, tx->to, tx->gas, tx->value, tx->input);
+    }
+    return txCall(tx->from, tx->gas, tx->to, tx->value, tx->input, tx->accessList);
+}
+
+static int compareNanos(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+    return left < right ? -1 : left > right;
+}
+
+// with --bench-repeat, the transaction is first run repeatedly from the same world state, discarding its effects
+static result_t measureTransaction(transaction_t *tx, uint64_t debug, timing_t *timing) {
+    measurement_t measurement;
+    uint64_t nanos;
+    if (benchRepeat) {
+        evmSetDebug(0);
+        uint64_t *samples = malloc(benchRepeat * sizeof(uint64_t));
+        uint16_t snapshot = evmSnapshot();
+        for (uint32_t run = 0; run < (uint32_t)benchWarmup + benchRepeat; run++) {
+            measureStart(&measurement);
+            result_t discarded = transact(tx);
+            measureEnd(&measurement, &nanos, &timing->ops);
+            // the return data is a slice of frame memory owned by the evm
+            evmFreeStateChanges(discarded.stateChanges);
+            if (run >= benchWarmup) {
+                samples[run - benchWarmup] = nanos;
+            }
+            evmRestore(snapshot);
+        }
+        evmRelease(snapshot);
+        qsort(samples, benchRepeat, sizeof(uint64_t), compareNanos);
+        timing->nanos = samples[benchRepeat / 2];
+        // nearest rank
+        timing->p99 = samples[(benchRepeat * 99 + 99) / 100 - 1];
+        free(samples);
+    }
+    evmSetDebug(debug);
+    measureStart(&measurement);
+    result_t result = transact(tx);
+    measureEnd(&measurement, &nanos, &timing->ops);
+    if (!benchRepeat) {
+        timing->nanos = timing->p99 = nanos;
+    }
+    return result;
+}
+
+static void fprintNanos(FILE *file, uint64_t nanos) {
+    if (nanos < 10000) {
+        fprintf(file, "%" PRIu64 "ns", nanos);
+    } else if (nanos < 10000000) {
+        fprintf(file, "%.2fus", nanos / 1e3);
+    } else if (nanos < 10000000000) {
+        fprintf(file, "%.2fms", nanos / 1e6);
+    } else {
+        fprintf(file, "%.2fs", nanos / 1e9);
+    }
+}
+
+static void printTiming(uint64_t gasUsed, const timing_t *timing) {
+    fprintf(stderr, "    %" PRIu64 " gas", gasUsed);
+    if (benchRepeat) {
+        fputs(" median ", stderr);
+        fprintNanos(stderr, timing->nanos);
+        fputs(" p99 ", stderr);
+        fprintNanos(stderr, timing->p99);
+    } else {
+        fputs(" in ", stderr);
+        fprintNanos(stderr, timing->nanos);
+    }
+    if (timing->nanos) {
+        fprintf(stderr, " (%.2f Mgas/s)", gasUsed * 1e3 / timing->nanos);
+    }
+    if (benchRepeat) {
+        fprintf(stderr, " over %" PRIu16 " runs", benchRepeat);
+    }
+    fputc('\n', stderr);
+}
 
 static void printEntryHeader(const entry_t *entry) {
     fputs("# ", stderr);
@@ -195,7 +373,8 @@ static void printEntryHeader(const entry_t *entry) {
     fputc('\n', stderr);
 }
 
-static void reportResult(testEntry_t *test, result_t *result, uint64_t gas, const char *fallbackName, bool statusFail) {
+// returns whether the test passed
+static bool reportResult(testEntry_t *test, result_t *result, uint64_t gas, const char *fallbackName, bool statusFail) {
     uint64_t gasUsed = gas - result->gasRemaining;
     test->result.gasUsed = gasUsed;
 
@@ -279,11 +458,32 @@ static void reportResult(testEntry_t *test, result_t *result, uint64_t gas, cons
     } else {
         fprintf(stderr, "\033[0;32mpass\033[0m\n");
     }
+    return !testFailure;
+}
+
+// prints the timing and records the test for reports
+static void recordTest(const entry_t *entry, const testEntry_t *test, const char *fallbackName, bool passed, const timing_t *timing) {
+    if (timingEnabled) {
+        printTiming(test->result.gasUsed, timing);
+    }
+    if (!reportEnabled()) {
+        return;
+    }
+    char address[43];
+    if (!entry->path) {
+        address[0] = '0';
+        address[1] = 'x';
+        for (uint8_t i = 0; i < 20; i++) {
+            sprintf(address + 2 + i * 2, "%02x", entry->address->address[i]);
+        }
+    }
+    reportTest(currentConfigFile, entry->path ? entry->path : address, test->name ? test->name : fallbackName, passed, test->result.gasUsed, timing->nanos, timing->ops);
 }
 
-static void runConstructTest(const entry_t *entry, testEntry_t *test, result_t *result, uint64_t gas) {
+static void runConstructTest(const entry_t *entry, testEntry_t *test, result_t *result, uint64_t gas, const timing_t *timing) {
     printEntryHeader(entry);
-    reportResult(test, result, gas, "constructor", false);
+    bool passed = reportResult(test, result, gas, "constructor", false);
+    recordTest(entry, test, "constructor", passed, timing);
 }
 
 static uint64_t runTests(const entry_t *entry, testEntry_t *test, bool headerPrinted) {
@@ -295,24 +495,38 @@ static uint64_t runTests(const entry_t *entry, testEntry_t *test, bool headerPri
         printEntryHeader(entry);
     }
 
-    evmSetDebug(test->debug);
     if (test->blockNumber) {
         evmSetBlockNumber(*test->blockNumber);
-        free(test->blockNumber);
     }
     if (test->timestamp) {
         evmSetTimestamp(*test->timestamp);
-        free(test->timestamp);
     }
-    uint64_t gas = 0xffffffffffffffff;
+    // TODO support evmStaticCall
+    transaction_t tx;
+    tx.create = false;
+    AddressCopy(tx.from, test->from);
+    tx.to = test->to ? *test->to : *entry->address;
+    tx.gas = 0xffffffffffffffff;
     if (test->gas) {
-        gas = test->gas;
+        tx.gas = test->gas;
     }
-    // TODO support evmStaticCall
-    result_t result = txCall(test->from, gas, test->to ? *test->to : *entry->address, test->value, test->input, test->accessList);
+    memcpy(tx.value, test->value, sizeof(val_t));
+    tx.input = test->input;
+    tx.accessList = test->accessList;
+    uint16_t snapshot = 0;
+    if (test->isolate) {
+        snapshot = evmSnapshot();
+    }
+    timing_t timing;
+    result_t result = measureTransaction(&tx, test->debug, &timing);
     char indexStr[24];
     snprintf(indexStr, sizeof(indexStr), "%" PRIu64, testsRun);
-    reportResult(test, &result, gas, indexStr, test->op == CREATE);
+    bool passed = reportResult(test, &result, tx.gas, indexStr, test->op == CREATE);
+    recordTest(entry, test, indexStr, passed, &timing);
+    if (test->isolate) {
+        evmRestore(snapshot);
+        evmRelease(snapshot);
+    }
     return ++testsRun;
 }
 
@@ -333,54 +547,65 @@ static void verifyConstructResult(result_t *constructResult, entry_t *entry) {
     }
 }
 
-static void applyEntry(entry_t *entry) {
-    if (entry->importPath) {
-        loadConfig(entry->importPath, false);
+static void importConfig(const char *importPath);
+
+// entries are left intact so that imported entries can be applied again
+static void applyEntry(const entry_t *parsed) {
+    if (parsed->importPath) {
+        importConfig(parsed->importPath);
         return;
     }
+    entry_t copy = *parsed;
+    entry_t *entry = &copy;
+    // each application of an entry without an address gets a new one
+    address_t anonymous;
     if (entry->address == NULL) {
-        entry->address = calloc(1, sizeof(address_t));
-        entry->address->address[0] = 0xaa;
-        entry->address->address[1] = 0xbb;
+        bzero(&anonymous, sizeof(anonymous));
+        anonymous.address[0] = 0xaa;
+        anonymous.address[1] = 0xbb;
         static uint32_t anonymousId;
-        *(uint32_t *)(&entry->address->address[15]) = anonymousId++;
+        *(uint32_t *)(&anonymous.address[15]) = anonymousId++;
+        entry->address = &anonymous;
     }
     bool constructHeaderPrinted = false;
     if (entry->initCode.size) {
-        address_t from;
+        transaction_t tx;
+        tx.create = true;
         if (entry->creator) {
-            AddressCopy(from, (*entry->creator));
+            AddressCopy(tx.from, (*entry->creator));
         } else {
-            bzero(&from, sizeof(from));
+            bzero(&tx.from, sizeof(tx.from));
         }
-        uint64_t gas = 0xffffffffffffffff;
+        AddressCopy(tx.to, (*entry->address));
+        tx.gas = 0xffffffffffffffff;
+        uint64_t debug = 0;
         if (entry->constructTest) {
             if (!AddressZero(&entry->constructTest->from)) {
                 if (entry->creator && !AddressEqual(&entry->constructTest->from, entry->creator)) {
                     fprintf(stderr, "constructTest.from conflicts with creator\n");
                     _exit(1);
                 }
-                AddressCopy(from, entry->constructTest->from);
+                AddressCopy(tx.from, entry->constructTest->from);
             }
             if (entry->constructTest->gas) {
-                gas = entry->constructTest->gas;
+                tx.gas = entry->constructTest->gas;
             }
-            evmSetDebug(entry->constructTest->debug);
+            debug = entry->constructTest->debug;
             if (entry->constructTest->blockNumber) {
                 evmSetBlockNumber(*entry->constructTest->blockNumber);
-                free(entry->constructTest->blockNumber);
             }
             if (entry->constructTest->timestamp) {
                 evmSetTimestamp(*entry->constructTest->timestamp);
-                free(entry->constructTest->timestamp);
             }
         }
-        val_t value;
-        value[0] = 0;
-        value[1] = 0;
-        value[2] = 0;
-
-        result_t constructResult = evmConstruct(from, *entry->address, gas, value, entry->initCode);
+        tx.value[0] = 0;
+        tx.value[1] = 0;
+        tx.value[2] = 0;
+        tx.input = entry->initCode;
+        tx.accessList = NULL;
+
+        timing_t timing;
+        result_t constructResult = measureTransaction(&tx, debug, &timing);
         verifyConstructResult(&constructResult, entry);
         if (entry->constructTest) {
             // normalize status to 1/0 for test comparison: deployed address → 1
@@ -388,7 +613,7 @@ static void applyEntry(entry_t *entry) {
                 clear256(&constructResult.status);
                 LOWER(LOWER(constructResult.status)) = 1;
             }
-            runConstructTest(entry, entry->constructTest, &constructResult, gas);
+            runConstructTest(entry, entry->constructTest, &constructResult, tx.gas, &timing);
             constructHeaderPrinted = true;
         }
     } else if (entry->code.size) {
@@ -396,11 +621,11 @@ static void applyEntry(entry_t *entry) {
     }
     evmMockNonce(*entry->address, entry->nonce);
     evmMockBalance(*entry->address, entry->balance);
-    while (entry->storage != NULL) {
-        storageEntry_t *prev = entry->storage;
-        evmMockStorage(*entry->address, &prev->key, &prev->value);
-        entry->storage = prev->prev;
-        free(prev);
+    if (entry->storage.num_storageEntrys) {
+        evmReserveStorage(*entry->address, entry->storage.num_storageEntrys);
+    }
+    for (size_t i = 0; i < entry->storage.num_storageEntrys; i++) {
+        evmMockStorage(*entry->address, &entry->storage.storageEntrys[i].key, &entry->storage.storageEntrys[i].value);
     }
     runTests(entry, entry->tests, constructHeaderPrinted);
 }
@@ -444,10 +669,26 @@ static void jsonScanData(const char **iter, data_t *result){
     jsonSkipExpectedChar(&data, 'x');
     result->size = (*iter - data - 1) / 2;
     result->content = malloc(result->size);
-    for (size_t i = 0; i < result->size; i++) {
-        result->content[i] = hexString16ToUint8(data);
-        data += 2;
+    hexDecode(result->content, data, result->size);
+}
+
+// reads the hex digits up to the closing quote, keeping the lowest 256 bits
+static void jsonReadHex256(const char **iter, uint256_t *result) {
+    const char *start = *iter;
+    while (**iter != '"') {
+        (*iter)++;
+    }
+    size_t length = *iter - start;
+    if (length > 64) {
+        start += length - 64;
+        length = 64;
     }
+    char padded[64];
+    memset(padded, '0', 64 - length);
+    memcpy(padded + 64 - length, start, length);
+    uint8_t bytes[32];
+    hexDecode(bytes, padded, 32);
+    readu256BE(bytes, result);
 }
 
 static void jsonScanLog(const char **iter, logChanges_t **prev) {
@@ -473,7 +714,7 @@ static void jsonScanLog(const char **iter, logChanges_t **prev) {
                     fputc(logHeading[i], stderr);
                 }
                 fputc('\n', stderr);
-                _exit(1);
+                jsonFail();
             }
             jsonScanWaste(iter);
             if (**iter == ',') {
@@ -539,6 +780,7 @@ static address_t *jsonReadAddressString(const char **iter) {
 
 static testEntry_t *jsonScanTestEntry(const char **iter) {
     testEntry_t *test = calloc(1, sizeof(testEntry_t));
+    scanningTest = test;
     *(testResults.tail) = &test->result;
     testResults.tail = &test->result.next;
     LOWER(LOWER(test->status)) = 1;
@@ -563,7 +805,7 @@ static testEntry_t *jsonScanTestEntry(const char **iter) {
                         size_t accessListAccountLen = *iter - accessListAccount - 1;
                         if (accessListAccountLen != 42) {
                             fprintf(stderr, "Unexpected address length %zu\n", accessListAccountLen);
-                            _exit(1);
+                            jsonFail();
                         }
                         accessList->address = AddressFromHex42(accessListAccount);
 
@@ -629,6 +871,9 @@ static testEntry_t *jsonScanTestEntry(const char **iter) {
                     } while (1);
                 }
                 jsonSkipExpectedChar(iter, '}');
+            } else if (testHeadingLen == 7 && *testHeading == 'i') {
+                // isolate
+                test->isolate = jsonScanBool(iter);
             } else {
                 const char *testValue = jsonScanStr(iter);
                 size_t testValueLength = *iter - testValue - 1;
@@ -793,7 +1038,7 @@ static testEntry_t *jsonScanTestEntry(const char **iter) {
     return test;
 }
 
-static void jsonScanEntry(const char **iter) {
+static entry_t jsonScanEntry(const char **iter) {
     entry_t entry;
     bzero(&entry, sizeof(entry_t));
     jsonScanChar(iter, '{');
@@ -850,10 +1095,7 @@ static void jsonScanEntry(const char **iter) {
                 jsonSkipExpectedChar(&start, 'x');
                 entry.initCode.size = (*iter - start) / 2;
                 entry.initCode.content = calloc(entry.initCode.size, 1);
-                for (unsigned int i = 0; i < entry.initCode.size; i++) {
-                    entry.initCode.content[i] = hexString16ToUint8(start);
-                    start += 2;
-                }
+                hexDecode(entry.initCode.content, start, entry.initCode.size);
             } else {
                 size_t len = *iter - start - 1;
                 char *initcodePath = malloc(len + 1);
@@ -873,10 +1115,7 @@ static void jsonScanEntry(const char **iter) {
                 jsonSkipExpectedChar(&start, 'x');
                 entry.code.size = (*iter - start) / 2;
                 entry.code.content = calloc(entry.code.size, 1);
-                for (unsigned int i = 0; i < entry.code.size; i++) {
-                    entry.code.content[i] = hexString16ToUint8(start);
-                    start += 2;
-                }
+                hexDecode(entry.code.content, start, entry.code.size);
             } else {
                 size_t len = *iter - start - 1;
                 entry.path = malloc(len + 1);
@@ -935,31 +1174,23 @@ static void jsonScanEntry(const char **iter) {
         case 'rots':
             // storage
             jsonScanChar(iter, '{');
+            if (entry.storage.buffer_size == 0) {
+                storageEntries_init(&entry.storage, 16);
+            }
             do {
-                storageEntry_t *storageEntry = malloc(sizeof(storageEntry_t));
-                storageEntry->prev = entry.storage;
-                entry.storage = storageEntry;
+                storageEntry_t storageEntry;
                 jsonScanChar(iter, '"');
                 jsonSkipExpectedChar(iter, '0');
                 jsonSkipExpectedChar(iter, 'x');
-                clear256(&storageEntry->key);
-                while (**iter != '"') {
-                    shiftl256(&storageEntry->key, 4, &storageEntry->key);
-                    LOWER(LOWER(storageEntry->key)) |= hexString8ToUint8(**iter);
-                    (*iter)++;
-                }
+                jsonReadHex256(iter, &storageEntry.key);
                 jsonSkipExpectedChar(iter, '"');
                 jsonScanChar(iter, ':');
                 jsonScanChar(iter, '"');
                 jsonSkipExpectedChar(iter, '0');
                 jsonSkipExpectedChar(iter, 'x');
-                clear256(&storageEntry->value);
-                while (**iter != '"') {
-                    shiftl256(&storageEntry->value, 4, &storageEntry->value);
-                    LOWER(LOWER(storageEntry->value)) |= hexString8ToUint8(**iter);
-                    (*iter)++;
-                }
+                jsonReadHex256(iter, &storageEntry.value);
                 jsonSkipExpectedChar(iter, '"');
+                storageEntries_append(&entry.storage, storageEntry);
                 if (**iter == ',') {
                     jsonSkipExpectedChar(iter, ',');
                     jsonScanWaste(iter);
@@ -995,17 +1226,24 @@ static void jsonScanEntry(const char **iter) {
     } while (1);
     jsonScanChar(iter, '}');
 
-    applyEntry(&entry);
+    return entry;
 }
 
-void applyConfig(const char *json) {
+// applies each entry as it is parsed, keeping the entries in parsed when not NULL
+static void scanConfig(const char *json, entries_t *parsed) {
     testResults.head = NULL;
     testResults.tail = &testResults.head;
     lineNumber = 1;
 
     jsonScanChar(&json, '[');
     do {
-        jsonScanEntry(&json);
+        entry_t entry = jsonScanEntry(&json);
+        applyEntry(&entry);
+        if (parsed) {
+            entries_append(parsed, entry);
+        } else {
+            storageEntries_destroy(&entry.storage);
+        }
         jsonScanWaste(&json);
         if (*json == ',') {
             jsonSkipExpectedChar(&json, ',');
@@ -1017,10 +1255,153 @@ void applyConfig(const char *json) {
     } while (1);
     jsonScanChar(&json, ']');
     if (anyTestFailure) {
+        reportClose();
         _exit(1);
     }
 }
 
+void applyConfig(const char *json) {
+    scanConfig(json, NULL);
+}
+
+static void freeRequest(testEntry_t *request) {
+    free(request->name);
+    free(request->to);
+    free(request->input.content);
+    free(request->output.content);
+    free(request->blockNumber);
+    free(request->timestamp);
+    while (request->accessList != NULL) {
+        accessList_t *prev = request->accessList->prev;
+        while (request->accessList->storage != NULL) {
+            accessListStorage_t *prevSlot = request->accessList->storage->prev;
+            free(request->accessList->storage);
+            request->accessList->storage = prevSlot;
+        }
+        free(request->accessList);
+        request->accessList = prev;
+    }
+    free(request);
+}
+
+static void fprintJsonString(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', out);
+            fputc(*str, out);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(out, "\\u%04x", *str);
+        } else {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void fprintResponse(FILE *out, const testEntry_t *request, const result_t *result, uint64_t gas) {
+    fputc('{', out);
+    if (request->name) {
+        fputs("\"name\":", out);
+        fprintJsonString(out, request->name);
+        fputc(',', out);
+    }
+    fprintf(out, "\"gasUsed\":%" PRIu64 ",\"logs\":", gas - result->gasRemaining);
+    fprintLogs(out, result->stateChanges, true);
+    fprintf(
+        out,
+        ",\"status\":\"0x%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "\",\"returnData\":\"0x",
+        UPPER(UPPER(result->status)),
+        LOWER(UPPER(result->status)),
+        UPPER(LOWER(result->status)),
+        LOWER(LOWER(result->status))
+    );
+    fprintData(out, result->returnData);
+    fputs("\"}\n", out);
+}
+
+requestStats_t serveRequests(FILE *in, FILE *out, bool commit) {
+    requestStats_t stats;
+    bzero(&stats, sizeof(stats));
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, in)) > 0) {
+        const char *iter = line;
+        while (isspace(*iter)) {
+            iter++;
+        }
+        while (length && isspace(line[length - 1])) {
+            length--;
+        }
+        if (*iter == '\0') {
+            continue;
+        }
+        // the scanner treats NUL as whitespace, so the object must end the line
+        if (*iter != '{' || line[length - 1] != '}') {
+            fputs("{\"error\":\"expected one JSON object per line\"}\n", out);
+            fflush(out);
+            continue;
+        }
+        // requests are not written back like tests
+        testResults.head = NULL;
+        testResults.tail = &testResults.head;
+        lineNumber = 1;
+        jmp_buf recovery;
+        if (setjmp(recovery)) {
+            jsonRecovery = NULL;
+            freeRequest(scanningTest);
+            fputs("{\"error\":\"malformed request\"}\n", out);
+            fflush(out);
+            continue;
+        }
+        jsonRecovery = &recovery;
+        testEntry_t *request = jsonScanTestEntry(&iter);
+        jsonRecovery = NULL;
+
+        uint16_t snapshot = 0;
+        if (!commit) {
+            snapshot = evmSnapshot();
+        }
+        // the overrides only apply to this request
+        uint64_t blockNumber = evmBlockNumber();
+        uint64_t timestamp = evmTimestamp();
+        evmSetDebug(request->debug);
+        if (request->blockNumber) {
+            evmSetBlockNumber(*request->blockNumber);
+        }
+        if (request->timestamp) {
+            evmSetTimestamp(*request->timestamp);
+        }
+        uint64_t gas = request->gas ? request->gas : 0xffffffffffffffff;
+        result_t result;
+        measurement_t measurement;
+        uint64_t nanos, ops;
+        measureStart(&measurement);
+        if (request->to) {
+            result = txCall(request->from, gas, *request->to, request->value, request->input, request->accessList);
+        } else {
+            result = txCreate(request->from, gas, request->value, request->input);
+        }
+        measureEnd(&measurement, &nanos, &ops);
+        stats.transactions++;
+        stats.gasUsed += gas - result.gasRemaining;
+        stats.nanos += nanos;
+        fprintResponse(out, request, &result, gas);
+        fflush(out);
+        evmFreeStateChanges(result.stateChanges);
+        evmSetBlockNumber(blockNumber);
+        evmSetTimestamp(timestamp);
+        if (!commit) {
+            evmRestore(snapshot);
+            evmRelease(snapshot);
+        }
+        freeRequest(request);
+    }
+    free(line);
+    return stats;
+}
+
 typedef char char_t;
 VECTOR(char, file);
 
@@ -1081,24 +1462,32 @@ static void updateConfig(const char *configContents, const char *dstPath) {
     file_destroy(&file);
 }
 
+static char *mapConfig(const char *configFile, struct stat *fstatus) {
+    int fd = open(configFile, O_RDONLY);
+    if (fd == -1) {
+        perror(configFile);
+        _exit(1);
+    }
+
+    int fstatSuccess = fstat(fd, fstatus);
+    if (fstatSuccess == -1) {
+        perror(configFile);
+        _exit(1);
+    }
+    char *configContents = mmap(NULL, fstatus->st_size, PROT_READ, MAP_PRIVATE | MAP_FILE, fd, 0);
+    close(fd);
+    return configContents;
+}
+
 void loadConfig(const char *_configFile, int updateConfigFile) {
     if (_configFile != NULL) {
-        int fd = open(_configFile, O_RDONLY);
-        if (fd == -1) {
-            perror(_configFile);
-            _exit(1);
-        }
-
         struct stat fstatus;
-        int fstatSuccess = fstat(fd, &fstatus);
-        if (fstatSuccess == -1) {
-            perror(_configFile);
-            _exit(1);
-        }
-        char *configContents = mmap(NULL, fstatus.st_size, PROT_READ, MAP_PRIVATE | MAP_FILE, fd, 0);
+        char *configContents = mapConfig(_configFile, &fstatus);
         {
             uint64_t prevLineNumber = lineNumber;
             struct testResults results = testResults;
+            const char *prevConfigFile = currentConfigFile;
+            currentConfigFile = _configFile;
 
             applyConfig(configContents);
             if (updateConfigFile) {
@@ -1107,8 +1496,353 @@ void loadConfig(const char *_configFile, int updateConfigFile) {
 
             lineNumber = prevLineNumber;
             testResults = results;
+            currentConfigFile = prevConfigFile;
         }
         munmap(configContents, fstatus.st_size);
+    }
+}
+
+// with -r, workers replay the output of config files that passed before; see setResultCache
+static const char *resultCacheDirectory = NULL;
+static const char *resultCacheVersion;
+static bool resultCacheRerun;
+// the world state each worker starts from
+static uint8_t startDigest[32];
+static bool recordingDependencies = false;
+// "keccak path" lines for each file read by the config file a worker is running, starting with the config file
+static file_t dependencies;
+
+void setResultCache(const char *directory, const char *buildVersion, bool rerun) {
+    resultCacheDirectory = directory;
+    resultCacheVersion = buildVersion;
+    resultCacheRerun = rerun;
+}
+
+static void recordDependency(const char *path, const uint8_t hash[32]) {
+    if (!recordingDependencies) {
+        return;
+    }
+    file_ensure(&dependencies, dependencies.num_chars + 67 + strlen(path));
+    for (uint8_t i = 0; i < 32; i++) {
+        dependencies.num_chars += sprintf(dependencies.chars + dependencies.num_chars, "%02x", hash[i]);
+    }
+    dependencies.num_chars += sprintf(dependencies.chars + dependencies.num_chars, " %s\n", path);
+}
+
+static bool hashFile(const char *path, uint8_t hash[32]) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat fstatus;
+    if (fstat(fd, &fstatus) == -1) {
         close(fd);
+        return false;
+    }
+    uint8_t *contents = malloc(fstatus.st_size);
+    ssize_t red = read(fd, contents, fstatus.st_size);
+    close(fd);
+    if (red == fstatus.st_size) {
+        keccak_256(hash, 32, contents, red);
+    }
+    free(contents);
+    return red == fstatus.st_size;
+}
+
+// keccak of the build version, the starting world state and the config file
+static char *resultPath(const uint8_t configHash[32]) {
+    size_t versionLength = strlen(resultCacheVersion);
+    uint8_t *key = malloc(versionLength + 64);
+    memcpy(key, resultCacheVersion, versionLength);
+    memcpy(key + versionLength, startDigest, 32);
+    memcpy(key + versionLength + 32, configHash, 32);
+    uint8_t hash[32];
+    keccak_256(hash, 32, key, versionLength + 64);
+    free(key);
+    char *path = malloc(strlen(resultCacheDirectory) + 66);
+    char *end = stpcpy(path, resultCacheDirectory);
+    *end++ = '/';
+    for (uint8_t i = 0; i < 32; i++) {
+        end += sprintf(end, "%02x", hash[i]);
+    }
+    return path;
+}
+
+// an entry lists the other files read, as "keccak path" lines after their count, followed by the output
+static bool replayResult(const uint8_t configHash[32]) {
+    char *path = resultPath(configHash);
+    FILE *entry = fopen(path, "r");
+    free(path);
+    if (entry == NULL) {
+        return false;
+    }
+    bool replayed = false;
+    uint32_t count;
+    if (fscanf(entry, "%" SCNu32 "\n", &count) != 1) {
+        goto done;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        char expected[65];
+        char dependencyPath[4097];
+        if (fscanf(entry, "%64s %4096[^\n]\n", expected, dependencyPath) != 2) {
+            goto done;
+        }
+        uint8_t hash[32];
+        if (!hashFile(dependencyPath, hash)) {
+            goto done;
+        }
+        for (uint8_t j = 0; j < 32; j++) {
+            if (hash[j] != hexString16ToUint8(expected + j * 2)) {
+                goto done;
+            }
+        }
+    }
+    char buffer[4096];
+    size_t red;
+    while ((red = fread(buffer, 1, sizeof(buffer), entry))) {
+        fwrite(buffer, 1, red, stderr);
+    }
+    replayed = true;
+done:
+    fclose(entry);
+    return replayed;
+}
+
+static void storeResult(const char *manifest, size_t manifestLength, const char *output, size_t outputLength) {
+    uint8_t configHash[32];
+    for (uint8_t i = 0; i < 32; i++) {
+        configHash[i] = hexString16ToUint8(manifest + i * 2);
+    }
+    const char *others = memchr(manifest, '\n', manifestLength) + 1;
+    uint32_t count = 0;
+    for (const char *line = others; line < manifest + manifestLength; line = memchr(line, '\n', manifest + manifestLength - line) + 1) {
+        count++;
+    }
+    char *path = resultPath(configHash);
+    // written aside and renamed so that concurrent runs never read a partial entry
+    char *tmpPath = malloc(strlen(path) + 8);
+    sprintf(tmpPath, "%s.XXXXXX", path);
+    int fd = mkstemp(tmpPath);
+    if (fd == -1) {
+        perror(tmpPath);
+    } else {
+        FILE *entry = fdopen(fd, "w");
+        fprintf(entry, "%" PRIu32 "\n", count);
+        fwrite(others, 1, manifest + manifestLength - others, entry);
+        fwrite(output, 1, outputLength, entry);
+        if (fclose(entry) || rename(tmpPath, path)) {
+            perror(path);
+            unlink(tmpPath);
+        }
+    }
+    free(tmpPath);
+    free(path);
+}
+
+static void importConfig(const char *importPath) {
+    char *path = realpath(importPath, NULL);
+    if (path == NULL) {
+        perror(importPath);
+        _exit(1);
+    }
+    struct stat fstatus;
+    if (stat(path, &fstatus) == -1) {
+        perror(importPath);
+        _exit(1);
+    }
+    for (import_t *import = imports; import != NULL; import = import->next) {
+        if (strcmp(import->path, path)) {
+            continue;
+        }
+        if (import->size != fstatus.st_size
+            || import->mtime.tv_sec != fstatus.st_mtim.tv_sec
+            || import->mtime.tv_nsec != fstatus.st_mtim.tv_nsec) {
+            // modified since; parsed again below, shadowing this one
+            break;
+        }
+        free(path);
+        recordDependency(import->path, import->hash);
+        const char *prevConfigFile = currentConfigFile;
+        currentConfigFile = importPath;
+        for (size_t i = 0; i < import->entries.num_entrys; i++) {
+            applyEntry(import->entries.entrys + i);
+        }
+        currentConfigFile = prevConfigFile;
+        if (anyTestFailure) {
+            reportClose();
+            _exit(1);
+        }
+        return;
+    }
+
+    import_t *import = malloc(sizeof(import_t));
+    import->path = path;
+    import->mtime = fstatus.st_mtim;
+    import->size = fstatus.st_size;
+    entries_init(&import->entries, 8);
+    char *configContents = mapConfig(path, &fstatus);
+    keccak_256(import->hash, 32, (uint8_t *)configContents, fstatus.st_size);
+    recordDependency(path, import->hash);
+    {
+        uint64_t prevLineNumber = lineNumber;
+        struct testResults results = testResults;
+        const char *prevConfigFile = currentConfigFile;
+        currentConfigFile = importPath;
+
+        scanConfig(configContents, &import->entries);
+
+        lineNumber = prevLineNumber;
+        testResults = results;
+        currentConfigFile = prevConfigFile;
+    }
+    import->next = imports;
+    imports = import;
+}
+
+typedef struct worker {
+    pid_t pid;
+    int fd;
+    file_t output;
+    bool done;
+    bool passed;
+    FILE *report;
+} worker_t;
+
+static void startWorker(worker_t *worker, const char *configFile, int updateConfigFile) {
+    int rw[2];
+    if (pipe(rw) == -1) {
+        perror("pipe");
+        _exit(1);
+    }
+    worker->report = reportWorkerSink();
+    fflush(NULL);
+    // the worker inherits the world state through copy-on-write pages
+    worker->pid = fork();
+    if (worker->pid == -1) {
+        perror("fork");
+        _exit(1);
+    }
+    if (worker->pid == 0) {
+        close(rw[0]);
+        dup2(rw[1], 2);
+        close(rw[1]);
+        if (worker->report) {
+            reportSetSink(worker->report);
+        }
+        uint8_t configHash[32];
+        // timings differ between runs, so they are neither replayed nor stored
+        if (resultCacheDirectory && !timingEnabled && hashFile(configFile, configHash)) {
+            // -u needs the tests parsed to update the file, and reports need them measured
+            if (!resultCacheRerun && !updateConfigFile && !worker->report && replayResult(configHash)) {
+                fflush(stderr);
+                _exit(0);
+            }
+            file_init(&dependencies, 4096);
+            recordingDependencies = true;
+            recordDependency(configFile, configHash);
+            assembleObserve(recordDependency);
+        }
+        loadConfig(configFile, updateConfigFile);
+        fflush(stderr);
+        if (recordingDependencies) {
+            // the parent stores the output with the files read, which follow a NUL
+            if (write(2, "", 1) != 1 || write(2, dependencies.chars, dependencies.num_chars) != (ssize_t)dependencies.num_chars) {
+                perror("write");
+            }
+        }
+        _exit(0);
+    }
+    close(rw[1]);
+    worker->fd = rw[0];
+    file_init(&worker->output, 4096);
+    worker->done = false;
+}
+
+// returns false if the worker failed
+static bool drainWorker(worker_t *worker) {
+    file_ensure(&worker->output, worker->output.num_chars + 4096);
+    ssize_t red = read(worker->fd, worker->output.chars + worker->output.num_chars, worker->output.buffer_size - worker->output.num_chars);
+    if (red > 0) {
+        worker->output.num_chars += red;
+        return true;
+    }
+    if (red == -1) {
+        perror("read");
+    }
+    close(worker->fd);
+    worker->done = true;
+    int status;
+    if (waitpid(worker->pid, &status, 0) == -1) {
+        perror("waitpid");
+        return false;
+    }
+    worker->passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return worker->passed;
+}
+
+int loadConfigsParallel(char *const configFiles[], size_t count, int updateConfigFile, uint16_t jobs) {
+    if (jobs == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cores > 0 ? cores : 1;
+    }
+    worker_t *workers = calloc(count, sizeof(worker_t));
+    struct pollfd *fds = calloc(jobs, sizeof(struct pollfd));
+    size_t *polled = calloc(jobs, sizeof(size_t));
+    size_t started = 0;
+    size_t printed = 0;
+    uint16_t running = 0;
+    int failed = 0;
+    if (resultCacheDirectory) {
+        evmStateDigest(startDigest);
+    }
+    while (printed < count) {
+        for (; running < jobs && started < count; running++) {
+            startWorker(workers + started, configFiles[started], updateConfigFile);
+            started++;
+        }
+        nfds_t nfds = 0;
+        for (size_t i = printed; i < started; i++) {
+            if (!workers[i].done) {
+                fds[nfds].fd = workers[i].fd;
+                fds[nfds].events = POLLIN;
+                polled[nfds++] = i;
+            }
+        }
+        if (nfds && poll(fds, nfds, -1) == -1) {
+            perror("poll");
+            _exit(1);
+        }
+        for (nfds_t i = 0; i < nfds; i++) {
+            if (fds[i].revents) {
+                worker_t *worker = workers + polled[i];
+                if (!drainWorker(worker)) {
+                    failed = 1;
+                }
+                if (worker->done) {
+                    running--;
+                }
+            }
+        }
+        // output is printed in the order of the files
+        for (; printed < started && workers[printed].done; printed++) {
+            size_t outputLength = workers[printed].output.num_chars;
+            const char *manifest = memchr(workers[printed].output.chars, '\0', outputLength);
+            if (manifest) {
+                outputLength = manifest - workers[printed].output.chars;
+                if (workers[printed].passed) {
+                    storeResult(manifest + 1, workers[printed].output.num_chars - outputLength - 1, workers[printed].output.chars, outputLength);
+                }
+            }
+            fwrite(workers[printed].output.chars, 1, outputLength, stderr);
+            if (workers[printed].report) {
+                reportAppendWorker(workers[printed].report);
+            }
+            file_destroy(&workers[printed].output);
+        }
     }
+    fflush(stderr);
+    free(polled);
+    free(fds);
+    free(workers);
+    return failed;
 }
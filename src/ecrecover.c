@@ -0,0 +1,276 @@
+#include "ecrecover.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// Entries are indexed from 1 so that 0 can mean none
+#define ECRECOVER_CACHE_SIZE 4096
+#define ECRECOVER_CACHE_BUCKETS 8192
+
+typedef struct ecrecoverCacheEntry {
+    uint8_t input[128];
+    address_t signer;
+    bool valid;
+    uint16_t newer;
+    uint16_t older;
+    uint16_t bucketNext;
+} ecrecoverCacheEntry_t;
+
+static secp256k1_context *context = NULL;
+static ecrecoverCacheEntry_t cache[ECRECOVER_CACHE_SIZE + 1];
+static uint16_t buckets[ECRECOVER_CACHE_BUCKETS];
+static uint16_t cacheCount = 0;
+static uint16_t newest = 0;
+static uint16_t oldest = 0;
+static ecrecoverStats_t stats;
+// guards the cache and stats; recovery itself runs unlocked
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t contextOnce = PTHREAD_ONCE_INIT;
+
+static void createContext() {
+    // the ecmult tables are precomputed when secp256k1 is built, so one context serves every recovery
+    __atomic_store_n(&context, secp256k1_context_create(SECP256K1_CONTEXT_NONE), __ATOMIC_RELEASE);
+}
+
+void ecrecoverInit() {
+    pthread_once(&contextOnce, createContext);
+}
+
+ecrecoverStats_t ecrecoverStats() {
+    pthread_mutex_lock(&cacheLock);
+    ecrecoverStats_t result = stats;
+    pthread_mutex_unlock(&cacheLock);
+    return result;
+}
+
+void ecrecoverResetStats() {
+    pthread_mutex_lock(&cacheLock);
+    bzero(&stats, sizeof(stats));
+    pthread_mutex_unlock(&cacheLock);
+}
+
+static inline const secp256k1_context *recoverContext() {
+    // a thread that did not call ecrecoverInit may see the context before or after it is created
+    const secp256k1_context *created = __atomic_load_n(&context, __ATOMIC_ACQUIRE);
+    return created ? created : secp256k1_context_static;
+}
+
+// writes the uncompressed public key without its 0x04 prefix
+static bool recoverPubkey(const uint8_t *hash, int recid, const uint8_t *rs, uint8_t pubkey64[64]) {
+    const secp256k1_context *ctx = recoverContext();
+    secp256k1_ecdsa_recoverable_signature sig;
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ecdsa_recoverable_signature_parse_compact(ctx, &sig, rs, recid)
+        || !secp256k1_ecdsa_recover(ctx, &pubkey, &sig, hash)) {
+        return false;
+    }
+    uint8_t pubkeyBytes[65];
+    size_t pubkeyLen = 65;
+    secp256k1_ec_pubkey_serialize(ctx, pubkeyBytes, &pubkeyLen, &pubkey, SECP256K1_EC_UNCOMPRESSED);
+    memcpy(pubkey64, pubkeyBytes + 1, 64);
+    return true;
+}
+
+static inline void pubkeyToAddress(const uint8_t pubkey64[64], address_t *signer) {
+    uint8_t pubkeyHash[32];
+    keccak_256(pubkeyHash, 32, pubkey64, 64);
+    memcpy(signer->address, pubkeyHash + 12, 20);
+}
+
+static bool recoverSigner(const uint8_t *hash, int recid, const uint8_t *rs, address_t *signer) {
+    uint8_t pubkey[64];
+    if (!recoverPubkey(hash, recid, rs, pubkey)) {
+        bzero(signer, sizeof(address_t));
+        return false;
+    }
+    pubkeyToAddress(pubkey, signer);
+    return true;
+}
+
+static inline uint16_t cacheBucket(const uint8_t *input) {
+    // the message hash and r are already uniformly distributed
+    uint64_t hash;
+    uint64_t r;
+    memcpy(&hash, input, 8);
+    memcpy(&r, input + 64, 8);
+    return (hash ^ r) % ECRECOVER_CACHE_BUCKETS;
+}
+
+static void cacheUnlink(uint16_t entry) {
+    if (cache[entry].newer) {
+        cache[cache[entry].newer].older = cache[entry].older;
+    } else {
+        newest = cache[entry].older;
+    }
+    if (cache[entry].older) {
+        cache[cache[entry].older].newer = cache[entry].newer;
+    } else {
+        oldest = cache[entry].newer;
+    }
+}
+
+static void cachePushNewest(uint16_t entry) {
+    cache[entry].newer = 0;
+    cache[entry].older = newest;
+    if (newest) {
+        cache[newest].newer = entry;
+    } else {
+        oldest = entry;
+    }
+    newest = entry;
+}
+
+static void cacheEvict(uint16_t entry) {
+    uint16_t *bucket = &buckets[cacheBucket(cache[entry].input)];
+    while (*bucket != entry) {
+        bucket = &cache[*bucket].bucketNext;
+    }
+    *bucket = cache[entry].bucketNext;
+    cacheUnlink(entry);
+}
+
+bool ecrecover(const uint8_t input[128], address_t *signer) {
+    // v is at bytes [32..63]: upper 31 bytes must be 0, last byte must be 27 or 28
+    for (int i = 32; i < 63; i++) {
+        if (input[i] != 0) {
+            return false;
+        }
+    }
+    int v = input[63];
+    if (v != 27 && v != 28) {
+        return false;
+    }
+
+    uint16_t bucket = cacheBucket(input);
+    pthread_mutex_lock(&cacheLock);
+    for (uint16_t entry = buckets[bucket]; entry; entry = cache[entry].bucketNext) {
+        if (memcmp(cache[entry].input, input, 128) == 0) {
+            stats.cacheHits++;
+            if (entry != newest) {
+                cacheUnlink(entry);
+                cachePushNewest(entry);
+            }
+            *signer = cache[entry].signer;
+            bool valid = cache[entry].valid;
+            pthread_mutex_unlock(&cacheLock);
+            return valid;
+        }
+    }
+    stats.cacheMisses++;
+    pthread_mutex_unlock(&cacheLock);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool valid = recoverSigner(input, v - 27, input + 64, signer);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_lock(&cacheLock);
+    stats.recoverNanos += (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+
+    uint16_t entry;
+    if (cacheCount < ECRECOVER_CACHE_SIZE) {
+        entry = ++cacheCount;
+    } else {
+        entry = oldest;
+        cacheEvict(entry);
+    }
+    memcpy(cache[entry].input, input, 128);
+    cache[entry].signer = *signer;
+    cache[entry].valid = valid;
+    cache[entry].bucketNext = buckets[bucket];
+    buckets[bucket] = entry;
+    cachePushNewest(entry);
+    pthread_mutex_unlock(&cacheLock);
+    return valid;
+}
+
+// work is claimed in chunks to keep the workers off the shared counter
+#define RECOVER_CHUNK 64
+
+// secp256k1n / 2, above which EIP-2 rejects transaction signatures
+static const uint8_t HALF_ORDER[32] = {
+    0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0x5d, 0x57, 0x6e, 0x73, 0x57, 0xa4, 0x50, 0x1d, 0xdf, 0xe9, 0x2f, 0x46, 0x68, 0x1b, 0x20, 0xa0,
+};
+
+typedef struct recoverJob {
+    const txSignature_t *signatures;
+    size_t count;
+    uint64_t chainId;
+    address_t *senders;
+    bool *valid;
+    size_t next;
+} recoverJob_t;
+
+static void *recoverWorker(void *arg) {
+    recoverJob_t *job = arg;
+    while (1) {
+        size_t start = __atomic_fetch_add(&job->next, RECOVER_CHUNK, __ATOMIC_RELAXED);
+        if (start >= job->count) {
+            return NULL;
+        }
+        size_t end = start + RECOVER_CHUNK < job->count ? start + RECOVER_CHUNK : job->count;
+        for (size_t i = start; i < end; i++) {
+            const txSignature_t *signature = job->signatures + i;
+            uint8_t rs[64];
+            memcpy(rs, signature->r, 32);
+            memcpy(rs + 32, signature->s, 32);
+            int recid;
+            if (signature->v == 0 || signature->v == 1) {
+                recid = signature->v;
+            } else if (signature->v == 27 || signature->v == 28) {
+                recid = signature->v - 27;
+            } else if (signature->v >= 35 && (signature->v - 35) / 2 == job->chainId) {
+                recid = (signature->v - 35) & 1;
+            } else {
+                recid = -1;
+            }
+            if (memcmp(signature->s, HALF_ORDER, 32) > 0) {
+                recid = -1;
+            }
+            uint8_t pubkey[64];
+            job->valid[i] = recid >= 0 && recoverPubkey(signature->hash, recid, rs, pubkey);
+            if (job->valid[i]) {
+                pubkeyToAddress(pubkey, job->senders + i);
+            } else {
+                bzero(job->senders + i, sizeof(address_t));
+            }
+        }
+    }
+}
+
+void txRecoverSenders(const txSignature_t *signatures, size_t count, uint64_t chainId, address_t *senders, bool *valid, uint16_t threads) {
+    ecrecoverInit();
+    if (threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? cores : 1;
+    }
+    size_t chunks = (count + RECOVER_CHUNK - 1) / RECOVER_CHUNK;
+    if (threads > chunks) {
+        threads = chunks ? chunks : 1;
+    }
+    recoverJob_t job;
+    job.signatures = signatures;
+    job.count = count;
+    job.chainId = chainId;
+    job.senders = senders;
+    job.valid = valid;
+    job.next = 0;
+
+    // the calling thread is the first worker
+    pthread_t workers[threads];
+    for (uint16_t i = 1; i < threads; i++) {
+        if (pthread_create(workers + i, NULL, recoverWorker, &job)) {
+            perror("pthread_create");
+            threads = i;
+            break;
+        }
+    }
+    recoverWorker(&job);
+    for (uint16_t i = 1; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
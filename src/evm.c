@@ -1,12 +1,16 @@
 #include "evm.h"
+#include "image.h"
 #include "vector.h"
 
 #include <assert.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <ucontext.h>
 
 
 uint16_t fprintLog(FILE *file, const logChanges_t *log, int showLogIndex) {
@@ -175,6 +179,18 @@ static inline bool BalanceSub(val_t from, val_t amount) {
     return true;
 }
 
+// fails when the product does not fit a balance
+static inline bool BalanceProduct(val_t product, uint64_t a, uint64_t b) {
+    unsigned __int128 wide = (unsigned __int128) a * b;
+    if (wide >> 96) {
+        return false;
+    }
+    product[0] = wide >> 64;
+    product[1] = wide >> 32;
+    product[2] = wide;
+    return true;
+}
+
 typedef uint256_t evmStack_t[1024];
 
 typedef struct transientStorage {
@@ -189,23 +205,130 @@ typedef struct accountStorage {
     uint256_t value;
     uint256_t original;
     uint64_t warm;
-    struct accountStorage *next;
 } storage_t;
 
+// slots in insertion order, found through an open-addressed index
+typedef struct storageTable {
+    storage_t *slots;
+    uint32_t count;
+    // a power of two, with twice as many index entries
+    uint32_t capacity;
+    // 1 + the position of each slot, 0 where empty
+    uint32_t *index;
+} storageTable_t;
+
+// the keccak and jump analysis of a distinct code, shared by every instance; accounts keep their own copy of the bytes
+typedef struct codeEntry {
+    uint8_t hash[32];
+    uint64_t size;
+    // bit i is set where the byte at i is a JUMPDEST op rather than PUSH data
+    uint64_t *jumpdests;
+    struct codeEntry *next;
+} codeEntry_t;
+
+static struct {
+    pthread_mutex_t lock;
+    // a power of two
+    uint32_t bucketCount;
+    uint32_t count;
+    codeEntry_t **buckets;
+} codes = {PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL};
+
+static uint64_t jumpdestWords(const data_t *code) {
+    return (code->size + 63) / 64 + 1;
+}
+
+// into a zeroed bitmap of jumpdestWords
+static void analyzeJumpdests(uint64_t *jumpdests, const data_t *code) {
+    for (uint64_t pc = 0; pc < code->size; pc++) {
+        op_t op = code->content[pc];
+        if (op == JUMPDEST) {
+            jumpdests[pc / 64] |= 1ull << (pc % 64);
+        } else if (op >= PUSH1 && op <= PUSH32) {
+            pc += op - PUSH0;
+        }
+    }
+}
+
+static uint32_t codeBucket(const uint8_t hash[32], uint32_t bucketCount) {
+    uint32_t bucket;
+    memcpy(&bucket, hash, sizeof(bucket));
+    return bucket & (bucketCount - 1);
+}
+
+// entries are kept until the process exits, so they can be shared without counting references
+// only account code is interned; initcode runs once, so its frame analyzes it instead
+static const codeEntry_t *internCode(const data_t *code) {
+    uint8_t hash[32];
+    keccak_256(hash, 32, code->content, code->size);
+    pthread_mutex_lock(&codes.lock);
+    if (codes.count >= codes.bucketCount) {
+        uint32_t bucketCount = codes.bucketCount ? codes.bucketCount * 2 : 256;
+        codeEntry_t **buckets = calloc(bucketCount, sizeof(codeEntry_t *));
+        for (uint32_t i = 0; i < codes.bucketCount; i++) {
+            while (codes.buckets[i]) {
+                codeEntry_t *entry = codes.buckets[i];
+                codes.buckets[i] = entry->next;
+                uint32_t bucket = codeBucket(entry->hash, bucketCount);
+                entry->next = buckets[bucket];
+                buckets[bucket] = entry;
+            }
+        }
+        free(codes.buckets);
+        codes.buckets = buckets;
+        codes.bucketCount = bucketCount;
+    }
+    codeEntry_t **bucket = codes.buckets + codeBucket(hash, codes.bucketCount);
+    codeEntry_t *entry = *bucket;
+    while (entry && memcmp(entry->hash, hash, 32)) {
+        entry = entry->next;
+    }
+    if (entry == NULL) {
+        entry = malloc(sizeof(codeEntry_t));
+        memcpy(entry->hash, hash, 32);
+        entry->size = code->size;
+        entry->jumpdests = calloc(jumpdestWords(code), sizeof(uint64_t));
+        analyzeJumpdests(entry->jumpdests, code);
+        entry->next = *bucket;
+        *bucket = entry;
+        codes.count++;
+    }
+    pthread_mutex_unlock(&codes.lock);
+    return entry;
+}
+
 typedef struct account {
     address_t address;
     val_t balance;
     data_t code;
+    // interned when first needed after the code is set; see setAccountCode
+    const codeEntry_t *codeEntry;
     uint64_t nonce;
     uint64_t warm;
-    storage_t *storage;
+    storageTable_t storage;
     tstorage_t *tstorage;
+    precompileHandler_t precompile; // native when execute is set
+    // storage and tstorage are shared with the newest snapshot until the account is accessed in the current epoch
+    uint32_t epoch;
 } account_t;
 
 static bool AccountDead(account_t *account) {
     return !(account->balance[0] || account->balance[1] || account->balance[2] || account->code.size || account->nonce);
 }
 
+// every change to the code of an account goes through here, so its codeEntry matches
+static void setAccountCode(account_t *account, data_t code) {
+    account->code = code;
+    account->codeEntry = NULL;
+}
+
+static const codeEntry_t *accountCodeEntry(account_t *account) {
+    if (account->codeEntry == NULL) {
+        account->codeEntry = internCode(&account->code);
+    }
+    return account->codeEntry;
+}
+
 VECTOR(uint8, memory);
 typedef struct {
     evmStack_t bottom;
@@ -219,8 +342,34 @@ typedef struct {
     data_t callData;
     uint64_t gas;
     bool readonly;
+    // the account whose code runs, NULL for initcode, and the bitmap of its jumpdests once a jump needs it
+    account_t *codeAccount;
+    const uint64_t *jumpdests;
+    // the bitmap of initcode, kept by the frame for the next initcode it runs
+    uint64_t *initcodeJumpdests;
+    uint64_t initcodeJumpdestWords;
+    // while the frame is calling, where it resumes and what it has changed so far
+    uint64_t pc;
+    op_t calling;
+    uint64_t returnOffset;
+    uint64_t returnSize;
+    stateChanges_t *stateChanges;
+    // for SHOW_CALLS
+    uint64_t startGas;
 } context_t;
 
+static const uint64_t *analyzeInitcode(context_t *callContext) {
+    uint64_t words = jumpdestWords(&callContext->code);
+    if (words > callContext->initcodeJumpdestWords) {
+        free(callContext->initcodeJumpdests);
+        callContext->initcodeJumpdests = malloc(words * sizeof(uint64_t));
+        callContext->initcodeJumpdestWords = words;
+    }
+    bzero(callContext->initcodeJumpdests, words * sizeof(uint64_t));
+    analyzeJumpdests(callContext->initcodeJumpdests, &callContext->code);
+    return callContext->initcodeJumpdests;
+}
+
 
 stateChanges_t *getCurrentAccountStateChanges(result_t *result, context_t *context) {
     stateChanges_t **stateChanges = &result->stateChanges;
@@ -288,7 +437,13 @@ static inline bool ensureMemory(context_t *callContext, uint64_t capacity) {
             return false;
         }
         callContext->gas -= memoryGas;
-        memory_ensure(memory, capacity);
+        if (memory->buffer_size < capacity) {
+            // grow geometrically so that incremental expansion does not copy the whole buffer each time
+            memory_ensure(memory, capacity < memory->buffer_size << 1 ? memory->buffer_size << 1 : capacity);
+        } else {
+            // the buffer is reused across calls at this depth so it may hold stale bytes
+            bzero(memory->uint8s + memory->num_uint8s, capacity - memory->num_uint8s);
+        }
         memory->num_uint8s = capacity;
     }
     return true;
@@ -310,26 +465,72 @@ static inline uint64_t initcodeGas(const data_t *initcode) {
     return G_INITCODEWORD * ((initcode->size + 31) >> 5); // EIP 3860: 2 gas per word
 }
 
+// the transaction runs at depth 0
+#define MAX_CALL_DEPTH 1024
+#define MAX_ACCOUNTS (1 << 22)
+
 typedef struct {
-    context_t bottom[1024];
+    context_t bottom[MAX_CALL_DEPTH + 1];
     context_t *next;
 } callstack_t;
 
-callstack_t callstack;
-
-static account_t accounts[1024];
-static account_t *emptyAccount;
-static uint64_t evmIteration = 0;
-static uint16_t logIndex = 0;
-static uint64_t refundCounter = 0;
-static uint64_t blockNumber = 20587048;
-static uint64_t timestamp = 0x65712600;
-static address_t coinbase;
-static uint64_t debugFlags = 0;
-static account_t knownPrecompiles[KNOWN_PRECOMPILES];
+typedef struct snapshot {
+    // the precompile headers followed by accountCount account headers
+    account_t *headers;
+    uint32_t accountCount;
+    uint16_t logIndex;
+    // the epoch that was current when the snapshot was taken
+    uint32_t epoch;
+} snapshot_t;
+
+VECTOR(snapshot, snapshotStack);
+
+struct evm {
+    callstack_t callstack;
+    // reserved for MAX_ACCOUNTS so that account pointers stay valid as accounts are added
+    account_t *accounts;
+    account_t *emptyAccount;
+    // 1 + the position of each account by address, 0 where empty; a restore can leave entries past emptyAccount
+    uint32_t *accountTable;
+    uint32_t accountTableSize;
+    uint32_t accountTableUsed;
+    uint64_t evmIteration;
+    uint16_t logIndex;
+    uint64_t refundCounter;
+    uint64_t blockNumber;
+    uint64_t timestamp;
+    address_t coinbase;
+    uint64_t gasLimit;
+    uint64_t baseFee;
+    uint256_t prevRandao;
+    // the effective gas price of the current block transaction
+    uint64_t gasPrice;
+    uint64_t debugFlags;
+    const stateProvider_t *provider;
+    // precompile addresses are indexed by their last byte
+    account_t precompiles[256];
+    snapshotStack_t snapshots;
+    uint32_t epoch;
+    uint32_t epochs;
+    // every op executed, for reports
+    uint64_t opCount;
+};
+
+#define DEFAULT_BLOCK_NUMBER 20587048
+#define DEFAULT_TIMESTAMP 0x65712600
+#define DEFAULT_GAS_LIMIT 30000000
+
+// backs the global API
+static evm_t defaultEvm = {
+    .blockNumber = DEFAULT_BLOCK_NUMBER,
+    .timestamp = DEFAULT_TIMESTAMP,
+    .gasLimit = DEFAULT_GAS_LIMIT,
+};
+// the instance running on this thread, set by each public entry point
+static __thread evm_t *evm = &defaultEvm;
 
 uint16_t depthOf(context_t *context) {
-    return context - callstack.bottom;
+    return context - evm->callstack.bottom;
 }
 
 void fRepeat(FILE *file, const char *str, uint16_t times) {
@@ -342,32 +543,121 @@ void fRepeat(FILE *file, const char *str, uint16_t times) {
 
 #define INDENT fRepeat(stderr, "\t", depthOf(callContext))
 
+void evmSetBlockNumber_r(evm_t *instance, uint64_t _blockNumber) {
+    instance->blockNumber = _blockNumber;
+}
+
 void evmSetBlockNumber(uint64_t _blockNumber) {
-    blockNumber = _blockNumber;
+    evmSetBlockNumber_r(&defaultEvm, _blockNumber);
+}
+
+void evmSetTimestamp_r(evm_t *instance, uint64_t _timestamp) {
+    instance->timestamp = _timestamp;
 }
 
 void evmSetTimestamp(uint64_t _timestamp) {
-    timestamp = _timestamp;
+    evmSetTimestamp_r(&defaultEvm, _timestamp);
+}
+
+uint64_t evmBlockNumber_r(evm_t *instance) {
+    return instance->blockNumber;
+}
+
+uint64_t evmBlockNumber() {
+    return evmBlockNumber_r(&defaultEvm);
+}
+
+uint64_t evmTimestamp_r(evm_t *instance) {
+    return instance->timestamp;
+}
+
+uint64_t evmTimestamp() {
+    return evmTimestamp_r(&defaultEvm);
+}
+
+void evmSetBlock_r(evm_t *instance, const blockHeader_t *header) {
+    instance->blockNumber = header->number;
+    instance->timestamp = header->timestamp;
+    instance->gasLimit = header->gasLimit;
+    instance->baseFee = header->baseFee;
+    copy256(&instance->prevRandao, &header->prevRandao);
+    instance->coinbase = header->coinbase;
+}
+
+void evmSetBlock(const blockHeader_t *header) {
+    evmSetBlock_r(&defaultEvm, header);
+}
+
+void evmSetDebug_r(evm_t *instance, uint64_t flags) {
+    instance->debugFlags = flags;
 }
 
 void evmSetDebug(uint64_t flags) {
-    debugFlags = flags;
+    evmSetDebug_r(&defaultEvm, flags);
+}
+
+void evmSetStateProvider_r(evm_t *instance, const stateProvider_t *provider) {
+    instance->provider = provider;
+}
+
+void evmSetStateProvider(const stateProvider_t *provider) {
+    evmSetStateProvider_r(&defaultEvm, provider);
 }
 
-#define SHOW_STACK (debugFlags & EVM_DEBUG_STACK)
-#define SHOW_MEMORY (debugFlags & EVM_DEBUG_MEMORY)
-#define SHOW_OPS (debugFlags & EVM_DEBUG_OPS)
-#define SHOW_GAS (debugFlags & EVM_DEBUG_GAS)
-#define SHOW_PC (debugFlags & EVM_DEBUG_PC)
-#define SHOW_CALLS (debugFlags & EVM_DEBUG_CALLS)
-#define SHOW_LOGS (debugFlags & EVM_DEBUG_LOGS)
+#define SHOW_STACK (evm->debugFlags & EVM_DEBUG_STACK)
+#define SHOW_MEMORY (evm->debugFlags & EVM_DEBUG_MEMORY)
+#define SHOW_OPS (evm->debugFlags & EVM_DEBUG_OPS)
+#define SHOW_GAS (evm->debugFlags & EVM_DEBUG_GAS)
+#define SHOW_PC (evm->debugFlags & EVM_DEBUG_PC)
+#define SHOW_CALLS (evm->debugFlags & EVM_DEBUG_CALLS)
+#define SHOW_LOGS (evm->debugFlags & EVM_DEBUG_LOGS)
+
+static uint32_t accountHash(const address_t *address) {
+    uint64_t hash;
+    memcpy(&hash, address->address + 12, sizeof(hash));
+    return (hash * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+// the table entry of the address, which is 0 if it has no account
+static uint32_t *findAccountTable(address_t address) {
+    uint32_t mask = evm->accountTableSize - 1;
+    uint32_t count = evm->emptyAccount - evm->accounts;
+    for (uint32_t i = accountHash(&address) & mask;; i = (i + 1) & mask) {
+        uint32_t *position = evm->accountTable + i;
+        if (*position == 0 || (*position <= count && AddressEqual(&evm->accounts[*position - 1].address, &address))) {
+            return position;
+        }
+    }
+}
+
+// drops the entries a restore left behind, and keeps the table at most a quarter full
+static void rebuildAccountTable(evm_t *instance) {
+    evm_t *caller = evm;
+    evm = instance;
+    uint32_t count = evm->emptyAccount - evm->accounts;
+    uint32_t size = 64;
+    while (size < count * 4) {
+        size *= 2;
+    }
+    if (size != evm->accountTableSize) {
+        free(evm->accountTable);
+        evm->accountTable = malloc(size * sizeof(uint32_t));
+        evm->accountTableSize = size;
+    }
+    bzero(evm->accountTable, size * sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        *findAccountTable(evm->accounts[i].address) = i + 1;
+    }
+    evm->accountTableUsed = count;
+    evm = caller;
+}
 
 static account_t *getAccount(const address_t address) {
     if (AddressIsPrecompile(address)) {
-        if (PrecompileIsKnownPrecompile(address)) {
-            account_t *precompile = knownPrecompiles + address.address[19];
+        account_t *precompile = evm->precompiles + address.address[19];
+        if (!address.address[18] && (PrecompileIsKnownPrecompile(address) || precompile->precompile.execute)) {
             AddressCopy(precompile->address, address);
-            precompile->warm = evmIteration;
+            precompile->warm = evm->evmIteration;
             return precompile;
         } else {
             fputs("Unknown precompile ", stderr);
@@ -375,76 +665,506 @@ static account_t *getAccount(const address_t address) {
             fputc('\n', stderr);
         }
     }
-    account_t *result = accounts;
-    while (result < emptyAccount && !AddressEqual(&result->address, &address)) {
-        result++;
+    uint32_t *position = findAccountTable(address);
+    if (*position) {
+        return evm->accounts + *position - 1;
+    }
+    if (evm->emptyAccount == evm->accounts + MAX_ACCOUNTS) {
+        fprintf(stderr, "More than %u accounts\n", MAX_ACCOUNTS);
+        exit(1);
+    }
+    account_t *result = evm->emptyAccount++;
+    *position = result - evm->accounts + 1;
+    AddressCopy(result->address, address);
+    if (++evm->accountTableUsed * 2 > evm->accountTableSize) {
+        rebuildAccountTable(evm);
     }
-    if (result == emptyAccount) {
-        emptyAccount++;
-        AddressCopy(result->address, address);
-        result->code.size = 0;
-        result->nonce = 0;
-        result->balance[0] = 0;
-        result->balance[1] = 0;
-        result->balance[2] = 0;
+    result->epoch = evm->epoch;
+    result->code.size = 0;
+    result->codeEntry = NULL;
+    result->nonce = 0;
+    result->balance[0] = 0;
+    result->balance[1] = 0;
+    result->balance[2] = 0;
+    if (evm->provider) {
+        evm->provider->account(evm->provider->context, &address, result->balance, &result->nonce, &result->code);
     }
     return result;
 }
 
-void evmInit() {
-    callstack.next = callstack.bottom;
-    while (emptyAccount--> accounts) {
-        storage_t *storage = emptyAccount->storage;
-        while (storage != NULL) {
-            void *toFree = storage;
-            storage = storage->next;
-            free(toFree);
-        }
-        tstorage_t *tstorage = emptyAccount->tstorage;
-        while (tstorage != NULL) {
-            void *toFree = tstorage;
-            tstorage = tstorage->next;
-            free(toFree);
-        }
-        emptyAccount->storage = NULL;
-        emptyAccount->tstorage = NULL;
-        emptyAccount->warm = 0;
-        bzero(emptyAccount->address.address, 20);
-        op_t *code = emptyAccount->code.content;
+static uint64_t holeGas(const data_t *input) {
+    return 0;
+}
+
+static precompileResult_t holeExecute(const data_t *input, data_t *output) {
+    output->size = 0;
+    return PRECOMPILE_SUCCEEDED;
+}
+
+static uint64_t ecrecoverGas(const data_t *input) {
+    return 3000;
+}
+
+static precompileResult_t ecrecoverExecute(const data_t *input, data_t *output) {
+    if (output->size < 32) {
+        output->size = 32;
+        return PRECOMPILE_OUTPUT_TOO_SMALL;
+    }
+    uint8_t padded[128];
+    memset(padded, 0, 128);
+    size_t copyLen = input->size < 128 ? input->size : 128;
+    memcpy(padded, input->content, copyLen);
+    address_t signer;
+    if (!ecrecover(padded, &signer)) {
+        output->size = 0;
+        return PRECOMPILE_SUCCEEDED;
+    }
+    output->size = 32;
+    bzero(output->content, 12);
+    memcpy(output->content + 12, signer.address, 20);
+    return PRECOMPILE_SUCCEEDED;
+}
+
+static uint64_t identityGas(const data_t *input) {
+    return 15 + 3 * ((input->size + 31) / 32);
+}
+
+static precompileResult_t identityExecute(const data_t *input, data_t *output) {
+    if (output->size < input->size) {
+        output->size = input->size;
+        return PRECOMPILE_OUTPUT_TOO_SMALL;
+    }
+    output->size = input->size;
+    memcpy(output->content, input->content, input->size);
+    return PRECOMPILE_SUCCEEDED;
+}
+
+static uint64_t kzgPointEvaluationGas(const data_t *input) {
+    return 50000;
+}
+
+static precompileResult_t kzgPointEvaluationExecute(const data_t *input, data_t *output) {
+    if (!kzgTrustedSetupLoaded()) {
+        fputs("KZG trusted setup not loaded; set " KZG_TRUSTED_SETUP_ENV "\n", stderr);
+        return PRECOMPILE_FAILED;
+    }
+    if (input->size != 192 || !kzgVerifyPointEvaluation(input->content)) {
+        return PRECOMPILE_FAILED;
+    }
+    if (output->size < 64) {
+        output->size = 64;
+        return PRECOMPILE_OUTPUT_TOO_SMALL;
+    }
+    output->size = 64;
+    memcpy(output->content, kzgPointEvaluationReturn, 64);
+    return PRECOMPILE_SUCCEEDED;
+}
+
+// must agree with the supported flags of PRECOMPILES
+static const precompileHandler_t supportedPrecompiles[KNOWN_PRECOMPILES] = {
+    [HOLE] = {"HOLE", holeGas, holeExecute},
+    [ECRECOVER] = {"ECRECOVER", ecrecoverGas, ecrecoverExecute},
+    [IDENTITY] = {"IDENTITY", identityGas, identityExecute},
+    [ZKG_POINT] = {"ZKG_POINT", kzgPointEvaluationGas, kzgPointEvaluationExecute},
+};
+
+static pthread_once_t precompilesOnce = PTHREAD_ONCE_INIT;
+
+static void initPrecompiles() {
+    ecrecoverInit();
+    kzgInit();
+}
+
+static void freeAccountStorage(account_t *account) {
+    free(account->storage.slots);
+    free(account->storage.index);
+    tstorage_t *tstorage = account->tstorage;
+    while (tstorage != NULL) {
+        void *toFree = tstorage;
+        tstorage = tstorage->next;
+        free(toFree);
+    }
+    bzero(&account->storage, sizeof(storageTable_t));
+    account->tstorage = NULL;
+}
+
+void evmInit_r(evm_t *instance) {
+    evm = instance;
+    pthread_once(&precompilesOnce, initPrecompiles);
+    evm->callstack.next = evm->callstack.bottom;
+    if (evm->snapshots.num_snapshots) {
+        evmRestore_r(instance, 0);
+        evmRelease_r(instance, 0);
+    }
+    if (evm->accounts == NULL) {
+        evm->accounts = mmap(NULL, MAX_ACCOUNTS * sizeof(account_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (evm->accounts == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        evm->emptyAccount = evm->accounts;
+    }
+    while (evm->emptyAccount--> evm->accounts) {
+        freeAccountStorage(evm->emptyAccount);
+        evm->emptyAccount->warm = 0;
+        bzero(evm->emptyAccount->address.address, 20);
+        op_t *code = evm->emptyAccount->code.content;
         if (code != NULL) {
             free(code);
         }
-        emptyAccount->code.content = NULL;
+        evm->emptyAccount->code.content = NULL;
+        evm->emptyAccount->codeEntry = NULL;
+        bzero(&evm->emptyAccount->precompile, sizeof(precompileHandler_t));
     }
-    emptyAccount = accounts;
-    evmIteration++;
-    refundCounter = 0;
-    logIndex = 0;
-    coinbase = AddressFromHex42("0x4838B106FCe9647Bdf1E7877BF73cE8B0BAD5f97");
-    account_t *coinbaseAccount = getAccount(coinbase);
+    evm->emptyAccount = evm->accounts;
+    rebuildAccountTable(evm);
+    for (uint16_t i = 0; i < 256; i++) {
+        // the zero address is among them, and sends transactions
+        freeAccountStorage(evm->precompiles + i);
+        free(evm->precompiles[i].code.content);
+        bzero(evm->precompiles + i, sizeof(account_t));
+        if (i < KNOWN_PRECOMPILES && PrecompileIsSupported(i)) {
+            assert(supportedPrecompiles[i].execute);
+            evm->precompiles[i].precompile = supportedPrecompiles[i];
+        } else {
+            bzero(&evm->precompiles[i].precompile, sizeof(precompileHandler_t));
+        }
+    }
+    evm->evmIteration++;
+    evm->refundCounter = 0;
+    evm->logIndex = 0;
+    evm->coinbase = AddressFromHex42("0x4838B106FCe9647Bdf1E7877BF73cE8B0BAD5f97");
+    // its balance is mocked, so it is not provided
+    const stateProvider_t *provider = evm->provider;
+    evm->provider = NULL;
+    account_t *coinbaseAccount = getAccount(evm->coinbase);
+    evm->provider = provider;
     coinbaseAccount->balance[0] = 0x1;
     coinbaseAccount->balance[1] = 0xd82f5899;
     coinbaseAccount->balance[2] = 0x461084bd;
 }
 
+void evmInit() {
+    evmInit_r(&defaultEvm);
+}
+
 void evmFinalize() {
 }
 
-void evmMockBalance(address_t from, const val_t balance) {
+evm_t *evmNew() {
+    evm_t *instance = calloc(1, sizeof(evm_t));
+    instance->blockNumber = DEFAULT_BLOCK_NUMBER;
+    instance->timestamp = DEFAULT_TIMESTAMP;
+    instance->gasLimit = DEFAULT_GAS_LIMIT;
+    evmInit_r(instance);
+    return instance;
+}
+
+void evmFree(evm_t *instance) {
+    // evmInit releases the accounts
+    evmInit_r(instance);
+    for (uint16_t i = 0; i <= MAX_CALL_DEPTH; i++) {
+        memory_destroy(&instance->callstack.bottom[i].memory);
+        free(instance->callstack.bottom[i].initcodeJumpdests);
+    }
+    snapshotStack_destroy(&instance->snapshots);
+    munmap(instance->accounts, MAX_ACCOUNTS * sizeof(account_t));
+    free(instance->accountTable);
+    free(instance);
+    evm = &defaultEvm;
+}
+
+uint16_t evmSnapshot_r(evm_t *instance) {
+    evm = instance;
+    assert(evm->callstack.next == evm->callstack.bottom);
+    if (evm->snapshots.buffer_size == 0) {
+        snapshotStack_init(&evm->snapshots, 4);
+    }
+    snapshot_t snapshot;
+    snapshot.accountCount = evm->emptyAccount - evm->accounts;
+    snapshot.headers = malloc((256 + snapshot.accountCount) * sizeof(account_t));
+    memcpy(snapshot.headers, evm->precompiles, 256 * sizeof(account_t));
+    memcpy(snapshot.headers + 256, evm->accounts, snapshot.accountCount * sizeof(account_t));
+    snapshot.logIndex = evm->logIndex;
+    snapshot.epoch = evm->epoch;
+    snapshotStack_append(&evm->snapshots, snapshot);
+    // storage is now shared with the snapshot
+    evm->epoch = ++evm->epochs;
+    return evm->snapshots.num_snapshots - 1;
+}
+
+uint16_t evmSnapshot() {
+    return evmSnapshot_r(&defaultEvm);
+}
+
+// drops the newest snapshot, keeping the current state
+static void releaseSnapshot() {
+    snapshot_t *snapshot = evm->snapshots.snapshots + --evm->snapshots.num_snapshots;
+    uint32_t accountCount = evm->emptyAccount - evm->accounts;
+    for (uint32_t i = 0; i < 256 + snapshot->accountCount; i++) {
+        account_t *saved = snapshot->headers + i;
+        account_t *live = i < 256 ? evm->precompiles + i : i - 256 < accountCount ? evm->accounts + i - 256 : NULL;
+        // storage from an older epoch is also held by an older snapshot
+        if (saved->epoch == snapshot->epoch && (live == NULL || live->epoch != saved->epoch)) {
+            freeAccountStorage(saved);
+        }
+    }
+    // the current epoch continues the epoch of the snapshot
+    for (uint32_t i = 0; i < 256 + accountCount; i++) {
+        account_t *live = i < 256 ? evm->precompiles + i : evm->accounts + i - 256;
+        if (live->epoch == evm->epoch) {
+            live->epoch = snapshot->epoch;
+        }
+    }
+    evm->epoch = snapshot->epoch;
+    free(snapshot->headers);
+}
+
+// returns to the newest snapshot, keeping it
+static void restoreSnapshot() {
+    snapshot_t *snapshot = evm->snapshots.snapshots + evm->snapshots.num_snapshots - 1;
+    uint32_t accountCount = evm->emptyAccount - evm->accounts;
+    for (uint32_t i = 0; i < 256 + accountCount; i++) {
+        account_t *live = i < 256 ? evm->precompiles + i : evm->accounts + i - 256;
+        account_t *saved = i < 256 + snapshot->accountCount ? snapshot->headers + i : NULL;
+        if (live->epoch == evm->epoch) {
+            freeAccountStorage(live);
+        }
+        // like evmInit, code set since the snapshot is freed
+        if (live->code.content != NULL && (saved == NULL || live->code.content != saved->code.content)) {
+            free(live->code.content);
+        }
+    }
+    memcpy(evm->precompiles, snapshot->headers, 256 * sizeof(account_t));
+    memcpy(evm->accounts, snapshot->headers + 256, snapshot->accountCount * sizeof(account_t));
+    if (accountCount > snapshot->accountCount) {
+        bzero(evm->accounts + snapshot->accountCount, (accountCount - snapshot->accountCount) * sizeof(account_t));
+    }
+    evm->emptyAccount = evm->accounts + snapshot->accountCount;
+    evm->logIndex = snapshot->logIndex;
+    evm->refundCounter = 0;
+    // storage is shared with the snapshot again
+    evm->epoch = ++evm->epochs;
+}
+
+void evmRestore_r(evm_t *instance, uint16_t snapshot) {
+    evm = instance;
+    assert(snapshot < evm->snapshots.num_snapshots);
+    while (evm->snapshots.num_snapshots > snapshot + 1) {
+        releaseSnapshot();
+    }
+    restoreSnapshot();
+}
+
+void evmRestore(uint16_t snapshot) {
+    evmRestore_r(&defaultEvm, snapshot);
+}
+
+void evmRelease_r(evm_t *instance, uint16_t snapshot) {
+    evm = instance;
+    while (evm->snapshots.num_snapshots > snapshot) {
+        releaseSnapshot();
+    }
+}
+
+void evmRelease(uint16_t snapshot) {
+    evmRelease_r(&defaultEvm, snapshot);
+}
+
+static void digestAppend(memory_t *buffer, const void *bytes, size_t length) {
+    memory_ensure(buffer, buffer->num_uint8s + length);
+    memcpy(buffer->uint8s + buffer->num_uint8s, bytes, length);
+    buffer->num_uint8s += length;
+}
+
+static void digestAccount(memory_t *buffer, account_t *account) {
+    digestAppend(buffer, &account->address, sizeof(address_t));
+    digestAppend(buffer, account->balance, sizeof(val_t));
+    digestAppend(buffer, &account->nonce, sizeof(account->nonce));
+    digestAppend(buffer, accountCodeEntry(account)->hash, 32);
+    // storage is in insertion order, so equal states can differ in digest
+    for (uint32_t i = 0; i < account->storage.count; i++) {
+        digestAppend(buffer, &account->storage.slots[i].key, sizeof(uint256_t));
+        digestAppend(buffer, &account->storage.slots[i].value, sizeof(uint256_t));
+    }
+}
+
+void evmStateDigest_r(evm_t *instance, uint8_t digest[32]) {
+    evm = instance;
+    memory_t buffer;
+    memory_init(&buffer, 4096);
+    digestAppend(&buffer, &evm->blockNumber, sizeof(evm->blockNumber));
+    digestAppend(&buffer, &evm->timestamp, sizeof(evm->timestamp));
+    digestAppend(&buffer, &evm->coinbase, sizeof(address_t));
+    digestAppend(&buffer, &evm->gasLimit, sizeof(evm->gasLimit));
+    digestAppend(&buffer, &evm->baseFee, sizeof(evm->baseFee));
+    digestAppend(&buffer, &evm->prevRandao, sizeof(uint256_t));
+    for (uint16_t i = 0; i < 256; i++) {
+        digestAccount(&buffer, evm->precompiles + i);
+    }
+    for (account_t *account = evm->accounts; account < evm->emptyAccount; account++) {
+        digestAccount(&buffer, account);
+    }
+    keccak_256(digest, 32, buffer.uint8s, buffer.num_uint8s);
+    memory_destroy(&buffer);
+}
+
+void evmStateDigest(uint8_t digest[32]) {
+    evmStateDigest_r(&defaultEvm, digest);
+}
+
+void evmVisitState_r(evm_t *instance, const stateVisitor_t *visitor) {
+    for (const account_t *account = instance->accounts; account < instance->emptyAccount; account++) {
+        visitor->account(visitor->context, &account->address, account->balance, account->nonce, &account->code);
+        for (uint32_t i = 0; i < account->storage.count; i++) {
+            visitor->storage(visitor->context, &account->address, &account->storage.slots[i].key, &account->storage.slots[i].value);
+        }
+    }
+}
+
+void evmVisitState(const stateVisitor_t *visitor) {
+    evmVisitState_r(&defaultEvm, visitor);
+}
+
+static int compareImageAccounts(const void *a, const void *b) {
+    return memcmp(((const imageAccount_t *)a)->address, ((const imageAccount_t *)b)->address, 20);
+}
+
+static int compareImageSlots(const void *a, const void *b) {
+    return memcmp(((const imageSlot_t *)a)->key, ((const imageSlot_t *)b)->key, 32);
+}
+
+// the code of an image account, before accounts with the same code share it
+typedef struct accountCode {
+    uint8_t hash[32];
+    uint32_t account;
+    const data_t *content;
+} accountCode_t;
+
+static int compareAccountCodes(const void *a, const void *b) {
+    return memcmp(((const accountCode_t *)a)->hash, ((const accountCode_t *)b)->hash, 32);
+}
+
+bool evmWriteImage_r(evm_t *instance, FILE *file) {
+    evm = instance;
+    uint32_t count = evm->emptyAccount - evm->accounts;
+    uint64_t maxSlots = 0;
+    for (const account_t *account = evm->accounts; account < evm->emptyAccount; account++) {
+        maxSlots += account->storage.count;
+    }
+    imageAccount_t *accounts = calloc(count + 1, sizeof(imageAccount_t));
+    accountCode_t *accountCodes = calloc(count + 1, sizeof(accountCode_t));
+    imageCode_t *codes = calloc(count + 1, sizeof(imageCode_t));
+    const data_t **codeContents = calloc(count + 1, sizeof(data_t *));
+    imageSlot_t *slots = calloc(maxSlots + 1, sizeof(imageSlot_t));
+
+    imageHeader_t header;
+    bzero(&header, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    for (account_t *account = evm->accounts; account < evm->emptyAccount; account++) {
+        uint64_t firstSlot = header.slotCount;
+        for (uint32_t i = 0; i < account->storage.count; i++) {
+            const storage_t *storage = account->storage.slots + i;
+            if (!zero256(&storage->value)) {
+                dumpu256BE(&storage->key, slots[header.slotCount].key);
+                dumpu256BE(&storage->value, slots[header.slotCount].value);
+                header.slotCount++;
+            }
+        }
+        if (AccountDead(account) && header.slotCount == firstSlot) {
+            continue;
+        }
+        accountCode_t *accountCode = accountCodes + header.accountCount;
+        memcpy(accountCode->hash, accountCodeEntry(account)->hash, 32);
+        accountCode->account = header.accountCount;
+        accountCode->content = &account->code;
+        imageAccount_t *image = accounts + header.accountCount++;
+        memcpy(image->address, account->address.address, sizeof(image->address));
+        memcpy(image->balance, account->balance, sizeof(image->balance));
+        image->nonce = account->nonce;
+        image->firstSlot = firstSlot;
+        image->slotCount = header.slotCount - firstSlot;
+        qsort(slots + firstSlot, image->slotCount, sizeof(imageSlot_t), compareImageSlots);
+    }
+    // accounts with the same code share it
+    qsort(accountCodes, header.accountCount, sizeof(accountCode_t), compareAccountCodes);
+    for (uint32_t i = 0; i < header.accountCount; i++) {
+        if (i == 0 || memcmp(accountCodes[i].hash, accountCodes[i - 1].hash, 32)) {
+            imageCode_t *code = codes + header.codeCount;
+            memcpy(code->hash, accountCodes[i].hash, 32);
+            code->offset = header.codeBytes;
+            code->size = accountCodes[i].content->size;
+            codeContents[header.codeCount++] = accountCodes[i].content;
+            header.codeBytes += code->size;
+        }
+        accounts[accountCodes[i].account].code = header.codeCount - 1;
+    }
+    qsort(accounts, header.accountCount, sizeof(imageAccount_t), compareImageAccounts);
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(accounts, sizeof(imageAccount_t), header.accountCount, file);
+    fwrite(codes, sizeof(imageCode_t), header.codeCount, file);
+    fwrite(slots, sizeof(imageSlot_t), header.slotCount, file);
+    for (uint64_t i = 0; i < header.codeCount; i++) {
+        fwrite(codeContents[i]->content, 1, codeContents[i]->size, file);
+    }
+    free(accounts);
+    free(accountCodes);
+    free(codes);
+    free(codeContents);
+    free(slots);
+    return !ferror(file);
+}
+
+bool evmWriteImage(FILE *file) {
+    return evmWriteImage_r(&defaultEvm, file);
+}
+
+uint64_t evmOpCount_r(evm_t *instance) {
+    return instance->opCount;
+}
+
+uint64_t evmOpCount() {
+    return evmOpCount_r(&defaultEvm);
+}
+
+uint32_t evmInternedCodes() {
+    pthread_mutex_lock(&codes.lock);
+    uint32_t count = codes.count;
+    pthread_mutex_unlock(&codes.lock);
+    return count;
+}
+
+void evmMockBalance_r(evm_t *instance, address_t from, const val_t balance) {
+    evm = instance;
     account_t *account = getAccount(from);
     account->balance[0] = balance[0];
     account->balance[1] = balance[1];
     account->balance[2] = balance[2];
 }
 
+void evmMockBalance(address_t from, const val_t balance) {
+    evmMockBalance_r(&defaultEvm, from, balance);
+}
+
+void evmMockCode_r(evm_t *instance, address_t to, data_t code) {
+    evm = instance;
+    setAccountCode(getAccount(to), code);
+}
+
 void evmMockCode(address_t to, data_t code) {
-    getAccount(to)->code = code;
+    evmMockCode_r(&defaultEvm, to, code);
 }
 
-void evmMockNonce(address_t to, uint64_t nonce) {
+void evmMockNonce_r(evm_t *instance, address_t to, uint64_t nonce) {
+    evm = instance;
     getAccount(to)->nonce = nonce;
 }
 
+void evmMockNonce(address_t to, uint64_t nonce) {
+    evmMockNonce_r(&defaultEvm, to, nonce);
+}
+
 typedef struct hashResult {
     val_t top96;
     address_t bottom160;
@@ -497,7 +1217,7 @@ static account_t *createNewAccount(account_t *from) {
     keccak_256((uint8_t *)&hashResult, sizeof(hashResult), inputBuffer, inputBuffer[0] - 0xbf);
     account_t *result = getAccount(hashResult.bottom160);
     result->nonce = 1;
-    result->warm = evmIteration;
+    result->warm = evm->evmIteration;
     return result;
 }
 
@@ -512,37 +1232,104 @@ static account_t *createNewAccount2(account_t *from, const uint256_t *salt, cons
     keccak_256((uint8_t *)&hashResult, sizeof(hashResult), inputBuffer, 85);
     account_t *result = getAccount(hashResult.bottom160);
     result->nonce = 1;
-    result->warm = evmIteration;
+    result->warm = evm->evmIteration;
     return result;
 }
 
 static account_t *warmAccount(context_t *callContext, const address_t address) {
     account_t *account = getAccount(address);
-    if (account->warm != evmIteration) {
+    if (account->warm != evm->evmIteration) {
         uint64_t gasCost = G_COLD_ACCOUNT - G_ACCESS;
         if (callContext->gas < gasCost) {
             return NULL;
         }
         callContext->gas -= gasCost;
-        account->warm = evmIteration;
+        account->warm = evm->evmIteration;
     }
     return account;
 }
 
+// copies the storage shared with the newest snapshot
+static void ownAccountStorage(account_t *account) {
+    if (account->epoch == evm->epoch) {
+        return;
+    }
+    account->epoch = evm->epoch;
+    storageTable_t *table = &account->storage;
+    if (table->capacity) {
+        const storage_t *sharedSlots = table->slots;
+        const uint32_t *sharedIndex = table->index;
+        table->slots = malloc(table->capacity * sizeof(storage_t));
+        memcpy(table->slots, sharedSlots, table->count * sizeof(storage_t));
+        table->index = malloc(table->capacity * 2 * sizeof(uint32_t));
+        memcpy(table->index, sharedIndex, table->capacity * 2 * sizeof(uint32_t));
+    }
+    // snapshots are taken between transactions, when transient storage is stale
+    account->tstorage = NULL;
+}
+
+static uint32_t storageHash(const uint256_t *key) {
+    uint64_t hash = UPPER(UPPER_P(key)) * 0xff51afd7ed558ccdull
+        ^ LOWER(UPPER_P(key)) * 0xc4ceb9fe1a85ec53ull
+        ^ UPPER(LOWER_P(key)) * 0x94d049bb133111ebull
+        ^ LOWER(LOWER_P(key));
+    return (hash * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+// the index entry for the key, which is 0 if the key is absent
+static uint32_t *findStorageIndex(const storageTable_t *table, const uint256_t *key) {
+    uint32_t mask = table->capacity * 2 - 1;
+    for (uint32_t i = storageHash(key) & mask;; i = (i + 1) & mask) {
+        uint32_t *position = table->index + i;
+        if (*position == 0 || equal256(&table->slots[*position - 1].key, key)) {
+            return position;
+        }
+    }
+}
+
+static void reserveStorage(storageTable_t *table, uint32_t count) {
+    if (count <= table->capacity) {
+        return;
+    }
+    uint32_t capacity = table->capacity ? table->capacity : 4;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    table->slots = realloc(table->slots, capacity * sizeof(storage_t));
+    free(table->index);
+    table->index = calloc(capacity * 2, sizeof(uint32_t));
+    table->capacity = capacity;
+    for (uint32_t i = 0; i < table->count; i++) {
+        *findStorageIndex(table, &table->slots[i].key) = i + 1;
+    }
+}
+
+// the slot can move when another is added
 static storage_t *getAccountStorage(account_t *account, const uint256_t *key) {
-    storage_t **storage = &account->storage;
-    while (*storage != NULL) {
-        if (equal256(&(*storage)->key, key)) {
-            return *storage;
+    ownAccountStorage(account);
+    storageTable_t *table = &account->storage;
+    if (table->capacity) {
+        uint32_t *position = findStorageIndex(table, key);
+        if (*position) {
+            return table->slots + *position - 1;
         }
-        storage = &(*storage)->next;
     }
-    *storage = calloc(1, sizeof(storage_t));
-    copy256(&(*storage)->key, key);
-    return *storage;
+    uint256_t value;
+    clear256(&value);
+    if (evm->provider) {
+        evm->provider->storage(evm->provider->context, &account->address, key, &value);
+    }
+    reserveStorage(table, table->count + 1);
+    storage_t *storage = table->slots + table->count++;
+    bzero(storage, sizeof(storage_t));
+    copy256(&storage->key, key);
+    copy256(&storage->value, &value);
+    *findStorageIndex(table, key) = table->count;
+    return storage;
 }
 
 static tstorage_t *getAccountTransientStorage(account_t *account, const uint256_t *key) {
+    ownAccountStorage(account);
     tstorage_t **tstorage = &account->tstorage;
     while (*tstorage != NULL) {
         if (equal256(&(*tstorage)->key, key)) {
@@ -555,153 +1342,189 @@ static tstorage_t *getAccountTransientStorage(account_t *account, const uint256_
     return *tstorage;
 }
 
-// NOTE this sometimes dismantles and reuses the elements of src
+// NOTE this dismantles and reuses the elements of src
 static void mergeStateChanges(stateChanges_t **dst, stateChanges_t *src) {
-    if (src == NULL) {
-        return;
+    // the accounts of src are merged from the last
+    stateChanges_t *reversed = NULL;
+    while (src != NULL) {
+        stateChanges_t *next = src->next;
+        src->next = reversed;
+        reversed = src;
+        src = next;
     }
-    mergeStateChanges(dst, src->next);
-
-    while (*dst != NULL) {
-        if (AddressEqual(&src->account, &(*dst)->account)) {
-            // merge!
-
-            // concatenate the linked lists
-            codeChanges_t **codeEnd = &src->codeChanges;
-            while (*codeEnd != NULL) {
-                codeEnd = &(*codeEnd)->prev;
-            }
-            *codeEnd = (*dst)->codeChanges;
-            (*dst)->codeChanges = src->codeChanges;
+    while (reversed != NULL) {
+        src = reversed;
+        reversed = reversed->next;
+        stateChanges_t **end = dst;
+        while (*end != NULL && !AddressEqual(&src->account, &(*end)->account)) {
+            end = &(*end)->next;
+        }
+        if (*end == NULL) {
+            // reuse src
+            src->next = NULL;
+            *end = src;
+            continue;
+        }
+        // merge!
 
-            storageChanges_t **storageEnd = &src->storageChanges;
-            while (*storageEnd != NULL) {
-                storageEnd = &(*storageEnd)->prev;
-            }
-            *storageEnd = (*dst)->storageChanges;
-            (*dst)->storageChanges = src->storageChanges;
+        // concatenate the linked lists
+        codeChanges_t **codeEnd = &src->codeChanges;
+        while (*codeEnd != NULL) {
+            codeEnd = &(*codeEnd)->prev;
+        }
+        *codeEnd = (*end)->codeChanges;
+        (*end)->codeChanges = src->codeChanges;
 
-            logChanges_t **logsEnd = &src->logChanges;
-            while (*logsEnd != NULL) {
-                logsEnd = &(*logsEnd)->prev;
-            }
-            *logsEnd = (*dst)->logChanges;
-            (*dst)->logChanges = src->logChanges;
+        storageChanges_t **storageEnd = &src->storageChanges;
+        while (*storageEnd != NULL) {
+            storageEnd = &(*storageEnd)->prev;
+        }
+        *storageEnd = (*end)->storageChanges;
+        (*end)->storageChanges = src->storageChanges;
 
-            return;
+        logChanges_t **logsEnd = &src->logChanges;
+        while (*logsEnd != NULL) {
+            logsEnd = &(*logsEnd)->prev;
         }
-        dst = &(*dst)->next;
+        *logsEnd = (*end)->logChanges;
+        (*end)->logChanges = src->logChanges;
+
+        free(src);
     }
-    // reuse src
-    src->next = *dst;
-    *dst = src;
 }
 
-void evmMockStorage(address_t to, const uint256_t *key, const uint256_t *storedValue) {
+void evmMockStorage_r(evm_t *instance, address_t to, const uint256_t *key, const uint256_t *storedValue) {
+    evm = instance;
     account_t *account = getAccount(to);
     storage_t *storage = getAccountStorage(account, key);
     copy256(&storage->value, storedValue);
 }
 
+void evmMockStorage(address_t to, const uint256_t *key, const uint256_t *storedValue) {
+    evmMockStorage_r(&defaultEvm, to, key, storedValue);
+}
+
+void evmReserveStorage_r(evm_t *instance, address_t to, uint32_t slots) {
+    evm = instance;
+    account_t *account = getAccount(to);
+    ownAccountStorage(account);
+    reserveStorage(&account->storage, account->storage.count + slots);
+}
+
+void evmReserveStorage(address_t to, uint32_t slots) {
+    evmReserveStorage_r(&defaultEvm, to, slots);
+}
+
 // you might expect the marginal cost of warming a slot is constant but actually it is 100 cheaper if you do it in SLOAD.
 static storage_t *warmStorage(context_t *callContext, uint256_t *key, uint64_t warmGasCost) {
     account_t *account = callContext->account;
     storage_t *storage = getAccountStorage(account, key);
-    if (storage->warm != evmIteration) {
+    if (storage->warm != evm->evmIteration) {
         if (callContext->gas < warmGasCost) {
             return NULL;
         }
         callContext->gas -= warmGasCost;
-        storage->warm = evmIteration;
+        storage->warm = evm->evmIteration;
         copy256(&storage->original, &storage->value);
     }
     return storage;
 }
 
-static result_t doSupportedPrecompile(precompile_t precompile, context_t *callContext) {
-    uint64_t gasCost;
+void evmMockPrecompile_r(evm_t *instance, address_t to, precompileHandler_t handler) {
+    evm = instance;
+    account_t *account;
+    if (AddressIsPrecompile(to) && !to.address[18]) {
+        // skip the unknown precompile warning
+        account = evm->precompiles + to.address[19];
+        AddressCopy(account->address, to);
+    } else {
+        account = getAccount(to);
+    }
+    account->precompile = handler;
+}
+
+void evmMockPrecompile(address_t to, precompileHandler_t handler) {
+    evmMockPrecompile_r(&defaultEvm, to, handler);
+}
+
+static result_t doPrecompile(context_t *callContext) {
+    const precompileHandler_t *handler = &callContext->account->precompile;
     result_t result;
     result.stateChanges = NULL;
     LOWER(LOWER(result.status)) = 1;
     UPPER(LOWER(result.status)) = 0;
     LOWER(UPPER(result.status)) = 0;
     UPPER(UPPER(result.status)) = 0;
-    #define OUT_OF_GAS \
-            fprintf(stderr, "Out of gas in precompile %s\n", precompileName[precompile]); \
-            LOWER(LOWER(result.status)) = 0; \
-            callContext->gas = 0; \
-            result.returnData.size = 0; \
-            return result
-    #define APPLY_GAS_COST(required) \
-            gasCost = required; \
-            if (callContext->gas < gasCost) { \
-                OUT_OF_GAS; \
-            } \
-            callContext->gas -= gasCost
-
-    switch (precompile) {
-    case HOLE:
+
+    uint64_t gasCost = handler->gas(&callContext->callData);
+    if (callContext->gas < gasCost) {
+        fprintf(stderr, "Out of gas in precompile %s\n", handler->name);
+        LOWER(LOWER(result.status)) = 0;
+        callContext->gas = 0;
         result.returnData.size = 0;
         return result;
-    case ECRECOVER:
-    {
-        APPLY_GAS_COST(3000);
-        uint8_t input[128];
-        memset(input, 0, 128);
-        size_t copyLen = callContext->callData.size < 128 ? callContext->callData.size : 128;
-        memcpy(input, callContext->callData.content, copyLen);
-        // v is at bytes [32..63]: upper 31 bytes must be 0, last byte must be 27 or 28
-        for (int i = 32; i < 63; i++) {
-            if (input[i] != 0) {
-                result.returnData.size = 0;
-                return result;
-            }
-        }
-        int v = input[63];
-        if (v != 27 && v != 28) {
-            result.returnData.size = 0;
-            return result;
-        }
-        int recid = v - 27;
-        secp256k1_ecdsa_recoverable_signature sig;
-        if (!secp256k1_ecdsa_recoverable_signature_parse_compact(secp256k1_context_static, &sig, input + 64, recid)) {
-            result.returnData.size = 0;
+    }
+    callContext->gas -= gasCost;
+
+    // the frame memory is the output buffer; most outputs fit in 64 bytes or the size of the input
+    memory_t *memory = &callContext->memory;
+    size_t capacity = callContext->callData.size > 64 ? callContext->callData.size : 64;
+    while (1) {
+        memory_ensure(memory, capacity);
+        result.returnData.content = memory->uint8s;
+        result.returnData.size = capacity;
+        switch (handler->execute(&callContext->callData, &result.returnData)) {
+        case PRECOMPILE_SUCCEEDED:
             return result;
-        }
-        secp256k1_pubkey pubkey;
-        if (!secp256k1_ecdsa_recover(secp256k1_context_static, &pubkey, &sig, input)) {
+        case PRECOMPILE_OUTPUT_TOO_SMALL:
+            capacity = result.returnData.size;
+            continue;
+        case PRECOMPILE_FAILED:
+            LOWER(LOWER(result.status)) = 0;
+            callContext->gas = 0;
             result.returnData.size = 0;
             return result;
         }
-        uint8_t pubkeyBytes[65];
-        size_t pubkeyLen = 65;
-        secp256k1_ec_pubkey_serialize(secp256k1_context_static, pubkeyBytes, &pubkeyLen, &pubkey, SECP256K1_EC_UNCOMPRESSED);
-        result.returnData.size = 32;
-        result.returnData.content = malloc(32);
-        keccak_256(result.returnData.content, 32, pubkeyBytes + 1, 64);
-        memset(result.returnData.content, 0, 12);
-        return result;
     }
-    case IDENTITY:
-        APPLY_GAS_COST(15 + 3 * ((callContext->callData.size + 31) / 32));
-        result.returnData.size = callContext->callData.size;
-        result.returnData.content = malloc(callContext->callData.size);
-        memcpy(result.returnData.content, callContext->callData.content, callContext->callData.size);
-        return result;
-    default:
-        assert(0);
-    }
-    #undef APPLY_GAS_COST
-    #undef OUT_OF_GAS
 }
 
-static result_t evmStaticCall(address_t from, uint64_t gas, address_t to, data_t input);
-static result_t evmDelegateCall(uint64_t gas, account_t *codeSource, data_t input);
-static result_t evmCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input);
-static result_t evmCreate(account_t *fromAccount, uint64_t gas, val_t value, data_t input);
-static result_t evmCreate2(account_t *fromAccount, uint64_t gas, val_t value, data_t input, const uint256_t *salt);
+// Each prepares the next frame of the callstack, or fills the failure and returns NULL when the call cannot start
+static context_t *prepareStaticCall(address_t from, uint64_t gas, address_t to, data_t input, result_t *failure);
+static context_t *prepareDelegateCall(uint64_t gas, account_t *codeSource, data_t input, result_t *failure);
+static context_t *prepareCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input, result_t *failure);
+static context_t *prepareCreate(account_t *fromAccount, uint64_t gas, val_t value, data_t input, result_t *failure);
+static context_t *prepareCreate2(account_t *fromAccount, uint64_t gas, val_t value, data_t input, const uint256_t *salt, result_t *failure);
+static void enterFrame(context_t *callContext);
+static void leaveFrame(context_t *callContext, result_t *result);
+static void depositCode(context_t *callContext, result_t *result);
+
+// applies the result of the call the frame made with op
+static void returnToCaller(context_t *callContext, op_t op, const result_t *child, result_t *result) {
+    callContext->gas += child->gasRemaining;
+    mergeStateChanges(&result->stateChanges, child->stateChanges);
+    callContext->returnData = child->returnData;
+    if (op == CREATE || op == CREATE2) {
+        if (!zero256(&child->status)) {
+            callContext->returnData.size = 0;         // EIP-211: success = empty buffer
+        }
+    } else {
+        uint64_t outSize = callContext->returnSize;
+        if (callContext->returnData.size < outSize) {
+            outSize = callContext->returnData.size;
+        }
+        memcpy(callContext->memory.uint8s + callContext->returnOffset, child->returnData.content, outSize);
+    }
+    copy256(callContext->top - 1, &child->status);
+}
 
+// Runs the entered frame until it returns
+// Nested calls run in the same loop: the caller is suspended in its frame, the callee is entered, and the caller resumes when it returns
 static result_t doCall(context_t *callContext) {
+    context_t *base = callContext;
+    result_t result;
+    uint64_t pc;
+    uint8_t buffer[32];
+enter:
     if (SHOW_CALLS) {
         INDENT;
         fprintf(stderr, "from: ");
@@ -726,23 +1549,17 @@ static result_t doCall(context_t *callContext) {
 
         dumpCallData(callContext);
     }
-    if (AddressIsPrecompile(callContext->account->address)) {
-        if (PrecompileIsKnownPrecompile(callContext->account->address)) {
-            precompile_t precompile = AddressToPrecompile(callContext->account->address);
-            if (PrecompileIsSupported(precompile)) {
-                return doSupportedPrecompile(precompile, callContext);
-            } else {
-                fprintf(stderr, "Unsupported precompile %s\n", precompileName[precompile]);
-            }
-        } else {
-            // warning already issued by getAccount
-        }
+    if (callContext->account->precompile.execute) {
+        result = doPrecompile(callContext);
+        goto leave;
+    }
+    if (callContext->account >= evm->precompiles && callContext->account < evm->precompiles + KNOWN_PRECOMPILES) {
+        fprintf(stderr, "Unsupported precompile %s\n", precompileName[callContext->account - evm->precompiles]);
     }
-    result_t result;
     result.stateChanges = NULL;
     clear256(&result.status);
-    uint64_t pc = 0;
-    uint8_t buffer[32];
+    pc = 0;
+run:
     while (1) {
         op_t op;
         if (pc < callContext->code.size) {
@@ -750,6 +1567,7 @@ static result_t doCall(context_t *callContext) {
         } else {
             op = STOP;
         }
+        evm->opCount++;
 
         if (SHOW_STACK) {
             dumpStack(callContext);
@@ -769,10 +1587,22 @@ static result_t doCall(context_t *callContext) {
         #define FAIL_INVALID \
                 callContext->gas = 0; \
                 result.returnData.size = 0; \
-                return result
+                goto leave
         #define OUT_OF_GAS \
                 fprintf(stderr, "Out of gas at pc %" PRIu64 " op %s\n", pc - 1, opString[op]); \
                 FAIL_INVALID
+        // continues with the frame, resuming after this op when it returns
+        #define CALL_FRAME(frame, failure) \
+                if (frame == NULL) { \
+                    returnToCaller(callContext, op, &failure, &result); \
+                    break; \
+                } \
+                callContext->pc = pc; \
+                callContext->calling = op; \
+                callContext->stateChanges = result.stateChanges; \
+                callContext = frame; \
+                enterFrame(callContext); \
+                goto enter
         if (
             (callContext->top < callContext->bottom + argCount[op])
             || (op >= DUP1 && op <= DUP16 && callContext->top - (op - PUSH32) < callContext->bottom)
@@ -924,7 +1754,7 @@ static result_t doCall(context_t *callContext) {
             AddressToUint256(callContext->top - 1, &callContext->caller);
             break;
         case ORIGIN:
-            AddressToUint256(callContext->top - 1, &callstack.bottom[0].caller);
+            AddressToUint256(callContext->top - 1, &evm->callstack.bottom[0].caller);
             break;
         case POP:
         // intentional fallthrough
@@ -1144,35 +1974,21 @@ static result_t doCall(context_t *callContext) {
                 fprintf(stderr, "%s to invalid destination %" PRIu64 " (%s)\n", opString[op], pc, opString[callContext->code.content[pc]]);
                 FAIL_INVALID;
             }
-            // Verify the JUMPDEST byte is a real instruction, not PUSH data.
-            // Backward scan: PUSH_n covers at most n <= 32 data bytes ahead.
-            // If no candidate found, skip the more expensive forward scan.
-            {
-                uint64_t lookback = pc < 32 ? pc : 32;
-                bool needForwardScan = false;
-                for (uint64_t i = 1; i <= lookback; i++) {
-                    uint8_t cb = callContext->code.content[pc - i];
-                    if (cb >= PUSH1 && cb <= PUSH32 && cb - PUSH0 >= i) {
-                        needForwardScan = true;
-                        break;
-                    }
-                }
-                if (needForwardScan) {
-                    uint64_t fpc = 0;
-                    while (fpc < pc) {
-                        uint8_t cb = callContext->code.content[fpc];
-                        if (cb >= PUSH1 && cb <= PUSH32) {
-                            uint8_t n = cb - PUSH0;
-                            if (fpc + n >= pc) {
-                                fprintf(stderr, "%s to JUMPDEST inside PUSH%u data at %" PRIu64 "\n", opString[op], n, pc);
-                                FAIL_INVALID;
-                            }
-                            fpc += 1 + n;
-                        } else {
-                            fpc++;
-                        }
-                    }
+            // the JUMPDEST byte may be PUSH data, which the analysis has marked
+            if (callContext->jumpdests == NULL) {
+                callContext->jumpdests = callContext->codeAccount ? accountCodeEntry(callContext->codeAccount)->jumpdests : analyzeInitcode(callContext);
+            }
+            if (!(callContext->jumpdests[pc / 64] >> (pc % 64) & 1)) {
+                // find the PUSH it belongs to
+                uint64_t fpc = 0;
+                uint8_t n = 0;
+                while (fpc < pc) {
+                    uint8_t cb = callContext->code.content[fpc];
+                    n = cb >= PUSH1 && cb <= PUSH32 ? cb - PUSH0 : 0;
+                    fpc += 1 + n;
                 }
+                fprintf(stderr, "%s to JUMPDEST inside PUSH%u data at %" PRIu64 "\n", opString[op], n, pc);
+                FAIL_INVALID;
             }
             break;
         default:
@@ -1181,7 +1997,7 @@ static result_t doCall(context_t *callContext) {
         case STOP:
             LOWER(LOWER(result.status)) = 1;
             result.returnData.size = 0;
-            return result;
+            goto leave;
         case GAS:
             bzero(callContext->top - 1, 24);
             LOWER(LOWER_P(callContext->top - 1)) = callContext->gas;
@@ -1204,6 +2020,20 @@ static result_t doCall(context_t *callContext) {
             LOWER(LOWER_P(callContext->top - 1)) = account->code.size;
         }
         break;
+        case EXTCODEHASH:
+        {
+            account_t *account = warmAccount(callContext, AddressFromUint256(callContext->top - 1));
+            if (account == NULL) {
+                OUT_OF_GAS;
+            }
+            // EIP-1052: zero for empty accounts
+            if (AccountDead(account)) {
+                clear256(callContext->top - 1);
+            } else {
+                readu256BE(accountCodeEntry(account)->hash, callContext->top - 1);
+            }
+        }
+        break;
         case CODESIZE:
             bzero(callContext->top - 1, 24);
             LOWER(LOWER_P(callContext->top - 1)) = callContext->code.size;
@@ -1278,7 +2108,7 @@ static result_t doCall(context_t *callContext) {
             }
             callContext->gas -= gasCost;
             logChanges_t *log = malloc(sizeof(logChanges_t));
-            log->logIndex = logIndex++;
+            log->logIndex = evm->logIndex++;
             log->topicCount = topicCount;
             if (topicCount) {
                 size_t topicSize = topicCount * sizeof(uint256_t);
@@ -1397,7 +2227,7 @@ static result_t doCall(context_t *callContext) {
                     } else {
                         gasCost = G_SRESET - G_ACCESS;
                         if (zero256(callContext->top)) {
-                            refundCounter += R_CLEAR;
+                            evm->refundCounter += R_CLEAR;
                         }
                     }
                     if (gasCost > callContext->gas) {
@@ -1407,16 +2237,16 @@ static result_t doCall(context_t *callContext) {
                 } else {
                     if (!zero256(&storage->original)) {
                         if (zero256(&storage->value)) {
-                            refundCounter -= R_CLEAR;
+                            evm->refundCounter -= R_CLEAR;
                         } else if (zero256(callContext->top)) {
-                            refundCounter += R_CLEAR;
+                            evm->refundCounter += R_CLEAR;
                         }
                     }
                     if (equal256(&storage->original, callContext->top)) {
                         if (zero256(&storage->original)) {
-                            refundCounter += G_SSET - G_ACCESS;
+                            evm->refundCounter += G_SSET - G_ACCESS;
                         } else {
-                            refundCounter += G_SRESET - G_ACCESS;
+                            evm->refundCounter += G_SRESET - G_ACCESS;
                         }
                     }
                 }
@@ -1455,7 +2285,7 @@ static result_t doCall(context_t *callContext) {
         case TLOAD:
         {
             tstorage_t *storage = getAccountTransientStorage(callContext->account, callContext->top -1);
-            if (storage->warm == evmIteration) {
+            if (storage->warm == evm->evmIteration) {
                 copy256(callContext->top - 1, &storage->value);
             } else {
                 clear256(callContext->top - 1);
@@ -1466,24 +2296,45 @@ static result_t doCall(context_t *callContext) {
         {
             tstorage_t *storage = getAccountTransientStorage(callContext->account, callContext->top + 1);
             copy256(&storage->value, callContext->top);
-            storage->warm = evmIteration;
+            storage->warm = evm->evmIteration;
         }
         break;
         case COINBASE:
             // TODO allow configuration for coinbase
-            AddressToUint256(callContext->top - 1, &coinbase);
+            AddressToUint256(callContext->top - 1, &evm->coinbase);
             break;
         case TIMESTAMP:
             UPPER(UPPER_P(callContext->top - 1)) = 0;
             LOWER(UPPER_P(callContext->top - 1)) = 0;
             UPPER(LOWER_P(callContext->top - 1)) = 0;
-            LOWER(LOWER_P(callContext->top - 1)) = timestamp;
+            LOWER(LOWER_P(callContext->top - 1)) = evm->timestamp;
             break;
         case NUMBER:
             UPPER(UPPER_P(callContext->top - 1)) = 0;
             LOWER(UPPER_P(callContext->top - 1)) = 0;
             UPPER(LOWER_P(callContext->top - 1)) = 0;
-            LOWER(LOWER_P(callContext->top - 1)) = blockNumber;
+            LOWER(LOWER_P(callContext->top - 1)) = evm->blockNumber;
+            break;
+        case GASLIMIT:
+            UPPER(UPPER_P(callContext->top - 1)) = 0;
+            LOWER(UPPER_P(callContext->top - 1)) = 0;
+            UPPER(LOWER_P(callContext->top - 1)) = 0;
+            LOWER(LOWER_P(callContext->top - 1)) = evm->gasLimit;
+            break;
+        case BASEFEE:
+            UPPER(UPPER_P(callContext->top - 1)) = 0;
+            LOWER(UPPER_P(callContext->top - 1)) = 0;
+            UPPER(LOWER_P(callContext->top - 1)) = 0;
+            LOWER(LOWER_P(callContext->top - 1)) = evm->baseFee;
+            break;
+        case GASPRICE:
+            UPPER(UPPER_P(callContext->top - 1)) = 0;
+            LOWER(UPPER_P(callContext->top - 1)) = 0;
+            UPPER(LOWER_P(callContext->top - 1)) = 0;
+            LOWER(LOWER_P(callContext->top - 1)) = evm->gasPrice;
+            break;
+        case PREVRANDAO:
+            copy256(callContext->top - 1, &evm->prevRandao);
             break;
         case CALLVALUE:
             UPPER(UPPER_P(callContext->top - 1)) = 0;
@@ -1497,7 +2348,7 @@ static result_t doCall(context_t *callContext) {
             UPPER(UPPER_P(callContext->top - 1)) = 0;
             LOWER(UPPER_P(callContext->top - 1)) = 0;
             UPPER(LOWER_P(callContext->top - 1)) = 0;
-            LOWER(LOWER_P(callContext->top - 1)) = 1;
+            LOWER(LOWER_P(callContext->top - 1)) = EVM_CHAIN_ID;
             break;
         case SELFBALANCE:
             UPPER(UPPER_P(callContext->top - 1)) = 0;
@@ -1540,14 +2391,9 @@ static result_t doCall(context_t *callContext) {
             uint64_t gas = L(callContext->gas);
             callContext->gas -= gas;
 
-            result_t createResult = evmCreate(callContext->account, gas, value, input);
-            callContext->gas += createResult.gasRemaining;
-            mergeStateChanges(&result.stateChanges, createResult.stateChanges);
-            callContext->returnData = createResult.returnData;
-            if (!zero256(&createResult.status)) {
-                callContext->returnData.size = 0;         // EIP-211: success = empty buffer
-            }
-            copy256(callContext->top - 1, &createResult.status);
+            result_t failure;
+            context_t *frame = prepareCreate(callContext->account, gas, value, input, &failure);
+            CALL_FRAME(frame, failure);
         }
         break;
         case CREATE2:
@@ -1581,14 +2427,9 @@ static result_t doCall(context_t *callContext) {
             uint64_t gas = L(callContext->gas);
             callContext->gas -= gas;
 
-            result_t createResult = evmCreate2(callContext->account, gas, value, input, salt);
-            callContext->gas += createResult.gasRemaining;
-            mergeStateChanges(&result.stateChanges, createResult.stateChanges);
-            callContext->returnData = createResult.returnData;
-            if (!zero256(&createResult.status)) {
-                callContext->returnData.size = 0;         // EIP-211: success = empty buffer
-            }
-            copy256(callContext->top - 1, &createResult.status);
+            result_t failure;
+            context_t *frame = prepareCreate2(callContext->account, gas, value, input, salt, &failure);
+            CALL_FRAME(frame, failure);
         }
         break;
         case CALL:
@@ -1634,15 +2475,11 @@ static result_t doCall(context_t *callContext) {
             if (value[0] || value[1] || value[2]) {
                 gas += G_CALLSTIPEND;
             }
-            result_t callResult = evmCall(callContext->account->address, gas, to, value, input);
-            callContext->gas += callResult.gasRemaining;
-            mergeStateChanges(&result.stateChanges, callResult.stateChanges);
-            callContext->returnData = callResult.returnData;
-            if (callContext->returnData.size < outSize) {
-                outSize = callContext->returnData.size;
-            }
-            memcpy(callContext->memory.uint8s + dst, callResult.returnData.content, outSize);
-            copy256(callContext->top - 1, &callResult.status);
+            callContext->returnOffset = dst;
+            callContext->returnSize = outSize;
+            result_t failure;
+            context_t *frame = prepareCall(callContext->account->address, gas, to, value, input, &failure);
+            CALL_FRAME(frame, failure);
         }
         break;
         case DELEGATECALL:
@@ -1675,15 +2512,11 @@ static result_t doCall(context_t *callContext) {
                 gas = L(callContext->gas);
             }
             callContext->gas -= gas;
-            result_t delegateCallResult = evmDelegateCall(gas, toAccount, input);
-            callContext->gas += delegateCallResult.gasRemaining;
-            mergeStateChanges(&result.stateChanges, delegateCallResult.stateChanges);
-            callContext->returnData = delegateCallResult.returnData;
-            if (callContext->returnData.size < outSize) {
-                outSize = callContext->returnData.size;
-            }
-            memcpy(callContext->memory.uint8s + dst, delegateCallResult.returnData.content, outSize);
-            copy256(callContext->top - 1, &delegateCallResult.status);
+            callContext->returnOffset = dst;
+            callContext->returnSize = outSize;
+            result_t failure;
+            context_t *frame = prepareDelegateCall(gas, toAccount, input, &failure);
+            CALL_FRAME(frame, failure);
         }
         break;
         case STATICCALL:
@@ -1716,15 +2549,11 @@ static result_t doCall(context_t *callContext) {
                 gas = L(callContext->gas);
             }
             callContext->gas -= gas;
-            result_t callResult = evmStaticCall(callContext->account->address, gas, to, input);
-            callContext->gas += callResult.gasRemaining;
-            mergeStateChanges(&result.stateChanges, callResult.stateChanges);
-            callContext->returnData = callResult.returnData;
-            if (callContext->returnData.size < outSize) {
-                outSize = callContext->returnData.size;
-            }
-            memcpy(callContext->memory.uint8s + dst, callResult.returnData.content, outSize);
-            copy256(callContext->top - 1, &callResult.status);
+            callContext->returnOffset = dst;
+            callContext->returnSize = outSize;
+            result_t failure;
+            context_t *frame = prepareStaticCall(callContext->account->address, gas, to, input, &failure);
+            CALL_FRAME(frame, failure);
         }
         break;
         case RETURN:
@@ -1748,94 +2577,156 @@ static result_t doCall(context_t *callContext) {
                     fprintf(stderr, "\033[0m");
                 }
             }
-            return result;
+            goto leave;
         }
     }
 #undef OUT_OF_GAS
+#undef CALL_FRAME
+leave:
+    leaveFrame(callContext, &result);
+    if (callContext == base) {
+        return result;
+    }
+    // resume the caller
+    callContext--;
+    if (callContext->calling == CREATE || callContext->calling == CREATE2) {
+        depositCode(callContext + 1, &result);
+    }
+    result_t child = result;
+    result.stateChanges = callContext->stateChanges;
+    clear256(&result.status);
+    pc = callContext->pc;
+    returnToCaller(callContext, callContext->calling, &child, &result);
+    goto run;
 }
 
-static void evmRevertCodeChanges(account_t *account, codeChanges_t **changes) {
-    if (*changes == NULL) {
-        return;
+void evmFreeStateChanges(stateChanges_t *stateChanges) {
+    while (stateChanges != NULL) {
+        while (stateChanges->codeChanges != NULL) {
+            codeChanges_t *prev = stateChanges->codeChanges->prev;
+            free(stateChanges->codeChanges);
+            stateChanges->codeChanges = prev;
+        }
+        while (stateChanges->storageChanges != NULL) {
+            storageChanges_t *prev = stateChanges->storageChanges->prev;
+            free(stateChanges->storageChanges);
+            stateChanges->storageChanges = prev;
+        }
+        while (stateChanges->logChanges != NULL) {
+            logChanges_t *prev = stateChanges->logChanges->prev;
+            free(stateChanges->logChanges->topics);
+            free(stateChanges->logChanges->data.content);
+            free(stateChanges->logChanges);
+            stateChanges->logChanges = prev;
+        }
+        stateChanges_t *next = stateChanges->next;
+        free(stateChanges);
+        stateChanges = next;
     }
-    assert(DataEqual(&account->code, &(*changes)->after));
-    account->code = (*changes)->before;
+}
 
-    evmRevertCodeChanges(account, &(*changes)->prev);
-    free(*changes);
-    *changes = NULL;
+static void evmRevertCodeChanges(account_t *account, codeChanges_t **changes) {
+    while (*changes != NULL) {
+        codeChanges_t *change = *changes;
+        assert(DataEqual(&account->code, &change->after));
+        setAccountCode(account, change->before);
+        *changes = change->prev;
+        free(change);
+    }
 }
 
 static void evmRevertStorageChanges(account_t *account, storageChanges_t **changes) {
-    if (*changes == NULL) {
-        return;
+    // the newest first, so the oldest warm remains
+    while (*changes != NULL) {
+        storageChanges_t *change = *changes;
+        storage_t *storage = getAccountStorage(account, &change->key);
+        assert(equal256(&storage->value, &change->after));
+        copy256(&storage->value, &change->before);
+        storage->warm = change->warm;
+        *changes = change->prev;
+        free(change);
     }
-    storage_t *storage = getAccountStorage(account, &(*changes)->key);
-    assert(equal256(&storage->value, &(*changes)->after));
-    copy256(&storage->value, &(*changes)->before);
-    storage->warm = (*changes)->warm;
-
-    evmRevertStorageChanges(account, &(*changes)->prev);
-    free(*changes);
-    *changes = NULL;
 }
 
 static void evmRevertLogChanges(logChanges_t **changes) {
-    if (*changes == NULL) {
-        return;
+    while (*changes != NULL) {
+        logChanges_t *change = *changes;
+        *changes = change->prev;
+        free(change);
     }
-    evmRevertLogChanges(&(*changes)->prev);
-
-    free(*changes);
-    *changes = NULL;
 }
 
 static void evmRevert(stateChanges_t **changes) {
-    if (*changes == NULL) {
-        return;
+    while (*changes != NULL) {
+        stateChanges_t *accountChanges = *changes;
+        account_t *account = getAccount(accountChanges->account);
+        evmRevertCodeChanges(account, &accountChanges->codeChanges);
+        evmRevertStorageChanges(account, &accountChanges->storageChanges);
+        evmRevertLogChanges(&accountChanges->logChanges);
+        *changes = accountChanges->next;
+        free(accountChanges);
     }
-    account_t *account = getAccount((*changes)->account);
-    evmRevertCodeChanges(account, &(*changes)->codeChanges);
-    evmRevertStorageChanges(account, &(*changes)->storageChanges);
-    evmRevertLogChanges(&(*changes)->logChanges);
-
-    evmRevert(&(*changes)->next);
-    free(*changes);
-    *changes = NULL;
 }
 
-static result_t _evmCall(context_t *callContext) {
+static void enterFrame(context_t *callContext) {
     callContext->top = callContext->bottom;
     callContext->returnData.size = 0;
 
-    memory_init(&callContext->memory, 0);
+    // each frame of the callstack owns its memory buffer and keeps it for the next call at its depth
+    // so the returnData of the previous call, which points into it, stays valid until the caller calls again
+    callContext->memory.num_uint8s = 0;
 
-    uint64_t startGas = callContext->gas;
+    callContext->startGas = callContext->gas;
 
-    callstack.next += 1;
-    result_t result = doCall(callContext);
-    callstack.next -= 1;
+    evm->callstack.next += 1;
+}
+
+static void leaveFrame(context_t *callContext, result_t *result) {
+    evm->callstack.next -= 1;
 
-    result.gasRemaining = callContext->gas;
+    result->gasRemaining = callContext->gas;
     if (SHOW_CALLS) {
         INDENT;
-        fprintf(stderr, "gasUsed: %" PRIu64, startGas - callContext->gas);
-        if (startGas < 600000000) {
-            fprintf(stderr, " / %" PRIu64, startGas);
+        fprintf(stderr, "gasUsed: %" PRIu64, callContext->startGas - callContext->gas);
+        if (callContext->startGas < 600000000) {
+            fprintf(stderr, " / %" PRIu64, callContext->startGas);
         }
         fputc('\n', stderr);
     }
 
-    if (zero256(&result.status)) {
-        evmRevert(&result.stateChanges);
+    if (zero256(&result->status)) {
+        evmRevert(&result->stateChanges);
     }
+}
 
-    return result;
+static result_t _evmCall(context_t *callContext) {
+    enterFrame(callContext);
+    return doCall(callContext);
 }
 
-static result_t evmDelegateCall(uint64_t gas, account_t *codeSource, data_t input) {
-    context_t *parent = callstack.next - 1;
-    context_t *callContext = callstack.next;
+static void failCall(result_t *failure, uint64_t gasRemaining) {
+    failure->gasRemaining = gasRemaining;
+    failure->stateChanges = NULL;
+    clear256(&failure->status);
+    failure->returnData.size = 0;
+}
+
+// the deepest frame fails its calls, keeping the gas
+static bool callstackFull(uint64_t gas, result_t *failure) {
+    if (evm->callstack.next <= evm->callstack.bottom + MAX_CALL_DEPTH) {
+        return false;
+    }
+    fputs("Call depth limit reached\n", stderr);
+    failCall(failure, gas);
+    return true;
+}
+
+static context_t *prepareDelegateCall(uint64_t gas, account_t *codeSource, data_t input, result_t *failure) {
+    if (callstackFull(gas, failure)) {
+        return NULL;
+    }
+    context_t *parent = evm->callstack.next - 1;
+    context_t *callContext = evm->callstack.next;
 
     callContext->gas = gas;
     callContext->readonly = parent->readonly;
@@ -1843,12 +2734,17 @@ static result_t evmDelegateCall(uint64_t gas, account_t *codeSource, data_t inpu
     AddressCopy(callContext->caller, parent->caller);
     callContext->account = parent->account;
     callContext->code = codeSource->code;
+    callContext->codeAccount = codeSource;
+    callContext->jumpdests = NULL;
     callContext->callData = input;
-    return _evmCall(callContext);
+    return callContext;
 }
 
-static result_t evmStaticCall(address_t from, uint64_t gas, address_t to, data_t input) {
-    context_t *callContext = callstack.next;
+static context_t *prepareStaticCall(address_t from, uint64_t gas, address_t to, data_t input, result_t *failure) {
+    if (callstackFull(gas, failure)) {
+        return NULL;
+    }
+    context_t *callContext = evm->callstack.next;
     callContext->gas = gas;
 
     callContext->readonly = true;
@@ -1856,30 +2752,29 @@ static result_t evmStaticCall(address_t from, uint64_t gas, address_t to, data_t
     AddressCopy(callContext->caller, from);
     callContext->account = getAccount(to);
     callContext->code = callContext->account->code;
+    callContext->codeAccount = callContext->account;
+    callContext->jumpdests = NULL;
     callContext->callData = input;
-
-    return _evmCall(callContext);
+    return callContext;
 }
 
-static result_t evmCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input) {
+static context_t *prepareCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input, result_t *failure) {
+    if (callstackFull(gas, failure)) {
+        return NULL;
+    }
     account_t *fromAccount = getAccount(from);
     if (!BalanceSub(fromAccount->balance, value)) {
         fprintf(stderr, "Insufficient balance [0x%08x%08x%08x] for call (need [0x%08x%08x%08x])\n",
                 fromAccount->balance[0], fromAccount->balance[1], fromAccount->balance[2],
                 value[0], value[1], value[2]
         );
-
-        result_t result;
-        result.gasRemaining = 0;
-        result.stateChanges = NULL;
-        clear256(&result.status);
-        result.returnData.size = 0;
-        return result;
+        failCall(failure, 0);
+        return NULL;
     }
 
-    context_t *callContext = callstack.next;
+    context_t *callContext = evm->callstack.next;
     callContext->gas = gas;
-    if (callstack.next == callstack.bottom) {
+    if (evm->callstack.next == evm->callstack.bottom) {
         callContext->readonly = false;
     } else {
         callContext->readonly = callContext[-1].readonly;
@@ -1890,26 +2785,30 @@ static result_t evmCall(address_t from, uint64_t gas, address_t to, val_t value,
     callContext->account = getAccount(to);
     BalanceAdd(callContext->account->balance, value);
     callContext->code = callContext->account->code;
+    callContext->codeAccount = callContext->account;
+    callContext->jumpdests = NULL;
     callContext->callData = input;
+    return callContext;
+}
 
-    return _evmCall(callContext);
+static result_t evmCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input) {
+    result_t result;
+    context_t *callContext = prepareCall(from, gas, to, value, input, &result);
+    return callContext ? _evmCall(callContext) : result;
 }
 
-static result_t _evmConstruct(address_t from, account_t *to, uint64_t gas, val_t value, data_t input) {
-    context_t *callContext = callstack.next;
+static context_t *prepareConstruct(address_t from, account_t *to, uint64_t gas, val_t value, data_t input, result_t *failure) {
+    context_t *callContext = evm->callstack.next;
     callContext->gas = gas;
-    if (callstack.next == callstack.bottom) {
+    if (evm->callstack.next == evm->callstack.bottom) {
         callContext->gas -= G_TXCREATE + G_TX;
         callContext->gas -= calldataGas(&input);
         callContext->gas -= initcodeGas(&input);
         if (gas < callContext->gas) {
             // underflow indicates insufficient initial gas
             fprintf(stderr, "Out of gas while initializing initcode (have %" PRIu64 " need %" PRIu64 ")\n", gas, gas - callContext->gas);
-            result_t result;
-            result.gasRemaining = 0;
-            clear256(&result.status);
-            result.returnData.size = 0;
-            return result;
+            failCall(failure, 0);
+            return NULL;
         }
     }
     callContext->readonly = false;
@@ -1917,70 +2816,92 @@ static result_t _evmConstruct(address_t from, account_t *to, uint64_t gas, val_t
     BalanceCopy(callContext->callValue, value);
     AddressCopy(callContext->caller, from);
     callContext->account = to;
-    callContext->account->warm = evmIteration;
+    callContext->account->warm = evm->evmIteration;
     BalanceAdd(callContext->account->balance, value);
     callContext->code = input;
+    callContext->codeAccount = NULL;
+    callContext->jumpdests = NULL;
     callContext->callData.size = 0;
+    return callContext;
+}
 
-    result_t result = _evmCall(callContext);
-
-    if (!zero256(&result.status)) {
-        uint64_t codeGas = result.returnData.size * G_PER_CODEBYTE;
+// stores the code returned by the initcode of the frame, failing when the gas cannot pay for it
+static void depositCode(context_t *callContext, result_t *result) {
+    if (!zero256(&result->status)) {
+        uint64_t codeGas = result->returnData.size * G_PER_CODEBYTE;
         if (codeGas > callContext->gas) {
             fprintf(stderr, "Insufficient gas to insert code, codeGas %" PRIu64 " > gas %" PRIu64 "\n", codeGas, callContext->gas);
-            LOWER(LOWER(result.status)) = 0;
-            result.gasRemaining = 0;
+            LOWER(LOWER(result->status)) = 0;
+            result->gasRemaining = 0;
         } else {
-            result.gasRemaining -= codeGas;
-            AddressToUint256(&result.status, &callContext->account->address);
+            result->gasRemaining -= codeGas;
+            AddressToUint256(&result->status, &callContext->account->address);
             codeChanges_t *change = malloc(sizeof(codeChanges_t));
             change->before = callContext->account->code;
-            callContext->account->code.size = result.returnData.size;
-            callContext->account->code.content = malloc(result.returnData.size);
-            memcpy(callContext->account->code.content, result.returnData.content, result.returnData.size);
-            change->after = callContext->account->code;
-            stateChanges_t *changes = getCurrentAccountStateChanges(&result, callContext);
+            data_t code;
+            code.size = result->returnData.size;
+            code.content = malloc(result->returnData.size);
+            memcpy(code.content, result->returnData.content, result->returnData.size);
+            setAccountCode(callContext->account, code);
+            change->after = code;
+            stateChanges_t *changes = getCurrentAccountStateChanges(result, callContext);
             change->prev = changes->codeChanges;
             changes->codeChanges = change;
         }
     }
-    if (zero256(&result.status)) {
-        evmRevert(&result.stateChanges);
+    if (zero256(&result->status)) {
+        evmRevert(&result->stateChanges);
+    }
+}
+
+static result_t _evmConstruct(address_t from, account_t *to, uint64_t gas, val_t value, data_t input) {
+    result_t result;
+    context_t *callContext = prepareConstruct(from, to, gas, value, input, &result);
+    if (callContext == NULL) {
+        return result;
     }
-    if (callstack.next == callstack.bottom) {
+    result = _evmCall(callContext);
+    depositCode(callContext, &result);
+    if (evm->callstack.next == evm->callstack.bottom) {
         // Apply refund
         uint64_t gasUsed = gas - result.gasRemaining;
         uint64_t refund = gasUsed / MAX_REFUND_DIVISOR;
-        if (refund > refundCounter) {
-            refund = refundCounter;
+        if (refund > evm->refundCounter) {
+            refund = evm->refundCounter;
         }
         result.gasRemaining += refund;
-        refundCounter = 0;
+        evm->refundCounter = 0;
     }
 
     return result;
 }
 
-result_t evmConstruct(address_t from, address_t to, uint64_t gas, val_t value, data_t input) {
+result_t evmConstruct_r(evm_t *instance, address_t from, address_t to, uint64_t gas, val_t value, data_t input) {
+    evm = instance;
     account_t *created = getAccount(to);
     created->nonce = 1;
     return _evmConstruct(from, created, gas, value, input);
 }
 
-result_t txCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input, const accessList_t *accessList) {
+result_t evmConstruct(address_t from, address_t to, uint64_t gas, val_t value, data_t input) {
+    return evmConstruct_r(&defaultEvm, from, to, gas, value, input);
+}
+
+result_t txCall_r(evm_t *instance, address_t from, uint64_t gas, address_t to, val_t value, data_t input, const accessList_t *accessList) {
+    evm = instance;
     account_t *fromAccount = getAccount(from);
-    fromAccount->warm = evmIteration;
-    account_t *coinbaseAccount = getAccount(coinbase);
-    coinbaseAccount->warm = evmIteration;
+    fromAccount->warm = evm->evmIteration;
+    account_t *coinbaseAccount = getAccount(evm->coinbase);
+    coinbaseAccount->warm = evm->evmIteration;
     uint64_t intrinsicGas = G_TX + calldataGas(&input);
     while (accessList) {
         intrinsicGas += G_ACCESSLIST_ACCOUNT;
         account_t *account = getAccount(accessList->address);
-        account->warm = evmIteration;
+        account->warm = evm->evmIteration;
         accessListStorage_t *accessListStorage = accessList->storage;
         while (accessListStorage) {
             intrinsicGas += G_ACCESSLIST_STORAGE;
-            getAccountStorage(account, &accessListStorage->key)->warm = evmIteration;
+            getAccountStorage(account, &accessListStorage->key)->warm = evm->evmIteration;
             accessListStorage = accessListStorage->prev;
         }
         accessList = accessList->prev;
@@ -1989,71 +2910,498 @@ result_t txCall(address_t from, uint64_t gas, address_t to, val_t value, data_t
         fprintf(stderr, "Insufficient intrinsic gas %" PRIu64 " (need %" PRIu64 ")\n", gas, intrinsicGas);
         result_t result;
         result.gasRemaining = 0;
+        result.stateChanges = NULL;
         clear256(&result.status);
         result.returnData.size = 0;
-        evmIteration++;
+        evm->evmIteration++;
         return result;
     }
     uint64_t originalGas = gas;
     gas -= intrinsicGas;
     account_t *toAccount = getAccount(to);
-    toAccount->warm = evmIteration;
+    toAccount->warm = evm->evmIteration;
     result_t result = evmCall(from, gas, to, value, input);
 
     // Apply refund
     uint64_t gasUsed = originalGas - result.gasRemaining;
     uint64_t refund = gasUsed / MAX_REFUND_DIVISOR;
-    if (refund > refundCounter) {
-        refund = refundCounter;
+    if (refund > evm->refundCounter) {
+        refund = evm->refundCounter;
     }
     result.gasRemaining += refund;
-    refundCounter = 0;
+    evm->refundCounter = 0;
 
-    evmIteration++;
+    evm->evmIteration++;
     fromAccount->nonce++;
     return result;
 }
 
-result_t evmCreate(account_t *fromAccount, uint64_t gas, val_t value, data_t input) {
+result_t txCall(address_t from, uint64_t gas, address_t to, val_t value, data_t input, const accessList_t *accessList) {
+    return txCall_r(&defaultEvm, from, gas, to, value, input, accessList);
+}
+
+static context_t *prepareCreate(account_t *fromAccount, uint64_t gas, val_t value, data_t input, result_t *failure) {
+    if (callstackFull(gas, failure)) {
+        return NULL;
+    }
     if (!BalanceSub(fromAccount->balance, value)) {
         fprintf(stderr, "Insufficient balance [0x%08x%08x%08x] for create (need [0x%08x%08x%08x])\n",
                 fromAccount->balance[0], fromAccount->balance[1], fromAccount->balance[2],
                 value[0], value[1], value[2]
         );
+        failCall(failure, gas);
+        return NULL;
+    }
+
+    return prepareConstruct(fromAccount->address, createNewAccount(fromAccount), gas, value, input, failure);
+}
 
+static result_t evmCreate(account_t *fromAccount, uint64_t gas, val_t value, data_t input) {
+    if (!BalanceSub(fromAccount->balance, value)) {
+        fprintf(stderr, "Insufficient balance [0x%08x%08x%08x] for create (need [0x%08x%08x%08x])\n",
+                fromAccount->balance[0], fromAccount->balance[1], fromAccount->balance[2],
+                value[0], value[1], value[2]
+        );
         result_t result;
-        result.gasRemaining = gas;
-        result.stateChanges = NULL;
-        clear256(&result.status);
-        result.returnData.size = 0;
+        failCall(&result, gas);
         return result;
     }
-
     return _evmConstruct(fromAccount->address, createNewAccount(fromAccount), gas, value, input);
 }
 
-static result_t evmCreate2(account_t *fromAccount, uint64_t gas, val_t value, data_t input, const uint256_t *salt) {
+static context_t *prepareCreate2(account_t *fromAccount, uint64_t gas, val_t value, data_t input, const uint256_t *salt, result_t *failure) {
+    if (callstackFull(gas, failure)) {
+        return NULL;
+    }
     if (!BalanceSub(fromAccount->balance, value)) {
         fprintf(stderr, "Insufficient balance [0x%08x%08x%08x] for create2 (need [0x%08x%08x%08x])\n",
                 fromAccount->balance[0], fromAccount->balance[1], fromAccount->balance[2],
                 value[0], value[1], value[2]
         );
-        result_t result;
-        result.gasRemaining = gas;
-        result.stateChanges = NULL;
-        clear256(&result.status);
-        result.returnData.size = 0;
-        return result;
+        failCall(failure, gas);
+        return NULL;
     }
-    return _evmConstruct(fromAccount->address, createNewAccount2(fromAccount, salt, &input), gas, value, input);
+    return prepareConstruct(fromAccount->address, createNewAccount2(fromAccount, salt, &input), gas, value, input, failure);
 }
 
-result_t txCreate(address_t from, uint64_t gas, val_t value, data_t input) {
+result_t txCreate_r(evm_t *instance, address_t from, uint64_t gas, val_t value, data_t input) {
+    evm = instance;
     account_t *fromAccount = getAccount(from);
-    fromAccount->warm = evmIteration;
-    account_t *coinbaseAccount = getAccount(coinbase);
-    coinbaseAccount->warm = evmIteration;
+    fromAccount->warm = evm->evmIteration;
+    account_t *coinbaseAccount = getAccount(evm->coinbase);
+    coinbaseAccount->warm = evm->evmIteration;
     result_t result = evmCreate(fromAccount, gas, value, input);
-    evmIteration++;
+    evm->evmIteration++;
     return result;
 }
+
+result_t txCreate(address_t from, uint64_t gas, val_t value, data_t input) {
+    return txCreate_r(&defaultEvm, from, gas, value, input);
+}
+
+void txSenders(const txSignature_t *signatures, size_t count, address_t *senders, bool *valid, uint16_t threads) {
+    txRecoverSenders(signatures, count, EVM_CHAIN_ID, senders, valid, threads);
+}
+
+static uint64_t intrinsicGas(const blockTransaction_t *tx) {
+    uint64_t gas = G_TX + calldataGas(&tx->input);
+    if (tx->create) {
+        return gas + G_TXCREATE + initcodeGas(&tx->input);
+    }
+    for (const accessList_t *accessList = tx->accessList; accessList; accessList = accessList->prev) {
+        gas += G_ACCESSLIST_ACCOUNT;
+        for (const accessListStorage_t *storage = accessList->storage; storage; storage = storage->prev) {
+            gas += G_ACCESSLIST_STORAGE;
+        }
+    }
+    return gas;
+}
+
+// whether the transaction fits after the cumulative gas and its sender can pay for it
+static bool checkBlockTransaction(const blockHeader_t *header, uint32_t i, const blockTransaction_t *tx, uint64_t cumulativeGasUsed) {
+    if (tx->maxFeePerGas < header->baseFee) {
+        fprintf(stderr, "Skipping transaction %u: max fee %" PRIu64 " below base fee %" PRIu64 "\n", i, tx->maxFeePerGas, header->baseFee);
+        return false;
+    }
+    if (tx->gas > header->gasLimit - cumulativeGasUsed) {
+        fprintf(stderr, "Skipping transaction %u: gas %" PRIu64 " exceeds remaining block gas %" PRIu64 "\n", i, tx->gas, header->gasLimit - cumulativeGasUsed);
+        return false;
+    }
+    if (tx->gas < intrinsicGas(tx)) {
+        fprintf(stderr, "Skipping transaction %u: insufficient intrinsic gas %" PRIu64 " (need %" PRIu64 ")\n", i, tx->gas, intrinsicGas(tx));
+        return false;
+    }
+    account_t *fromAccount = getAccount(tx->from);
+    val_t value, maxFee, balance;
+    BalanceCopy(value, tx->value);
+    BalanceCopy(balance, fromAccount->balance);
+    if (!BalanceProduct(maxFee, tx->gas, tx->maxFeePerGas) || !BalanceSub(balance, maxFee) || !BalanceSub(balance, value)) {
+        fprintf(stderr, "Skipping transaction %u: insufficient balance for gas and value\n", i);
+        return false;
+    }
+    return true;
+}
+
+static uint64_t priorityFeeOf(const blockHeader_t *header, const blockTransaction_t *tx) {
+    uint64_t priorityFee = tx->maxFeePerGas - header->baseFee;
+    if (priorityFee > tx->maxPriorityFeePerGas) {
+        priorityFee = tx->maxPriorityFeePerGas;
+    }
+    return priorityFee;
+}
+
+// executes a checked transaction, charging its sender for the gas used; the coinbase is paid separately
+// fails without executing when the sender cannot pay for its gas
+static bool chargeBlockTransaction(evm_t *instance, const blockHeader_t *header, const blockTransaction_t *tx, uint64_t priorityFee, result_t *result) {
+    account_t *fromAccount = getAccount(tx->from);
+    val_t value, fee;
+    BalanceCopy(value, tx->value);
+    uint64_t gasPrice = header->baseFee + priorityFee;
+    if (!BalanceProduct(fee, tx->gas, gasPrice) || !BalanceSub(fromAccount->balance, fee)) {
+        return false;
+    }
+    instance->gasPrice = gasPrice;
+
+    *result = tx->create
+        ? txCreate_r(instance, tx->from, tx->gas, value, tx->input)
+        : txCall_r(instance, tx->from, tx->gas, tx->to, value, tx->input, tx->accessList);
+
+    // refund the unused gas, which is less than was charged
+    bool refundFits = BalanceProduct(fee, result->gasRemaining, gasPrice);
+    assert(refundFits);
+    BalanceAdd(fromAccount->balance, fee);
+    instance->gasPrice = 0;
+    return true;
+}
+
+// pays the priority fee, burning the base fee, and fills the receipt
+static void includeBlockTransaction(const blockHeader_t *header, const blockTransaction_t *tx, const result_t *result, uint64_t priorityFee, receipt_t *receipt, uint64_t *cumulativeGasUsed) {
+    uint64_t gasUsed = tx->gas - result->gasRemaining;
+    val_t fee;
+    // less than the sender was charged
+    bool feeFits = BalanceProduct(fee, gasUsed, priorityFee);
+    assert(feeFits);
+    BalanceAdd(getAccount(header->coinbase)->balance, fee);
+
+    *cumulativeGasUsed += gasUsed;
+    receipt->included = true;
+    copy256(&receipt->status, &result->status);
+    receipt->gasUsed = gasUsed;
+    receipt->cumulativeGasUsed = *cumulativeGasUsed;
+    receipt->stateChanges = result->stateChanges;
+}
+
+static void skipReceipt(receipt_t *receipt, uint64_t cumulativeGasUsed) {
+    receipt->included = false;
+    clear256(&receipt->status);
+    receipt->gasUsed = 0;
+    receipt->cumulativeGasUsed = cumulativeGasUsed;
+    receipt->stateChanges = NULL;
+}
+
+static void executeBlockTransaction(evm_t *instance, const blockHeader_t *header, uint32_t i, const blockTransaction_t *tx, receipt_t *receipt, uint64_t *cumulativeGasUsed) {
+    skipReceipt(receipt, *cumulativeGasUsed);
+    if (!checkBlockTransaction(header, i, tx, *cumulativeGasUsed)) {
+        return;
+    }
+    uint64_t priorityFee = priorityFeeOf(header, tx);
+    result_t result;
+    if (!chargeBlockTransaction(instance, header, tx, priorityFee, &result)) {
+        return;
+    }
+    includeBlockTransaction(header, tx, &result, priorityFee, receipt, cumulativeGasUsed);
+}
+
+uint64_t evmExecuteBlock_r(evm_t *instance, const blockHeader_t *header, const blockTransaction_t *transactions, uint32_t count, receipt_t *receipts) {
+    evm = instance;
+    evmSetBlock_r(instance, header);
+    uint64_t cumulativeGasUsed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        executeBlockTransaction(instance, header, i, transactions + i, receipts + i, &cumulativeGasUsed);
+    }
+    return cumulativeGasUsed;
+}
+
+uint64_t evmExecuteBlock(const blockHeader_t *header, const blockTransaction_t *transactions, uint32_t count, receipt_t *receipts) {
+    return evmExecuteBlock_r(&defaultEvm, header, transactions, count, receipts);
+}
+
+// the precompiles and then the accounts
+static account_t *accountAt(evm_t *instance, uint32_t index) {
+    return index < 256 ? instance->precompiles + index : instance->accounts + index - 256;
+}
+
+// copies the world state of src into a fresh instance, sharing the code
+static void copyWorldState(evm_t *dst, const evm_t *src) {
+    uint32_t count = src->emptyAccount - src->accounts;
+    uint32_t dstCount = dst->emptyAccount - dst->accounts;
+    memcpy(dst->precompiles, src->precompiles, sizeof(dst->precompiles));
+    memcpy(dst->accounts, src->accounts, count * sizeof(account_t));
+    if (dstCount > count) {
+        bzero(dst->accounts + count, (dstCount - count) * sizeof(account_t));
+    }
+    dst->emptyAccount = dst->accounts + count;
+    rebuildAccountTable(dst);
+    for (uint32_t i = 0; i < 256 + count; i++) {
+        account_t *account = accountAt(dst, i);
+        storageTable_t *table = &account->storage;
+        if (table->capacity) {
+            const storage_t *slots = table->slots;
+            const uint32_t *index = table->index;
+            table->slots = malloc(table->capacity * sizeof(storage_t));
+            memcpy(table->slots, slots, table->count * sizeof(storage_t));
+            table->index = malloc(table->capacity * 2 * sizeof(uint32_t));
+            memcpy(table->index, index, table->capacity * 2 * sizeof(uint32_t));
+        }
+        account->tstorage = NULL;
+        account->epoch = dst->epoch;
+    }
+    dst->provider = src->provider;
+    dst->blockNumber = src->blockNumber;
+    dst->timestamp = src->timestamp;
+    dst->coinbase = src->coinbase;
+    dst->gasLimit = src->gasLimit;
+    dst->baseFee = src->baseFee;
+    copy256(&dst->prevRandao, &src->prevRandao);
+    dst->logIndex = src->logIndex;
+    // later than every warm iteration copied
+    dst->evmIteration = src->evmIteration + 1;
+}
+
+// room for the native frames of the deepest callstack; pages are only committed as they are touched
+#define SIMULATION_STACK_SIZE (64 << 20)
+
+VECTOR(stateRequest, stateRequests);
+
+typedef struct simulator {
+    ucontext_t host;
+    // answered requests, kept for the later transactions
+    stateRequests_t answers;
+    // open-addressed index of the answers by address and key, holding 1 + position and 0 where empty
+    uint32_t *answerTable;
+    uint32_t answerTableSize;
+    // the requests of the suspended transactions, without repeats; at most one per simulation
+    stateRequests_t requests;
+} simulator_t;
+
+typedef struct simulation {
+    ucontext_t context;
+    void *stack;
+    // a copy of the state, restored after each transaction
+    evm_t *worker;
+    stateProvider_t provider;
+    simulator_t *simulator;
+    const blockTransaction_t *tx;
+    result_t *result;
+    bool running;
+} simulation_t;
+
+static __thread simulation_t *launching;
+
+static bool stateRequestMatches(const stateRequest_t *request, const address_t *address, const uint256_t *key) {
+    return request->slot == (key != NULL) && AddressEqual(&request->address, address) && (key == NULL || equal256(&request->key, key));
+}
+
+static uint32_t stateRequestHash(const address_t *address, const uint256_t *key) {
+    uint64_t hash;
+    memcpy(&hash, address->address + 12, sizeof(hash));
+    if (key != NULL) {
+        hash ^= (LOWER(LOWER_P(key)) + 1) * 0xff51afd7ed558ccdull;
+    }
+    return (hash * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+static int64_t findStateRequest(const stateRequests_t *requests, const address_t *address, const uint256_t *key) {
+    for (size_t i = 0; i < requests->num_stateRequests; i++) {
+        if (stateRequestMatches(requests->stateRequests + i, address, key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// the index entry of the answer, which is 0 if it has not been fetched
+static uint32_t *findAnswer(const simulator_t *simulator, const address_t *address, const uint256_t *key) {
+    uint32_t mask = simulator->answerTableSize - 1;
+    for (uint32_t i = stateRequestHash(address, key) & mask;; i = (i + 1) & mask) {
+        uint32_t *position = simulator->answerTable + i;
+        if (*position == 0 || stateRequestMatches(simulator->answers.stateRequests + *position - 1, address, key)) {
+            return position;
+        }
+    }
+}
+
+// keeps the answer index at most half full
+static void addAnswer(simulator_t *simulator, stateRequest_t answer) {
+    stateRequests_append(&simulator->answers, answer);
+    uint32_t count = simulator->answers.num_stateRequests;
+    if (count * 2 > simulator->answerTableSize) {
+        free(simulator->answerTable);
+        simulator->answerTableSize *= 2;
+        simulator->answerTable = calloc(simulator->answerTableSize, sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++) {
+            const stateRequest_t *indexed = simulator->answers.stateRequests + i;
+            *findAnswer(simulator, &indexed->address, indexed->slot ? &indexed->key : NULL) = i + 1;
+        }
+    } else {
+        *findAnswer(simulator, &answer.address, answer.slot ? &answer.key : NULL) = count;
+    }
+}
+
+// returns the answer, suspending the transaction until it is fetched
+static const stateRequest_t *awaitState(simulation_t *simulation, const address_t *address, const uint256_t *key) {
+    simulator_t *simulator = simulation->simulator;
+    uint32_t answer = *findAnswer(simulator, address, key);
+    if (answer == 0) {
+        if (findStateRequest(&simulator->requests, address, key) < 0) {
+            stateRequest_t request;
+            bzero(&request, sizeof(request));
+            request.address = *address;
+            request.slot = key != NULL;
+            if (key != NULL) {
+                copy256(&request.key, key);
+            }
+            stateRequests_append(&simulator->requests, request);
+        }
+        swapcontext(&simulation->context, &simulator->host);
+        // other transactions ran meanwhile
+        evm = simulation->worker;
+        answer = *findAnswer(simulator, address, key);
+    }
+    return simulator->answers.stateRequests + answer - 1;
+}
+
+static void awaitAccount(void *context, const address_t *address, val_t balance, uint64_t *nonce, data_t *code) {
+    const stateRequest_t *answer = awaitState(context, address, NULL);
+    BalanceCopy(balance, answer->balance);
+    *nonce = answer->nonce;
+    code->size = answer->code.size;
+    code->content = NULL;
+    if (code->size) {
+        code->content = malloc(code->size);
+        memcpy(code->content, answer->code.content, code->size);
+    }
+}
+
+static void awaitStorage(void *context, const address_t *address, const uint256_t *key, uint256_t *value) {
+    copy256(value, &awaitState(context, address, key)->value);
+}
+
+// the entry of each transaction coroutine
+static void runSimulation() {
+    simulation_t *simulation = launching;
+    const blockTransaction_t *tx = simulation->tx;
+    evm_t *worker = simulation->worker;
+    val_t value;
+    BalanceCopy(value, tx->value);
+    result_t result = tx->create
+        ? txCreate_r(worker, tx->from, tx->gas, value, tx->input)
+        : txCall_r(worker, tx->from, tx->gas, tx->to, value, tx->input, tx->accessList);
+    // the restore frees the memory and code they reference
+    uint8_t *returnData = malloc(result.returnData.size);
+    memcpy(returnData, result.returnData.content, result.returnData.size);
+    result.returnData.content = returnData;
+    for (stateChanges_t *changes = result.stateChanges; changes != NULL; changes = changes->next) {
+        while (changes->codeChanges != NULL) {
+            codeChanges_t *prev = changes->codeChanges->prev;
+            free(changes->codeChanges);
+            changes->codeChanges = prev;
+        }
+    }
+    *simulation->result = result;
+    evmRestore_r(worker, 0);
+    simulation->running = false;
+    swapcontext(&simulation->context, &simulation->simulator->host);
+}
+
+// runs the transaction until it finishes or suspends
+static void launchSimulation(simulation_t *simulation, const blockTransaction_t *tx, result_t *result) {
+    simulation->tx = tx;
+    simulation->result = result;
+    simulation->running = true;
+    getcontext(&simulation->context);
+    simulation->context.uc_stack.ss_sp = simulation->stack;
+    simulation->context.uc_stack.ss_size = SIMULATION_STACK_SIZE;
+    simulation->context.uc_link = NULL;
+    makecontext(&simulation->context, runSimulation, 0);
+    launching = simulation;
+    swapcontext(&simulation->simulator->host, &simulation->context);
+}
+
+void evmSimulate_r(evm_t *instance, const blockTransaction_t *transactions, uint32_t count, result_t *results, uint16_t width, batchFetch_t fetch, void *context) {
+    if (width == 0) {
+        width = 1;
+    }
+    if (width > count) {
+        width = count;
+    }
+    simulator_t simulator;
+    stateRequests_init(&simulator.answers, 16);
+    simulator.answerTableSize = 64;
+    simulator.answerTable = calloc(simulator.answerTableSize, sizeof(uint32_t));
+    stateRequests_init(&simulator.requests, 16);
+    simulation_t *simulations = calloc(width, sizeof(simulation_t));
+    for (uint16_t i = 0; i < width; i++) {
+        simulation_t *simulation = simulations + i;
+        simulation->simulator = &simulator;
+        simulation->worker = evmNew();
+        copyWorldState(simulation->worker, instance);
+        simulation->provider.context = simulation;
+        simulation->provider.account = awaitAccount;
+        simulation->provider.storage = awaitStorage;
+        simulation->worker->provider = &simulation->provider;
+        evmSnapshot_r(simulation->worker);
+        simulation->stack = mmap(NULL, SIMULATION_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (simulation->stack == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+    }
+    uint32_t next = 0;
+    uint16_t running;
+    do {
+        running = 0;
+        for (uint16_t i = 0; i < width; i++) {
+            simulation_t *simulation = simulations + i;
+            if (simulation->running) {
+                swapcontext(&simulator.host, &simulation->context);
+            }
+            while (!simulation->running && next < count) {
+                launchSimulation(simulation, transactions + next, results + next);
+                next++;
+            }
+            running += simulation->running;
+        }
+        // every running transaction is suspended on one of these
+        if (simulator.requests.num_stateRequests) {
+            fetch(context, simulator.requests.stateRequests, simulator.requests.num_stateRequests);
+            for (size_t i = 0; i < simulator.requests.num_stateRequests; i++) {
+                addAnswer(&simulator, simulator.requests.stateRequests[i]);
+            }
+            simulator.requests.num_stateRequests = 0;
+        }
+    } while (running);
+
+    for (uint16_t i = 0; i < width; i++) {
+        evm_t *worker = simulations[i].worker;
+        evmRelease_r(worker, 0);
+        // the remaining code belongs to the base
+        for (uint32_t j = 0; j < 256 + (worker->emptyAccount - worker->accounts); j++) {
+            accountAt(worker, j)->code.content = NULL;
+        }
+        evmFree(worker);
+        munmap(simulations[i].stack, SIMULATION_STACK_SIZE);
+    }
+    free(simulations);
+    for (size_t i = 0; i < simulator.answers.num_stateRequests; i++) {
+        free(simulator.answers.stateRequests[i].code.content);
+    }
+    stateRequests_destroy(&simulator.answers);
+    free(simulator.answerTable);
+    stateRequests_destroy(&simulator.requests);
+    evm = instance;
+}
+
+void evmSimulate(const blockTransaction_t *transactions, uint32_t count, result_t *results, uint16_t width, batchFetch_t fetch, void *context) {
+    evmSimulate_r(&defaultEvm, transactions, count, results, width, fetch, context);
+}
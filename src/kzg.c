@@ -0,0 +1,188 @@
+#include "kzg.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "hex.h"
+
+#define VERSIONED_HASH_VERSION_KZG 0x01
+
+static const uint8_t BLS_MODULUS[32] = {
+    0x73, 0xed, 0xa7, 0x53, 0x29, 0x9d, 0x7d, 0x48, 0x33, 0x39, 0xd8, 0x08, 0x09, 0xa1, 0xd8, 0x05,
+    0x53, 0xbd, 0xa4, 0x02, 0xff, 0xfe, 0x5b, 0xfe, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+};
+
+const uint8_t kzgPointEvaluationReturn[64] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+    0x73, 0xed, 0xa7, 0x53, 0x29, 0x9d, 0x7d, 0x48, 0x33, 0x39, 0xd8, 0x08, 0x09, 0xa1, 0xd8, 0x05,
+    0x53, 0xbd, 0xa4, 0x02, 0xff, 0xfe, 0x5b, 0xfe, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x01,
+};
+
+// verification only pairs against the G2 generator and [tau]G2, so only those are kept, with their lines prepared
+static g2Prepared_t g2GeneratorPrepared;
+static g2Prepared_t tauG2Prepared;
+static bool loaded = false;
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+// updated atomically by concurrent verifications
+static kzgStats_t stats;
+
+kzgStats_t kzgStats() {
+    kzgStats_t result;
+    result.verifications = __atomic_load_n(&stats.verifications, __ATOMIC_RELAXED);
+    result.verifyNanos = __atomic_load_n(&stats.verifyNanos, __ATOMIC_RELAXED);
+    return result;
+}
+
+void kzgResetStats() {
+    __atomic_store_n(&stats.verifications, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats.verifyNanos, 0, __ATOMIC_RELAXED);
+}
+
+bool kzgTrustedSetupLoaded() {
+    return __atomic_load_n(&loaded, __ATOMIC_ACQUIRE);
+}
+
+// reads the next line of hex into bytes, failing unless it is exactly size bytes
+static bool readHexLine(FILE *file, uint8_t *bytes, size_t size) {
+    int ch;
+    do {
+        ch = fgetc(file);
+    } while (ch == '\n' || ch == '\r' || ch == ' ');
+    if (ch == '0') {
+        ch = fgetc(file);
+        if (ch != 'x') {
+            ungetc(ch, file);
+            ch = '0';
+        } else {
+            ch = fgetc(file);
+        }
+    }
+    for (size_t i = 0; i < size; i++) {
+        char hex[2];
+        hex[0] = ch;
+        hex[1] = fgetc(file);
+        if (!isHex(hex[0]) || !isHex(hex[1])) {
+            return false;
+        }
+        bytes[i] = hexString16ToUint8(hex);
+        ch = fgetc(file);
+    }
+    return ch == '\n' || ch == '\r' || ch == EOF;
+}
+
+bool kzgLoadTrustedSetup(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    unsigned int g1Count, g2Count;
+    // the G1 points are skipped, so an excerpt of the G2 points may omit them
+    if (fscanf(file, "%u %u", &g1Count, &g2Count) != 2 || g2Count < 2) {
+        fprintf(stderr, "%s: expected G1 and G2 point counts\n", path);
+        fclose(file);
+        return false;
+    }
+    uint8_t compressed[96];
+    for (unsigned int i = 0; i < g1Count; i++) {
+        if (!readHexLine(file, compressed, 48)) {
+            fprintf(stderr, "%s: malformed G1 point %u\n", path, i);
+            fclose(file);
+            return false;
+        }
+    }
+    g2_t g2Points[2];
+    for (unsigned int i = 0; i < 2; i++) {
+        if (!readHexLine(file, compressed, 96) || !g2Decompress(g2Points + i, compressed)) {
+            fprintf(stderr, "%s: malformed G2 point %u\n", path, i);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    if (memcmp(&g2Points[0].x, &g2Generator.x, sizeof(fp2_t)) || memcmp(&g2Points[0].y, &g2Generator.y, sizeof(fp2_t))) {
+        fprintf(stderr, "%s: first G2 point is not the generator\n", path);
+        return false;
+    }
+    bls12381Init();
+    g2Prepare(&g2GeneratorPrepared, g2Points + 0);
+    g2Prepare(&tauG2Prepared, g2Points + 1);
+    // published after the prepared points for threads that did not call kzgInit
+    __atomic_store_n(&loaded, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void loadEnvTrustedSetup() {
+    const char *path = getenv(KZG_TRUSTED_SETUP_ENV);
+    if (path != NULL && !kzgLoadTrustedSetup(path)) {
+        fputs("Cannot load the trusted setup from $" KZG_TRUSTED_SETUP_ENV "\n", stderr);
+        exit(1);
+    }
+}
+
+void kzgInit() {
+    pthread_once(&initOnce, loadEnvTrustedSetup);
+}
+
+static bool isFieldElement(const uint8_t bytes[32]) {
+    return memcmp(bytes, BLS_MODULUS, 32) < 0;
+}
+
+static bool verifyPointEvaluation(const uint8_t input[192]) {
+    const uint8_t *versionedHash = input;
+    const uint8_t *z = input + 32;
+    const uint8_t *y = input + 64;
+    const uint8_t *commitment = input + 96;
+    const uint8_t *proof = input + 144;
+
+    uint8_t commitmentHash[32];
+    sha256(commitmentHash, commitment, 48);
+    if (versionedHash[0] != VERSIONED_HASH_VERSION_KZG || memcmp(versionedHash + 1, commitmentHash + 1, 31) != 0) {
+        return false;
+    }
+    if (!isFieldElement(z) || !isFieldElement(y)) {
+        return false;
+    }
+    g1_t commitmentPoint, proofPoint;
+    if (!g1Decompress(&commitmentPoint, commitment) || !g1Decompress(&proofPoint, proof)) {
+        return false;
+    }
+
+    // -y mod r
+    uint8_t minusY[32];
+    int borrow = 0;
+    for (int i = 31; i >= 0; i--) {
+        int diff = BLS_MODULUS[i] - y[i] - borrow;
+        minusY[i] = diff;
+        borrow = diff < 0;
+    }
+    if (memcmp(minusY, BLS_MODULUS, 32) == 0) {
+        bzero(minusY, 32);
+    }
+
+    // e(C - [y]G1 + [z]proof, G2) * e(-proof, [tau]G2) == 1
+    g1_t p[2];
+    g1LinearCombination(p + 0, &commitmentPoint, &proofPoint, z, minusY);
+    g1Neg(p + 1, &proofPoint);
+    const g2Prepared_t *q[2] = {&g2GeneratorPrepared, &tauG2Prepared};
+    return pairingProductIsOne(p, q, 2);
+}
+
+bool kzgVerifyPointEvaluation(const uint8_t input[192]) {
+    if (!kzgTrustedSetupLoaded()) {
+        return false;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool valid = verifyPointEvaluation(input);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    // verification is reentrant so the stats may be updated from several threads
+    __atomic_add_fetch(&stats.verifications, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.verifyNanos, (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec, __ATOMIC_RELAXED);
+    return valid;
+}
@@ -1,156 +1,289 @@
+#include <fcntl.h>
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <sys/param.h>
 #include <sys/stat.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 #include "data.h"
+#include "assemble.h"
 #include "hex.h"
+#include "keccak.h"
+#include "scan.h"
 
-static const char *selfPath;
-static const char *derivedPath = NULL;
+typedef struct dependency {
+    char *path;
+    struct timespec mtime;
+    off_t size;
+    uint8_t hash[32];
+} dependency_t;
 
-void pathInit(const char *_selfPath) {
-    selfPath = _selfPath;
+typedef struct assembly {
+    uint8_t wrap;
+    data_t code;
+    // the source itself, then every file assembled into it
+    dependency_t *dependencies;
+    uint32_t dependencyCount;
+    struct assembly *next;
+} assembly_t;
+
+static assembly_t *assemblies = NULL;
+// the assembly in progress, which inherits the dependencies of the files it assembles
+static assembly_t *assembling = NULL;
+static void (*observer)(const char *path, const uint8_t hash[32]) = NULL;
+
+void assembleObserve(void (*_observer)(const char *path, const uint8_t hash[32])) {
+    observer = _observer;
 }
 
-static const char *derivePath() {
-    if (derivedPath != NULL) {
-        return derivedPath;
-    }
-    if (!selfPath) {
-        fprintf(stderr, "must pathInit\n");
-        exit(1);
-    }
-    if (selfPath[0] == '/') {
-        // absolute path
-        derivedPath = selfPath;
-        return derivedPath;
-    }
-    const char *pathWalk = selfPath;
-    char *relativePath = malloc(MAXPATHLEN + 1);
-    while (*pathWalk) {
-        if (*pathWalk == '/') {
-            // relative path
-            if (getcwd(relativePath, MAXPATHLEN + 1) == NULL) {
-                perror("getcwd");
-                exit(1);
-            }
-            size_t offset = strlen(relativePath);
-            relativePath[offset++] = '/';
-            relativePath[offset] = '\0';
-            strcpy(relativePath + offset, selfPath);
-            derivedPath = relativePath;
-            return derivedPath;
+static void addDependency(assembly_t *assembly, const dependency_t *dependency) {
+    for (uint32_t i = 0; i < assembly->dependencyCount; i++) {
+        if (strcmp(assembly->dependencies[i].path, dependency->path) == 0) {
+            return;
         }
-        pathWalk++;
-    }
-    // look through $PATH
-    char *path = getenv("PATH");
-    struct stat statResult;
-    while (*path) {
-        char *next = strchr(path,':');
-        if (next == NULL) {
-            break;
-        }
-        char *end = stpncpy(relativePath, path, next - path);
-        *end++ = '/';
-        strcpy(end, selfPath);
-        if (stat(relativePath, &statResult) == -1) {
-            //perror(relativePath);
-            path = next + 1;
-        } else {
-            derivedPath = relativePath;
-            return derivedPath;
+    }
+    assembly->dependencies = realloc(assembly->dependencies, (assembly->dependencyCount + 1) * sizeof(dependency_t));
+    dependency_t *added = assembly->dependencies + assembly->dependencyCount++;
+    *added = *dependency;
+    added->path = strdup(dependency->path);
+}
+
+static void freeAssembly(assembly_t *assembly) {
+    for (uint32_t i = 0; i < assembly->dependencyCount; i++) {
+        free(assembly->dependencies[i].path);
+    }
+    free(assembly->dependencies);
+    free(assembly->code.content);
+    free(assembly);
+}
+
+// reads the whole file with a NUL terminator for the scanner
+static char *readSource(const char *path, dependency_t *dependency) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        _exit(1);
+    }
+    struct stat fstatus;
+    if (fstat(fd, &fstatus) == -1) {
+        perror(path);
+        _exit(1);
+    }
+    char *contents = malloc(fstatus.st_size + 1);
+    off_t red = 0;
+    while (red < fstatus.st_size) {
+        ssize_t chunk = read(fd, contents + red, fstatus.st_size - red);
+        if (chunk <= 0) {
+            perror(path);
+            _exit(1);
         }
+        red += chunk;
+    }
+    close(fd);
+    contents[red] = '\0';
+    dependency->path = (char *)path;
+    dependency->mtime = fstatus.st_mtim;
+    dependency->size = fstatus.st_size;
+    keccak_256(dependency->hash, 32, (uint8_t *)contents, red);
+    return contents;
+}
+
+static bool unmodified(const dependency_t *dependency) {
+    struct stat fstatus;
+    return stat(dependency->path, &fstatus) == 0
+           && fstatus.st_size == dependency->size
+           && fstatus.st_mtim.tv_sec == dependency->mtime.tv_sec
+           && fstatus.st_mtim.tv_nsec == dependency->mtime.tv_nsec;
+}
+
+// rereads the file, returning whether its contents still match the recorded hash
+static bool refresh(dependency_t *dependency) {
+    if (access(dependency->path, R_OK)) {
+        return false;
     }
-    fputs("evm: could not find evm\n", stderr);
-    _exit(-1);
+    uint8_t expected[32];
+    memcpy(expected, dependency->hash, 32);
+    free(readSource(dependency->path, dependency));
+    return memcmp(dependency->hash, expected, 32) == 0;
 }
 
-static data_t recursiveSubprocess(char *const args[]) {
-    int rw[2];
-    if (pipe(rw) == -1) {
-        perror("pipe");
-        _exit(-1);
-    }
-    pid_t pid = fork();
-    if (pid == 0) {
-        close(1);
-        close(rw[0]);
-        if (dup2(rw[1], 1) == -1) {
-            perror("dup2");
-            _exit(-1);
+// finds a fresh assembly, dropping any that are stale
+static assembly_t *findAssembly(const char *path, uint8_t wrap) {
+    for (assembly_t **prev = &assemblies; *prev; prev = &(*prev)->next) {
+        assembly_t *assembly = *prev;
+        if (assembly->wrap != wrap || strcmp(assembly->dependencies[0].path, path)) {
+            continue;
         }
-        // child
-        if (execve(derivedPath, args, NULL) == -1) {
-            perror(derivedPath);
-            _exit(-1);
+        for (uint32_t i = 0; i < assembly->dependencyCount; i++) {
+            if (!unmodified(assembly->dependencies + i)) {
+                *prev = assembly->next;
+                freeAssembly(assembly);
+                return NULL;
+            }
         }
+        return assembly;
+    }
+    return NULL;
+}
+
+// $EVM_ASSEMBLY_CACHE/<keccak(wrap, source)> holds the nested dependencies and the assembled hex:
+// count
+// hash path
+// ...
+// code
+static char *cachePath(const assembly_t *assembly) {
+    const char *directory = getenv("EVM_ASSEMBLY_CACHE");
+    if (directory == NULL || *directory == '\0') {
+        return NULL;
+    }
+    uint8_t key[33];
+    key[0] = assembly->wrap;
+    memcpy(key + 1, assembly->dependencies[0].hash, 32);
+    uint8_t hash[32];
+    keccak_256(hash, 32, key, 33);
+    size_t len = strlen(directory);
+    char *path = malloc(len + 66);
+    char *end = stpcpy(path, directory);
+    *end++ = '/';
+    for (uint8_t i = 0; i < 32; i++) {
+        end += sprintf(end, "%02x", hash[i]);
     }
-    close(rw[1]);
-    int status;
-    pid_t finished = wait(&status);
-    if (finished == -1) {
-        perror("wait");
-        _exit(-1);
-    }
-    if (WEXITSTATUS(status)) {
-        // propagate failure
-        _exit(WEXITSTATUS(status));
-    }
-    size_t bufferSize = 0x10000;
-    data_t input;
-    input.size = 0;
-    char *content = malloc(bufferSize);
-    while (1) {
-        ssize_t red = read(rw[0], content + input.size, bufferSize - input.size);
-        if (red == -1) {
-            perror("read");
-            _exit(-1);
+    return path;
+}
+
+static bool loadCachedAssembly(assembly_t *assembly) {
+    char *path = cachePath(assembly);
+    if (path == NULL) {
+        return false;
+    }
+    FILE *file = fopen(path, "r");
+    free(path);
+    if (file == NULL) {
+        return false;
+    }
+    bool loaded = false;
+    uint32_t count;
+    if (fscanf(file, "%" SCNu32 "\n", &count) != 1) {
+        goto done;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        char hash[65];
+        char dependencyPath[4097];
+        if (fscanf(file, "%64s %4096[^\n]\n", hash, dependencyPath) != 2) {
+            goto done;
         }
-        if (red == 0) {
-            break;
+        dependency_t dependency;
+        dependency.path = dependencyPath;
+        for (uint8_t j = 0; j < 32; j++) {
+            dependency.hash[j] = hexString16ToUint8(hash + j * 2);
         }
-        input.size += red;
-        if (input.size == bufferSize) {
-            char *next = malloc(bufferSize * 2);
-            memcpy(next, content, input.size);
-            free(content);
-            content = next;
-            bufferSize *= 2;
+        if (!refresh(&dependency)) {
+            goto done;
         }
+        addDependency(assembly, &dependency);
+    }
+    long start = ftell(file);
+    fseek(file, 0, SEEK_END);
+    size_t hexLength = ftell(file) - start;
+    fseek(file, start, SEEK_SET);
+    char *hex = malloc(hexLength + 1);
+    if (fread(hex, 1, hexLength, file) != hexLength) {
+        free(hex);
+        goto done;
     }
-    for (size_t i = 0; i < input.size / 2; i++) {
-        content[i] = hexString16ToUint8(content + i * 2);
+    assembly->code.size = hexLength / 2;
+    assembly->code.content = malloc(assembly->code.size);
+    for (size_t i = 0; i < assembly->code.size; i++) {
+        assembly->code.content[i] = hexString16ToUint8(hex + i * 2);
     }
-    input.content = (uint8_t *)content;
-    input.size /= 2;
+    free(hex);
+    loaded = true;
+done:
+    fclose(file);
+    while (!loaded && assembly->dependencyCount > 1) {
+        free(assembly->dependencies[--assembly->dependencyCount].path);
+    }
+    return loaded;
+}
 
-    return input;
+static void storeCachedAssembly(const assembly_t *assembly) {
+    char *path = cachePath(assembly);
+    if (path == NULL) {
+        return;
+    }
+    // written aside and renamed so that concurrent workers never read a partial entry
+    char *tmpPath = malloc(strlen(path) + 8);
+    sprintf(tmpPath, "%s.XXXXXX", path);
+    int fd = mkstemp(tmpPath);
+    if (fd == -1) {
+        perror(tmpPath);
+        free(tmpPath);
+        free(path);
+        return;
+    }
+    FILE *file = fdopen(fd, "w");
+    fprintf(file, "%" PRIu32 "\n", assembly->dependencyCount - 1);
+    for (uint32_t i = 1; i < assembly->dependencyCount; i++) {
+        for (uint8_t j = 0; j < 32; j++) {
+            fprintf(file, "%02x", assembly->dependencies[i].hash[j]);
+        }
+        fprintf(file, " %s\n", assembly->dependencies[i].path);
+    }
+    fprintData(file, assembly->code);
+    if (fclose(file) || rename(tmpPath, path)) {
+        perror(path);
+        unlink(tmpPath);
+    }
+    free(tmpPath);
+    free(path);
+}
+
+static data_t assembleCached(const char *path, uint8_t wrap) {
+    assembly_t *assembly = findAssembly(path, wrap);
+    if (assembly == NULL) {
+        assembly = calloc(1, sizeof(assembly_t));
+        assembly->wrap = wrap;
+        dependency_t source;
+        char *contents = readSource(path, &source);
+        addDependency(assembly, &source);
+        if (!loadCachedAssembly(assembly)) {
+            assembly_t *parent = assembling;
+            assembling = assembly;
+            scanState_t *enclosing = scanSave();
+            assembly->code = assembleSource(contents, wrap);
+            scanRestore(enclosing);
+            assembling = parent;
+            storeCachedAssembly(assembly);
+        }
+        free(contents);
+        assembly->next = assemblies;
+        assemblies = assembly;
+    }
+    if (assembling) {
+        for (uint32_t i = 0; i < assembly->dependencyCount; i++) {
+            addDependency(assembling, assembly->dependencies + i);
+        }
+    }
+    if (observer) {
+        for (uint32_t i = 0; i < assembly->dependencyCount; i++) {
+            observer(assembly->dependencies[i].path, assembly->dependencies[i].hash);
+        }
+    }
+    data_t code;
+    code.size = assembly->code.size;
+    code.content = malloc(code.size);
+    memcpy(code.content, assembly->code.content, code.size);
+    return code;
 }
 
 // evm -c $path
 data_t defaultConstructorForPath(const char *path) {
-    char *const args[4] = {
-        (char *) derivePath(),
-        "-c",
-        (char *) path,
-        NULL
-    };
-    return recursiveSubprocess(args);
+    return assembleCached(path, WRAP_MIN_CONSTRUCTOR);
 }
 
 // evm $path
 data_t assemblePath(const char *path) {
-    char *const args[4] = {
-        (char *) derivePath(),
-        (char *) path,
-        NULL
-    };
-    return recursiveSubprocess(args);
+    return assembleCached(path, WRAP_NONE);
 }
@@ -0,0 +1,1077 @@
+#include "provider.h"
+#include "hex.h"
+#include "image.h"
+#include "vector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef struct providedSlot {
+    uint256_t key;
+    uint256_t value;
+} providedSlot_t;
+
+VECTOR(providedSlot, providedSlots);
+
+typedef struct providedAccount {
+    address_t address;
+    // whether the account line has been read
+    bool known;
+    val_t balance;
+    uint64_t nonce;
+    data_t code;
+    providedSlots_t slots;
+    // for a store, open-addressed by key, holding 1 + the position of each slot and 0 where empty
+    uint32_t *slotIndex;
+    uint32_t slotIndexSize;
+} providedAccount_t;
+
+VECTOR(providedAccount, providedAccounts);
+
+typedef struct provider {
+    // where the files are read and, when asking, appended; NULL for no files
+    const char *dir;
+    // NULL for a directory provider
+    const char *command;
+    // the process that started the command; forks start their own
+    pid_t owner;
+    pid_t pid;
+    FILE *requests;
+    FILE *replies;
+    pthread_mutex_t lock;
+    // the accounts whose files have been read
+    providedAccounts_t accounts;
+    // the mapping of an image provider, which needs no lock, or of the image of a store
+    const imageHeader_t *image;
+    size_t imageSize;
+    // a store appends the changes committed since its image was written to the log in dir
+    // and keeps them in accounts, indexed by address like the slots of each account
+    FILE *log;
+    uint32_t *accountIndex;
+    uint32_t accountIndexSize;
+    // roughly the heap taken by the changes, which is bounded by folding them into a new image
+    size_t logMemory;
+    // the records appended by the commit in progress
+    uint64_t pendingRecords;
+} provider_t;
+
+#define ADDRESS_PATH_LENGTH 42
+
+static void addressPath(char path[ADDRESS_PATH_LENGTH + 1], const address_t *address) {
+    path[0] = '0';
+    path[1] = 'x';
+    for (size_t i = 0; i < 20; i++) {
+        sprintf(path + 2 + i * 2, "%02x", address->address[i]);
+    }
+}
+
+// reads 0x-prefixed hex of at most 32 bytes into bytes, returning the word after it
+static char *readHexWord(char *word, uint8_t bytes[32], const char *line) {
+    if (word == NULL || word[0] != '0' || word[1] != 'x') {
+        fprintf(stderr, "Expected hex in provided line: %s", line);
+        _exit(1);
+    }
+    word += 2;
+    size_t length = strcspn(word, " \n");
+    if (length > 64) {
+        fprintf(stderr, "Hex too long in provided line: %s", line);
+        _exit(1);
+    }
+    char padded[64];
+    memset(padded, '0', 64 - length);
+    memcpy(padded + 64 - length, word, length);
+    for (size_t i = 0; i < 64; i++) {
+        if (!isHex(padded[i])) {
+            fprintf(stderr, "Invalid hex in provided line: %s", line);
+            _exit(1);
+        }
+    }
+    hexDecode(bytes, padded, 32);
+    word += length;
+    return *word == ' ' ? word + 1 : NULL;
+}
+
+static char *readWord256(char *word, uint256_t *value, const char *line) {
+    uint8_t bytes[32];
+    word = readHexWord(word, bytes, line);
+    readu256BE(bytes, value);
+    return word;
+}
+
+static uint64_t readBigEndian(const uint8_t *bytes, size_t count) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < count; i++) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+static providedSlot_t *findSlot(providedAccount_t *account, const uint256_t *key) {
+    for (size_t i = 0; i < account->slots.num_providedSlots; i++) {
+        if (equal256(&account->slots.providedSlots[i].key, key)) {
+            return account->slots.providedSlots + i;
+        }
+    }
+    return NULL;
+}
+
+// reads an account or slot line into the account, returning its kind, 'a' or 's'
+// the first line for the account or slot wins
+static char readLine(providedAccount_t *account, char *line, uint256_t *key) {
+    if (strncmp(line, "account ", 8) == 0) {
+        uint8_t bytes[32];
+        char *word = readHexWord(line + 8, bytes, line);
+        for (size_t i = 0; i < 20; i++) {
+            if (bytes[i]) {
+                fprintf(stderr, "Balance exceeds 96 bits in provided line: %s", line);
+                _exit(1);
+            }
+        }
+        val_t balance;
+        for (size_t i = 0; i < 3; i++) {
+            balance[i] = readBigEndian(bytes + 20 + i * 4, 4);
+        }
+        word = readHexWord(word, bytes, line);
+        for (size_t i = 0; i < 24; i++) {
+            if (bytes[i]) {
+                fprintf(stderr, "Nonce exceeds 64 bits in provided line: %s", line);
+                _exit(1);
+            }
+        }
+        uint64_t nonce = readBigEndian(bytes + 24, 8);
+        if (word == NULL || word[0] != '0' || word[1] != 'x') {
+            fprintf(stderr, "Expected code in provided line: %s", line);
+            _exit(1);
+        }
+        word += 2;
+        size_t length = strcspn(word, " \n");
+        if (length & 1) {
+            fprintf(stderr, "Odd-lengthed code in provided line: %s", line);
+            _exit(1);
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (!isHex(word[i])) {
+                fprintf(stderr, "Invalid hex in provided line: %s", line);
+                _exit(1);
+            }
+        }
+        if (!account->known) {
+            account->known = true;
+            memcpy(account->balance, balance, sizeof(val_t));
+            account->nonce = nonce;
+            account->code.size = length / 2;
+            account->code.content = length ? malloc(length / 2) : NULL;
+            hexDecode(account->code.content, word, length / 2);
+        }
+        return 'a';
+    }
+    if (strncmp(line, "slot ", 5) == 0) {
+        providedSlot_t slot;
+        char *word = readWord256(line + 5, &slot.key, line);
+        readWord256(word, &slot.value, line);
+        if (findSlot(account, &slot.key) == NULL) {
+            providedSlots_append(&account->slots, slot);
+        }
+        copy256(key, &slot.key);
+        return 's';
+    }
+    fprintf(stderr, "Unexpected provided line: %s", line);
+    _exit(1);
+}
+
+static providedAccount_t *getProvidedAccount(provider_t *provider, const address_t *address) {
+    for (size_t i = 0; i < provider->accounts.num_providedAccounts; i++) {
+        if (AddressEqual(&provider->accounts.providedAccounts[i].address, address)) {
+            return provider->accounts.providedAccounts + i;
+        }
+    }
+    providedAccount_t loaded;
+    bzero(&loaded, sizeof(loaded));
+    loaded.address = *address;
+    providedSlots_init(&loaded.slots, 4);
+    if (provider->dir) {
+        char path[strlen(provider->dir) + ADDRESS_PATH_LENGTH + 2];
+        int prefix = sprintf(path, "%s/", provider->dir);
+        addressPath(path + prefix, address);
+        FILE *file = fopen(path, "r");
+        if (file == NULL && errno != ENOENT) {
+            perror(path);
+            _exit(1);
+        }
+        if (file) {
+            char *line = NULL;
+            size_t lineSize = 0;
+            uint256_t key;
+            while (getline(&line, &lineSize, file) > 0) {
+                readLine(&loaded, line, &key);
+            }
+            free(line);
+            fclose(file);
+        }
+    }
+    providedAccounts_append(&provider->accounts, loaded);
+    return provider->accounts.providedAccounts + provider->accounts.num_providedAccounts - 1;
+}
+
+static void stopCommand(provider_t *provider) {
+    fclose(provider->requests);
+    fclose(provider->replies);
+    if (provider->owner == getpid()) {
+        waitpid(provider->pid, NULL, 0);
+    }
+    provider->requests = NULL;
+    provider->replies = NULL;
+}
+
+static void startCommand(provider_t *provider) {
+    if (provider->requests && provider->owner != getpid()) {
+        // the pipes belong to the parent
+        stopCommand(provider);
+    }
+    if (provider->requests) {
+        return;
+    }
+    int requests[2];
+    int replies[2];
+    if (pipe(requests) || pipe(replies)) {
+        perror("pipe");
+        _exit(1);
+    }
+    provider->pid = fork();
+    if (provider->pid == -1) {
+        perror("fork");
+        _exit(1);
+    }
+    if (provider->pid == 0) {
+        dup2(requests[0], STDIN_FILENO);
+        dup2(replies[1], STDOUT_FILENO);
+        close(requests[0]);
+        close(requests[1]);
+        close(replies[0]);
+        close(replies[1]);
+        execl("/bin/sh", "sh", "-c", provider->command, NULL);
+        perror(provider->command);
+        _exit(1);
+    }
+    close(requests[0]);
+    close(replies[1]);
+    provider->owner = getpid();
+    provider->requests = fdopen(requests[1], "w");
+    provider->replies = fdopen(replies[0], "r");
+}
+
+// sends the request line and reads the answer into the account, appending it to its file
+static void ask(provider_t *provider, providedAccount_t *account, const char *request, char kind, const uint256_t *key) {
+    startCommand(provider);
+    fputs(request, provider->requests);
+    fflush(provider->requests);
+    char *line = NULL;
+    size_t lineSize = 0;
+    if (getline(&line, &lineSize, provider->replies) <= 0) {
+        fprintf(stderr, "%s: no answer to %s", provider->command, request);
+        _exit(1);
+    }
+    uint256_t answeredKey;
+    if (readLine(account, line, &answeredKey) != kind || (kind == 's' && !equal256(&answeredKey, key))) {
+        fprintf(stderr, "%s: unexpected answer to %s%s", provider->command, request, line);
+        _exit(1);
+    }
+    if (provider->dir) {
+        char path[strlen(provider->dir) + ADDRESS_PATH_LENGTH + 2];
+        int prefix = sprintf(path, "%s/", provider->dir);
+        addressPath(path + prefix, &account->address);
+        FILE *file = fopen(path, "a");
+        if (file == NULL || fputs(line, file) == EOF || fclose(file)) {
+            perror(path);
+            _exit(1);
+        }
+    }
+    free(line);
+}
+
+static void fprintWord256(FILE *file, const uint256_t *value) {
+    uint8_t bytes[32];
+    dumpu256BE(value, bytes);
+    fputs("0x", file);
+    for (size_t i = 0; i < 32; i++) {
+        fprintf(file, "%02x", bytes[i]);
+    }
+}
+
+static void provideAccount(void *context, const address_t *address, val_t balance, uint64_t *nonce, data_t *code) {
+    provider_t *provider = context;
+    pthread_mutex_lock(&provider->lock);
+    providedAccount_t *account = getProvidedAccount(provider, address);
+    if (!account->known && provider->command) {
+        char request[ADDRESS_PATH_LENGTH + 10];
+        strcpy(request, "account ");
+        addressPath(request + 8, address);
+        strcpy(request + 8 + ADDRESS_PATH_LENGTH, "\n");
+        ask(provider, account, request, 'a', NULL);
+    }
+    if (account->known) {
+        memcpy(balance, account->balance, sizeof(val_t));
+        *nonce = account->nonce;
+        code->size = account->code.size;
+        code->content = account->code.size ? malloc(account->code.size) : NULL;
+        memcpy(code->content, account->code.content, account->code.size);
+    }
+    pthread_mutex_unlock(&provider->lock);
+}
+
+static void provideStorage(void *context, const address_t *address, const uint256_t *key, uint256_t *value) {
+    provider_t *provider = context;
+    pthread_mutex_lock(&provider->lock);
+    providedAccount_t *account = getProvidedAccount(provider, address);
+    providedSlot_t *slot = findSlot(account, key);
+    if (slot == NULL && provider->command) {
+        char *request = NULL;
+        size_t requestSize = 0;
+        FILE *stream = open_memstream(&request, &requestSize);
+        fputs("slot ", stream);
+        fprintAddress(stream, (*address));
+        fputc(' ', stream);
+        fprintWord256(stream, key);
+        fputc('\n', stream);
+        fclose(stream);
+        ask(provider, account, request, 's', key);
+        free(request);
+        slot = findSlot(account, key);
+    }
+    if (slot) {
+        copy256(value, &slot->value);
+    }
+    pthread_mutex_unlock(&provider->lock);
+}
+
+static const imageAccount_t *imageAccounts(const provider_t *provider) {
+    return (const imageAccount_t *)(provider->image + 1);
+}
+
+static const imageCode_t *imageCodes(const provider_t *provider) {
+    return (const imageCode_t *)(imageAccounts(provider) + provider->image->accountCount);
+}
+
+static const imageSlot_t *imageSlots(const provider_t *provider) {
+    return (const imageSlot_t *)(imageCodes(provider) + provider->image->codeCount);
+}
+
+static int compareImageAddress(const void *address, const void *account) {
+    return memcmp(address, ((const imageAccount_t *)account)->address, 20);
+}
+
+static int compareImageKey(const void *key, const void *slot) {
+    return memcmp(key, ((const imageSlot_t *)slot)->key, 32);
+}
+
+static const uint8_t *imageCodeBytes(const provider_t *provider) {
+    return (const uint8_t *)(imageSlots(provider) + provider->image->slotCount);
+}
+
+static void checkImageAccount(const provider_t *provider, const imageAccount_t *account) {
+    const imageCode_t *code = imageCodes(provider) + account->code;
+    if (account->code >= provider->image->codeCount
+        || account->firstSlot > provider->image->slotCount
+        || account->slotCount > provider->image->slotCount - account->firstSlot
+        || code->offset > provider->image->codeBytes
+        || code->size > provider->image->codeBytes - code->offset) {
+        address_t address;
+        memcpy(address.address, account->address, sizeof(address.address));
+        fputs("Corrupt image account ", stderr);
+        fprintAddress(stderr, address);
+        fputc('\n', stderr);
+        _exit(1);
+    }
+}
+
+static const imageAccount_t *findImageAccount(const provider_t *provider, const address_t *address) {
+    if (provider->image == NULL) {
+        return NULL;
+    }
+    const imageAccount_t *account = bsearch(address->address, imageAccounts(provider), provider->image->accountCount, sizeof(imageAccount_t), compareImageAddress);
+    if (account) {
+        checkImageAccount(provider, account);
+    }
+    return account;
+}
+
+// points into the mapping
+static data_t imageCode(const provider_t *provider, const imageAccount_t *account) {
+    const imageCode_t *code = imageCodes(provider) + account->code;
+    data_t result;
+    result.size = code->size;
+    result.content = (uint8_t *)imageCodeBytes(provider) + code->offset;
+    return result;
+}
+
+static void findImageSlot(const provider_t *provider, const imageAccount_t *account, const uint256_t *key, uint256_t *value) {
+    uint8_t bytes[32];
+    dumpu256BE(key, bytes);
+    const imageSlot_t *slot = bsearch(bytes, imageSlots(provider) + account->firstSlot, account->slotCount, sizeof(imageSlot_t), compareImageKey);
+    if (slot) {
+        readu256BE(slot->value, value);
+    }
+}
+
+static void provideImageAccount(void *context, const address_t *address, val_t balance, uint64_t *nonce, data_t *code) {
+    const provider_t *provider = context;
+    const imageAccount_t *account = findImageAccount(provider, address);
+    if (account == NULL) {
+        return;
+    }
+    memcpy(balance, account->balance, sizeof(val_t));
+    *nonce = account->nonce;
+    // the evm owns the code of its accounts
+    data_t mapped = imageCode(provider, account);
+    code->size = mapped.size;
+    code->content = code->size ? malloc(code->size) : NULL;
+    memcpy(code->content, mapped.content, code->size);
+}
+
+static void provideImageStorage(void *context, const address_t *address, const uint256_t *key, uint256_t *value) {
+    const provider_t *provider = context;
+    const imageAccount_t *account = findImageAccount(provider, address);
+    if (account) {
+        findImageSlot(provider, account, key, value);
+    }
+}
+
+static stateProvider_t newProvider(const char *dir, const char *command) {
+    provider_t *provider = calloc(1, sizeof(provider_t));
+    provider->dir = dir;
+    provider->command = command;
+    pthread_mutex_init(&provider->lock, NULL);
+    providedAccounts_init(&provider->accounts, 16);
+    stateProvider_t result;
+    result.context = provider;
+    result.account = provideAccount;
+    result.storage = provideStorage;
+    return result;
+}
+
+stateProvider_t directoryProvider(const char *dir) {
+    return newProvider(dir, NULL);
+}
+
+stateProvider_t rpcProvider(const char *command, const char *cacheDir) {
+    if (cacheDir && mkdir(cacheDir, 0755) && errno != EEXIST) {
+        perror(cacheDir);
+        _exit(1);
+    }
+    return newProvider(cacheDir, command);
+}
+
+#define IMAGE_PINNED_BYTES (64 << 20)
+
+// exits unless the file is a complete image
+static const imageHeader_t *mapImage(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    if (fd == -1 || fstat(fd, &status)) {
+        perror(path);
+        _exit(1);
+    }
+    if ((size_t)status.st_size < sizeof(imageHeader_t)) {
+        fprintf(stderr, "%s: not an image\n", path);
+        _exit(1);
+    }
+    const imageHeader_t *header = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (header == MAP_FAILED) {
+        perror(path);
+        _exit(1);
+    }
+    close(fd);
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic))) {
+        fprintf(stderr, "%s: not an image\n", path);
+        _exit(1);
+    }
+    // each count is bounded by the size before they are summed
+    uint64_t remaining = status.st_size - sizeof(imageHeader_t);
+    if (header->accountCount > remaining / sizeof(imageAccount_t)
+        || header->codeCount > remaining / sizeof(imageCode_t)
+        || header->slotCount > remaining / sizeof(imageSlot_t)
+        || header->codeBytes > remaining
+        || header->accountCount * sizeof(imageAccount_t) + header->codeCount * sizeof(imageCode_t) + header->slotCount * sizeof(imageSlot_t) + header->codeBytes != remaining) {
+        fprintf(stderr, "%s: truncated image\n", path);
+        _exit(1);
+    }
+    // every lookup binary-searches the accounts, so their table stays resident when it is small enough to pin
+    // the slots and code are read at random, through the page cache, which evicts them as needed
+    size_t tables = sizeof(imageHeader_t) + header->accountCount * sizeof(imageAccount_t) + header->codeCount * sizeof(imageCode_t);
+    if (tables <= IMAGE_PINNED_BYTES) {
+        mlock(header, tables);
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t unpinned = tables / page * page;
+    madvise((uint8_t *)header + unpinned, status.st_size - unpinned, MADV_RANDOM);
+    *size = status.st_size;
+    return header;
+}
+
+stateProvider_t imageProvider(const char *path) {
+    stateProvider_t result = newProvider(NULL, NULL);
+    provider_t *provider = result.context;
+    provider->image = mapImage(path, &provider->imageSize);
+    result.account = provideImageAccount;
+    result.storage = provideImageStorage;
+    return result;
+}
+
+#define STORE_IMAGE "/image"
+#define STORE_LOG "/log"
+
+static char *storePath(const provider_t *provider, const char *file) {
+    char *path = malloc(strlen(provider->dir) + strlen(file) + 5);
+    sprintf(path, "%s%s", provider->dir, file);
+    return path;
+}
+
+// the changes kept in memory before they are folded into a new image, whatever the size of the image
+#define STORE_LOG_MEMORY (64 << 20)
+
+static uint32_t storeAddressHash(const address_t *address) {
+    uint64_t hash;
+    memcpy(&hash, address->address + 12, sizeof(hash));
+    return (hash * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+static uint32_t storeKeyHash(const uint256_t *key) {
+    uint64_t hash = UPPER(UPPER_P(key)) ^ LOWER(UPPER_P(key)) ^ UPPER(LOWER_P(key)) ^ LOWER(LOWER_P(key));
+    return (hash * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+static uint32_t *storeAccountEntry(const provider_t *provider, const address_t *address) {
+    uint32_t mask = provider->accountIndexSize - 1;
+    for (uint32_t i = storeAddressHash(address) & mask;; i = (i + 1) & mask) {
+        uint32_t *entry = provider->accountIndex + i;
+        if (*entry == 0 || AddressEqual(&provider->accounts.providedAccounts[*entry - 1].address, address)) {
+            return entry;
+        }
+    }
+}
+
+static uint32_t *storeSlotEntry(const providedAccount_t *account, const uint256_t *key) {
+    uint32_t mask = account->slotIndexSize - 1;
+    for (uint32_t i = storeKeyHash(key) & mask;; i = (i + 1) & mask) {
+        uint32_t *entry = account->slotIndex + i;
+        if (*entry == 0 || equal256(&account->slots.providedSlots[*entry - 1].key, key)) {
+            return entry;
+        }
+    }
+}
+
+// keeps the index of the accounts at most half full
+static void indexStoreAccounts(provider_t *provider) {
+    size_t count = provider->accounts.num_providedAccounts;
+    if (provider->accountIndexSize && count * 2 <= provider->accountIndexSize) {
+        return;
+    }
+    free(provider->accountIndex);
+    provider->accountIndexSize = provider->accountIndexSize ? provider->accountIndexSize * 2 : 64;
+    provider->accountIndex = calloc(provider->accountIndexSize, sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++) {
+        *storeAccountEntry(provider, &provider->accounts.providedAccounts[i].address) = i + 1;
+    }
+}
+
+static void indexStoreSlots(providedAccount_t *account) {
+    size_t count = account->slots.num_providedSlots;
+    if (account->slotIndexSize && count * 2 <= account->slotIndexSize) {
+        return;
+    }
+    free(account->slotIndex);
+    account->slotIndexSize = account->slotIndexSize ? account->slotIndexSize * 2 : 8;
+    account->slotIndex = calloc(account->slotIndexSize, sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++) {
+        *storeSlotEntry(account, &account->slots.providedSlots[i].key) = i + 1;
+    }
+}
+
+static providedAccount_t *findStoreAccount(provider_t *provider, const address_t *address, bool insert) {
+    uint32_t *entry = storeAccountEntry(provider, address);
+    if (*entry) {
+        return provider->accounts.providedAccounts + *entry - 1;
+    }
+    if (!insert) {
+        return NULL;
+    }
+    providedAccount_t inserted;
+    bzero(&inserted, sizeof(inserted));
+    inserted.address = *address;
+    providedSlots_init(&inserted.slots, 4);
+    indexStoreSlots(&inserted);
+    providedAccounts_append(&provider->accounts, inserted);
+    *entry = provider->accounts.num_providedAccounts;
+    indexStoreAccounts(provider);
+    provider->logMemory += sizeof(providedAccount_t) + 4 * sizeof(uint32_t);
+    return provider->accounts.providedAccounts + provider->accounts.num_providedAccounts - 1;
+}
+
+static providedSlot_t *findStoreSlot(provider_t *provider, providedAccount_t *account, const uint256_t *key, bool insert) {
+    uint32_t *entry = storeSlotEntry(account, key);
+    if (*entry) {
+        return account->slots.providedSlots + *entry - 1;
+    }
+    if (!insert) {
+        return NULL;
+    }
+    providedSlot_t inserted;
+    copy256(&inserted.key, key);
+    clear256(&inserted.value);
+    providedSlots_append(&account->slots, inserted);
+    *entry = account->slots.num_providedSlots;
+    indexStoreSlots(account);
+    provider->logMemory += sizeof(providedSlot_t) + 4 * sizeof(uint32_t);
+    return account->slots.providedSlots + account->slots.num_providedSlots - 1;
+}
+
+static int compareStoreAccounts(const void *a, const void *b) {
+    return memcmp(((const providedAccount_t *)a)->address.address, ((const providedAccount_t *)b)->address.address, 20);
+}
+
+static int compareStoreSlots(const void *a, const void *b) {
+    const uint256_t *left = &((const providedSlot_t *)a)->key;
+    const uint256_t *right = &((const providedSlot_t *)b)->key;
+    return gt256(left, right) - gt256(right, left);
+}
+
+// sorts the changes by address and key for merging with the image, which leaves their indexes stale
+static void sortStoreAccounts(provider_t *provider) {
+    qsort(provider->accounts.providedAccounts, provider->accounts.num_providedAccounts, sizeof(providedAccount_t), compareStoreAccounts);
+    for (size_t i = 0; i < provider->accounts.num_providedAccounts; i++) {
+        providedSlots_t *slots = &provider->accounts.providedAccounts[i].slots;
+        qsort(slots->providedSlots, slots->num_providedSlots, sizeof(providedSlot_t), compareStoreSlots);
+    }
+}
+
+static void setStoreAccount(provider_t *provider, const address_t *address, const val_t balance, uint64_t nonce, const data_t *code) {
+    providedAccount_t *account = findStoreAccount(provider, address, true);
+    account->known = true;
+    memcpy(account->balance, balance, sizeof(val_t));
+    account->nonce = nonce;
+    free(account->code.content);
+    provider->logMemory += code->size - account->code.size;
+    account->code.size = code->size;
+    account->code.content = code->size ? malloc(code->size) : NULL;
+    memcpy(account->code.content, code->content, code->size);
+}
+
+// the code points into the log or the image
+static void storedAccount(provider_t *provider, const address_t *address, val_t balance, uint64_t *nonce, data_t *code) {
+    const providedAccount_t *account = findStoreAccount(provider, address, false);
+    if (account && account->known) {
+        memcpy(balance, account->balance, sizeof(val_t));
+        *nonce = account->nonce;
+        *code = account->code;
+        return;
+    }
+    const imageAccount_t *imageAccount = findImageAccount(provider, address);
+    if (imageAccount) {
+        memcpy(balance, imageAccount->balance, sizeof(val_t));
+        *nonce = imageAccount->nonce;
+        *code = imageCode(provider, imageAccount);
+    }
+}
+
+static void storedSlot(provider_t *provider, const address_t *address, const uint256_t *key, uint256_t *value) {
+    providedAccount_t *account = findStoreAccount(provider, address, false);
+    const providedSlot_t *slot = account ? findStoreSlot(provider, account, key, false) : NULL;
+    if (slot) {
+        copy256(value, &slot->value);
+        return;
+    }
+    const imageAccount_t *imageAccount = findImageAccount(provider, address);
+    if (imageAccount) {
+        findImageSlot(provider, imageAccount, key, value);
+    }
+}
+
+static void provideStoreAccount(void *context, const address_t *address, val_t balance, uint64_t *nonce, data_t *code) {
+    provider_t *provider = context;
+    pthread_mutex_lock(&provider->lock);
+    data_t stored;
+    stored.size = 0;
+    storedAccount(provider, address, balance, nonce, &stored);
+    code->size = stored.size;
+    code->content = stored.size ? malloc(stored.size) : NULL;
+    memcpy(code->content, stored.content, stored.size);
+    pthread_mutex_unlock(&provider->lock);
+}
+
+static void provideStoreStorage(void *context, const address_t *address, const uint256_t *key, uint256_t *value) {
+    provider_t *provider = context;
+    pthread_mutex_lock(&provider->lock);
+    storedSlot(provider, address, key, value);
+    pthread_mutex_unlock(&provider->lock);
+}
+
+// applies a line of the log
+static void replayLine(provider_t *provider, char *line) {
+    uint8_t bytes[32];
+    char *rest = readHexWord(line, bytes, line);
+    address_t address;
+    memcpy(address.address, bytes + 12, sizeof(address.address));
+    if (rest == NULL) {
+        fprintf(stderr, "Expected record in store log line: %s", line);
+        _exit(1);
+    }
+    providedAccount_t record;
+    bzero(&record, sizeof(record));
+    providedSlots_init(&record.slots, 1);
+    uint256_t key;
+    if (readLine(&record, rest, &key) == 'a') {
+        setStoreAccount(provider, &address, record.balance, record.nonce, &record.code);
+        free(record.code.content);
+    } else {
+        copy256(&findStoreSlot(provider, findStoreAccount(provider, &address, true), &key, true)->value, &record.slots.providedSlots[0].value);
+    }
+    providedSlots_destroy(&record.slots);
+}
+
+static void commitAccount(void *context, const address_t *address, const val_t balance, uint64_t nonce, const data_t *code) {
+    provider_t *provider = context;
+    val_t storedBalance = {0, 0, 0};
+    uint64_t storedNonce = 0;
+    data_t storedCode;
+    storedCode.size = 0;
+    storedAccount(provider, address, storedBalance, &storedNonce, &storedCode);
+    if (memcmp(balance, storedBalance, sizeof(val_t)) == 0 && nonce == storedNonce && DataEqual(code, &storedCode)) {
+        return;
+    }
+    fprintAddress(provider->log, (*address));
+    fprintf(provider->log, " account 0x%08x%08x%08x 0x%" PRIx64 " 0x", balance[0], balance[1], balance[2], nonce);
+    fprintData(provider->log, *code);
+    fputc('\n', provider->log);
+    setStoreAccount(provider, address, balance, nonce, code);
+    provider->pendingRecords++;
+}
+
+static void commitSlot(void *context, const address_t *address, const uint256_t *key, const uint256_t *value) {
+    provider_t *provider = context;
+    uint256_t stored;
+    clear256(&stored);
+    storedSlot(provider, address, key, &stored);
+    if (equal256(value, &stored)) {
+        return;
+    }
+    fprintAddress(provider->log, (*address));
+    fputs(" slot ", provider->log);
+    fprintWord256(provider->log, key);
+    fputc(' ', provider->log);
+    fprintWord256(provider->log, value);
+    fputc('\n', provider->log);
+    copy256(&findStoreSlot(provider, findStoreAccount(provider, address, true), key, true)->value, value);
+    provider->pendingRecords++;
+}
+
+// visits the nonzero slots of the account in order, merging those of the image and the log
+// writes them when file is not NULL, returning how many there are
+static uint64_t mergeSlots(const provider_t *provider, const imageAccount_t *imageAccount, const providedAccount_t *account, FILE *file) {
+    const imageSlot_t *imageSlot = imageAccount ? imageSlots(provider) + imageAccount->firstSlot : NULL;
+    const imageSlot_t *imageEnd = imageAccount ? imageSlot + imageAccount->slotCount : NULL;
+    const providedSlot_t *slot = account ? account->slots.providedSlots : NULL;
+    const providedSlot_t *end = account ? slot + account->slots.num_providedSlots : NULL;
+    uint64_t count = 0;
+    while (imageSlot != imageEnd || slot != end) {
+        imageSlot_t merged;
+        int order = 1;
+        if (slot != end) {
+            dumpu256BE(&slot->key, merged.key);
+            order = imageSlot == imageEnd ? -1 : memcmp(merged.key, imageSlot->key, 32);
+        }
+        if (order <= 0) {
+            dumpu256BE(&slot->value, merged.value);
+            slot++;
+            // the log replaces the value of the image
+            imageSlot += order == 0;
+        } else {
+            merged = *imageSlot++;
+        }
+        static const uint8_t zero[32];
+        if (memcmp(merged.value, zero, 32) == 0) {
+            continue;
+        }
+        count++;
+        if (file) {
+            fwrite(&merged, sizeof(merged), 1, file);
+        }
+    }
+    return count;
+}
+
+typedef struct storeCode {
+    uint8_t hash[32];
+    uint64_t account;
+} storeCode_t;
+
+static int compareStoreCodes(const void *a, const void *b) {
+    return memcmp(((const storeCode_t *)a)->hash, ((const storeCode_t *)b)->hash, 32);
+}
+
+// writes the image with the log applied, streaming the slots, which can outnumber the accounts greatly
+static void writeStoreImage(provider_t *provider, FILE *file) {
+    uint64_t imageCount = provider->image ? provider->image->accountCount : 0;
+    size_t logCount = provider->accounts.num_providedAccounts;
+    imageAccount_t *accounts = calloc(imageCount + logCount + 1, sizeof(imageAccount_t));
+    // the sources of each account
+    const imageAccount_t **imageSources = calloc(imageCount + logCount + 1, sizeof(imageAccount_t *));
+    const providedAccount_t **logSources = calloc(imageCount + logCount + 1, sizeof(providedAccount_t *));
+    data_t *contents = calloc(imageCount + logCount + 1, sizeof(data_t));
+    storeCode_t *codes = calloc(imageCount + logCount + 1, sizeof(storeCode_t));
+
+    imageHeader_t header;
+    bzero(&header, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    const imageAccount_t *imageAccount = provider->image ? imageAccounts(provider) : NULL;
+    const imageAccount_t *imageEnd = imageAccount + imageCount;
+    const providedAccount_t *account = provider->accounts.providedAccounts;
+    const providedAccount_t *end = account + logCount;
+    while (imageAccount != imageEnd || account != end) {
+        int order = account == end ? 1 : imageAccount == imageEnd ? -1 : memcmp(account->address.address, imageAccount->address, 20);
+        const imageAccount_t *fromImage = order >= 0 ? imageAccount++ : NULL;
+        const providedAccount_t *fromLog = order <= 0 ? account++ : NULL;
+        imageAccount_t *merged = accounts + header.accountCount;
+        storeCode_t *code = codes + header.accountCount;
+        data_t *content = contents + header.accountCount;
+        bzero(merged, sizeof(imageAccount_t));
+        if (fromImage) {
+            checkImageAccount(provider, fromImage);
+        }
+        if (fromLog && fromLog->known) {
+            memcpy(merged->address, fromLog->address.address, 20);
+            memcpy(merged->balance, fromLog->balance, sizeof(val_t));
+            merged->nonce = fromLog->nonce;
+            *content = fromLog->code;
+            keccak_256(code->hash, 32, content->content, content->size);
+        } else if (fromImage) {
+            *merged = *fromImage;
+            *content = imageCode(provider, fromImage);
+            memcpy(code->hash, imageCodes(provider)[fromImage->code].hash, 32);
+        } else {
+            memcpy(merged->address, fromLog->address.address, 20);
+            content->size = 0;
+            keccak_256(code->hash, 32, NULL, 0);
+        }
+        merged->firstSlot = header.slotCount;
+        merged->slotCount = mergeSlots(provider, fromImage, fromLog, NULL);
+        if (ValueIsZero(merged->balance) && merged->nonce == 0 && content->size == 0 && merged->slotCount == 0) {
+            continue;
+        }
+        header.slotCount += merged->slotCount;
+        code->account = header.accountCount;
+        imageSources[header.accountCount] = fromImage;
+        logSources[header.accountCount] = fromLog;
+        header.accountCount++;
+    }
+
+    // accounts with the same code share it
+    qsort(codes, header.accountCount, sizeof(storeCode_t), compareStoreCodes);
+    imageCode_t *uniqueCodes = calloc(header.accountCount + 1, sizeof(imageCode_t));
+    const data_t **codeContents = calloc(header.accountCount + 1, sizeof(data_t *));
+    for (uint64_t i = 0; i < header.accountCount; i++) {
+        if (i == 0 || memcmp(codes[i].hash, codes[i - 1].hash, 32)) {
+            imageCode_t *unique = uniqueCodes + header.codeCount;
+            memcpy(unique->hash, codes[i].hash, 32);
+            unique->offset = header.codeBytes;
+            unique->size = contents[codes[i].account].size;
+            codeContents[header.codeCount++] = contents + codes[i].account;
+            header.codeBytes += unique->size;
+        }
+        accounts[codes[i].account].code = header.codeCount - 1;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(accounts, sizeof(imageAccount_t), header.accountCount, file);
+    fwrite(uniqueCodes, sizeof(imageCode_t), header.codeCount, file);
+    for (uint64_t i = 0; i < header.accountCount; i++) {
+        mergeSlots(provider, imageSources[i], logSources[i], file);
+    }
+    for (uint64_t i = 0; i < header.codeCount; i++) {
+        fwrite(codeContents[i]->content, 1, codeContents[i]->size, file);
+    }
+    free(accounts);
+    free(imageSources);
+    free(logSources);
+    free(contents);
+    free(codes);
+    free(uniqueCodes);
+    free(codeContents);
+}
+
+static void clearStoreAccounts(provider_t *provider) {
+    for (size_t i = 0; i < provider->accounts.num_providedAccounts; i++) {
+        providedAccount_t *account = provider->accounts.providedAccounts + i;
+        free(account->code.content);
+        providedSlots_destroy(&account->slots);
+        free(account->slotIndex);
+    }
+    provider->accounts.num_providedAccounts = 0;
+    bzero(provider->accountIndex, provider->accountIndexSize * sizeof(uint32_t));
+    provider->logMemory = 0;
+}
+
+// so the rename of a file in it survives a crash
+static void syncDir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd == -1 || fsync(fd) || close(fd)) {
+        perror(dir);
+        _exit(1);
+    }
+}
+
+// replaces the image with one including the log, which is then emptied
+static void compactStore(provider_t *provider) {
+    char *imagePath = storePath(provider, STORE_IMAGE);
+    char *writingPath = storePath(provider, STORE_IMAGE ".new");
+    FILE *file = fopen(writingPath, "w");
+    if (file == NULL) {
+        perror(writingPath);
+        _exit(1);
+    }
+    sortStoreAccounts(provider);
+    writeStoreImage(provider, file);
+    if (fflush(file) || fsync(fileno(file)) || fclose(file) || rename(writingPath, imagePath)) {
+        perror(writingPath);
+        _exit(1);
+    }
+    syncDir(provider->dir);
+    // replaying the log onto the new image would change nothing, so a crash before it is emptied loses nothing
+    if (ftruncate(fileno(provider->log), 0) || fsync(fileno(provider->log))) {
+        perror("log");
+        _exit(1);
+    }
+    clearStoreAccounts(provider);
+    if (provider->image) {
+        munmap((void *)provider->image, provider->imageSize);
+    }
+    provider->image = mapImage(imagePath, &provider->imageSize);
+    free(imagePath);
+    free(writingPath);
+}
+
+stateProvider_t storeProvider(const char *dir) {
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        perror(dir);
+        _exit(1);
+    }
+    stateProvider_t result = newProvider(dir, NULL);
+    provider_t *provider = result.context;
+    result.account = provideStoreAccount;
+    result.storage = provideStoreStorage;
+    char *imagePath = storePath(provider, STORE_IMAGE);
+    if (access(imagePath, F_OK) == 0) {
+        provider->image = mapImage(imagePath, &provider->imageSize);
+    }
+    free(imagePath);
+
+    char *logPath = storePath(provider, STORE_LOG);
+    provider->log = fopen(logPath, "a+");
+    if (provider->log == NULL) {
+        perror(logPath);
+        _exit(1);
+    }
+    indexStoreAccounts(provider);
+    // only the records followed by the line of their commit are replayed; a crash can leave others after them
+    rewind(provider->log);
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t length;
+    off_t complete = 0;
+    off_t offset = 0;
+    uint64_t records = 0;
+    while ((length = getline(&line, &lineSize, provider->log)) > 0 && line[length - 1] == '\n') {
+        offset += length;
+        if (strncmp(line, "commit ", 7)) {
+            records++;
+        } else if (strtoull(line + 7, NULL, 10) == records) {
+            complete = offset;
+            records = 0;
+        } else {
+            break;
+        }
+    }
+    rewind(provider->log);
+    for (offset = 0; offset < complete && (length = getline(&line, &lineSize, provider->log)) > 0; offset += length) {
+        if (strncmp(line, "commit ", 7)) {
+            replayLine(provider, line);
+        }
+    }
+    free(line);
+    if (ftruncate(fileno(provider->log), complete)) {
+        perror(logPath);
+        _exit(1);
+    }
+    if (provider->logMemory > STORE_LOG_MEMORY) {
+        compactStore(provider);
+    }
+    free(logPath);
+    return result;
+}
+
+static void commit(stateProvider_t *store, evm_t *instance) {
+    provider_t *provider = store->context;
+    pthread_mutex_lock(&provider->lock);
+    stateVisitor_t visitor;
+    visitor.context = provider;
+    visitor.account = commitAccount;
+    visitor.storage = commitSlot;
+    provider->pendingRecords = 0;
+    if (instance) {
+        evmVisitState_r(instance, &visitor);
+    } else {
+        evmVisitState(&visitor);
+    }
+    if (provider->pendingRecords) {
+        fprintf(provider->log, "commit %" PRIu64 "\n", provider->pendingRecords);
+    }
+    struct stat status;
+    if (fflush(provider->log) || fsync(fileno(provider->log)) || fstat(fileno(provider->log), &status)) {
+        perror("log");
+        _exit(1);
+    }
+    // so reading the image and the log stays cheap, and the log outgrows neither the state nor the memory for it
+    if ((size_t)status.st_size > provider->imageSize || provider->logMemory > STORE_LOG_MEMORY) {
+        compactStore(provider);
+    }
+    pthread_mutex_unlock(&provider->lock);
+}
+
+void storeCommit(stateProvider_t *store) {
+    commit(store, NULL);
+}
+
+void storeCommit_r(evm_t *evm, stateProvider_t *store) {
+    commit(store, evm);
+}
+
+void providerFree(stateProvider_t *stateProvider) {
+    provider_t *provider = stateProvider->context;
+    if (provider->log) {
+        fclose(provider->log);
+    }
+    if (provider->image) {
+        munmap((void *)provider->image, provider->imageSize);
+    }
+    if (provider->requests) {
+        stopCommand(provider);
+    }
+    for (size_t i = 0; i < provider->accounts.num_providedAccounts; i++) {
+        providedAccount_t *account = provider->accounts.providedAccounts + i;
+        free(account->code.content);
+        providedSlots_destroy(&account->slots);
+        free(account->slotIndex);
+    }
+    providedAccounts_destroy(&provider->accounts);
+    free(provider->accountIndex);
+    pthread_mutex_destroy(&provider->lock);
+    free(provider);
+    stateProvider->context = NULL;
+}
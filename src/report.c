@@ -0,0 +1,297 @@
+#include "report.h"
+#include "vector.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *reportPath = NULL;
+// one record per line until reportClose
+static FILE *sink = NULL;
+
+void reportOpen(const char *reportFile) {
+    reportPath = reportFile;
+    sink = tmpfile();
+    if (sink == NULL) {
+        perror("tmpfile");
+        _exit(1);
+    }
+}
+
+bool reportEnabled() {
+    return sink != NULL;
+}
+
+void reportTest(const char *file, const char *entry, const char *name, bool passed, uint64_t gasUsed, uint64_t nanos, uint64_t ops) {
+    if (sink == NULL) {
+        return;
+    }
+    fprintf(
+        sink,
+        "{\"file\":\"%s\",\"entry\":\"%s\",\"name\":\"%s\",\"status\":\"%s\",\"gasUsed\":%" PRIu64 ",\"nanos\":%" PRIu64 ",\"ops\":%" PRIu64 "}\n",
+        file, entry, name, passed ? "pass" : "fail", gasUsed, nanos, ops
+    );
+    // a failing config exits without flushing
+    fflush(sink);
+}
+
+static void appendFile(FILE *dst, FILE *src) {
+    rewind(src);
+    char buffer[4096];
+    size_t red;
+    while ((red = fread(buffer, 1, sizeof(buffer), src))) {
+        fwrite(buffer, 1, red, dst);
+    }
+}
+
+void reportClose() {
+    if (sink == NULL || reportPath == NULL) {
+        return;
+    }
+    FILE *report = fopen(reportPath, "w");
+    if (report == NULL) {
+        perror(reportPath);
+        _exit(1);
+    }
+    fputc('[', report);
+    rewind(sink);
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    for (bool first = true; (length = getline(&line, &capacity, sink)) > 0; first = false) {
+        fputs(first ? "\n" : ",\n", report);
+        fwrite(line, 1, length - 1, report);
+    }
+    fputs("\n]\n", report);
+    free(line);
+    if (fclose(report)) {
+        perror(reportPath);
+    }
+    fclose(sink);
+    sink = NULL;
+}
+
+FILE *reportWorkerSink() {
+    if (sink == NULL) {
+        return NULL;
+    }
+    FILE *workerSink = tmpfile();
+    if (workerSink == NULL) {
+        perror("tmpfile");
+        _exit(1);
+    }
+    return workerSink;
+}
+
+void reportSetSink(FILE *workerSink) {
+    sink = workerSink;
+    // the parent writes the report
+    reportPath = NULL;
+}
+
+void reportAppendWorker(FILE *workerSink) {
+    appendFile(sink, workerSink);
+    fclose(workerSink);
+}
+
+typedef struct reportRecord {
+    char *file;
+    char *entry;
+    char *name;
+    bool passed;
+    uint64_t gasUsed;
+    uint64_t nanos;
+    uint64_t ops;
+    // line order, to pair the nth repeat of a test with the nth repeat in the other report
+    size_t index;
+    uint32_t occurrence;
+} reportRecord_t;
+
+VECTOR(reportRecord, reportRecords);
+
+// copies the string value after "key": without unescaping, since it is only compared and printed
+static char *scanField(const char *line, const char *key) {
+    const char *start = strstr(line, key);
+    if (start == NULL) {
+        return NULL;
+    }
+    start += strlen(key);
+    const char *end = start;
+    while (*end && *end != '"') {
+        if (*end == '\\' && end[1]) {
+            end++;
+        }
+        end++;
+    }
+    return strndup(start, end - start);
+}
+
+static uint64_t scanNumber(const char *line, const char *key) {
+    const char *start = strstr(line, key);
+    return start ? strtoull(start + strlen(key), NULL, 10) : 0;
+}
+
+static int compareRecords(const void *a, const void *b) {
+    const reportRecord_t *left = a;
+    const reportRecord_t *right = b;
+    int cmp = strcmp(left->file, right->file);
+    if (cmp == 0) {
+        cmp = strcmp(left->entry, right->entry);
+    }
+    if (cmp == 0) {
+        cmp = strcmp(left->name, right->name);
+    }
+    return cmp;
+}
+
+static int compareRecordIndices(const void *a, const void *b) {
+    int cmp = compareRecords(a, b);
+    if (cmp == 0) {
+        const reportRecord_t *left = a;
+        const reportRecord_t *right = b;
+        cmp = left->index < right->index ? -1 : left->index > right->index;
+    }
+    return cmp;
+}
+
+static int compareRecordOccurrences(const void *a, const void *b) {
+    int cmp = compareRecords(a, b);
+    if (cmp == 0) {
+        const reportRecord_t *left = a;
+        const reportRecord_t *right = b;
+        cmp = left->occurrence < right->occurrence ? -1 : left->occurrence > right->occurrence;
+    }
+    return cmp;
+}
+
+static void readReport(const char *reportFile, reportRecords_t *records) {
+    FILE *report = fopen(reportFile, "r");
+    if (report == NULL) {
+        perror(reportFile);
+        _exit(1);
+    }
+    reportRecords_init(records, 64);
+    char *line = NULL;
+    size_t capacity = 0;
+    while (getline(&line, &capacity, report) > 0) {
+        if (line[0] != '{') {
+            continue;
+        }
+        reportRecord_t record;
+        record.file = scanField(line, "\"file\":\"");
+        record.entry = scanField(line, "\"entry\":\"");
+        record.name = scanField(line, "\"name\":\"");
+        if (record.file == NULL || record.entry == NULL || record.name == NULL) {
+            fprintf(stderr, "%s: unexpected record %s", reportFile, line);
+            _exit(1);
+        }
+        record.passed = strstr(line, "\"status\":\"pass\"") != NULL;
+        record.gasUsed = scanNumber(line, "\"gasUsed\":");
+        record.nanos = scanNumber(line, "\"nanos\":");
+        record.ops = scanNumber(line, "\"ops\":");
+        record.index = records->num_reportRecords;
+        reportRecords_append(records, record);
+    }
+    free(line);
+    fclose(report);
+    qsort(records->reportRecords, records->num_reportRecords, sizeof(reportRecord_t), compareRecordIndices);
+    for (size_t i = 0; i < records->num_reportRecords; i++) {
+        records->reportRecords[i].occurrence = i && compareRecords(records->reportRecords + i - 1, records->reportRecords + i) == 0
+            ? records->reportRecords[i - 1].occurrence + 1
+            : 0;
+    }
+}
+
+static void freeReport(reportRecords_t *records) {
+    for (size_t i = 0; i < records->num_reportRecords; i++) {
+        free(records->reportRecords[i].file);
+        free(records->reportRecords[i].entry);
+        free(records->reportRecords[i].name);
+    }
+    reportRecords_destroy(records);
+}
+
+typedef struct regression {
+    const reportRecord_t *current;
+    uint64_t base;
+    uint64_t increase;
+} regression_t;
+
+VECTOR(regression, regressions);
+
+static int compareRegressions(const void *a, const void *b) {
+    const regression_t *left = a;
+    const regression_t *right = b;
+    return left->increase < right->increase ? 1 : left->increase > right->increase ? -1 : 0;
+}
+
+static void printRegressions(const char *heading, regressions_t *regressions, uint16_t top, const char *unit) {
+    if (regressions->num_regressions == 0) {
+        return;
+    }
+    qsort(regressions->regressions, regressions->num_regressions, sizeof(regression_t), compareRegressions);
+    printf("%s regressions (%zu):\n", heading, regressions->num_regressions);
+    for (size_t i = 0; i < regressions->num_regressions && i < top; i++) {
+        const regression_t *regression = regressions->regressions + i;
+        printf("  +%" PRIu64 "%s", regression->increase, unit);
+        if (regression->base) {
+            printf(" (+%.2f%%)", 100.0 * regression->increase / regression->base);
+        }
+        printf(" %s %s %s\n", regression->current->file, regression->current->entry, regression->current->name);
+    }
+}
+
+int reportCompare(const char *baseFile, const char *currentFile, uint16_t top, double thresholdPercent) {
+    reportRecords_t base;
+    reportRecords_t current;
+    readReport(baseFile, &base);
+    readReport(currentFile, &current);
+
+    regressions_t gas;
+    regressions_t time;
+    regressions_init(&gas, 16);
+    regressions_init(&time, 16);
+    int failed = 0;
+    size_t added = 0;
+    size_t matched = 0;
+    for (size_t i = 0; i < current.num_reportRecords; i++) {
+        const reportRecord_t *record = current.reportRecords + i;
+        const reportRecord_t *before = bsearch(record, base.reportRecords, base.num_reportRecords, sizeof(reportRecord_t), compareRecordOccurrences);
+        if (before == NULL) {
+            added++;
+            continue;
+        }
+        matched++;
+        if (before->passed && !record->passed) {
+            printf("now failing: %s %s %s\n", record->file, record->entry, record->name);
+            failed = 1;
+        }
+        if (record->gasUsed > before->gasUsed) {
+            regression_t regression = {record, before->gasUsed, record->gasUsed - before->gasUsed};
+            regressions_append(&gas, regression);
+            if (regression.increase > before->gasUsed * thresholdPercent / 100) {
+                failed = 1;
+            }
+        }
+        if (record->nanos > before->nanos) {
+            regression_t regression = {record, before->nanos, record->nanos - before->nanos};
+            regressions_append(&time, regression);
+        }
+    }
+    printRegressions("gas", &gas, top, "");
+    printRegressions("time", &time, top, "ns");
+    size_t missing = 0;
+    for (size_t i = 0; i < base.num_reportRecords; i++) {
+        if (!bsearch(base.reportRecords + i, current.reportRecords, current.num_reportRecords, sizeof(reportRecord_t), compareRecordOccurrences)) {
+            missing++;
+        }
+    }
+    printf("%zu compared, %zu new, %zu missing\n", matched, added, missing);
+
+    regressions_destroy(&gas);
+    regressions_destroy(&time);
+    freeReport(&base);
+    freeReport(&current);
+    return failed;
+}
@@ -35,9 +35,59 @@ void scanInit() {
     programCounter = (uint32_t)-1;
     inDataSection = false;
     lineNumber = 1;
+    labelCount = 0;
     labelQueueInit();
 }
 
+struct scanState {
+    uint32_t programCounter;
+    bool inDataSection;
+    uint32_t lineNumber;
+    node_t *head;
+    node_t **tail;
+    label_t labels[MAX_LABEL_COUNT];
+    uint32_t labelLocations[MAX_LABEL_COUNT];
+    uint16_t dataSizes[MAX_LABEL_COUNT];
+    uint32_t labelCount;
+    op_t scanstack[STACKSIZE];
+    op_t scanstackIndex;
+    label_t *labelstack[STACKSIZE];
+};
+
+scanState_t *scanSave() {
+    scanState_t *state = malloc(sizeof(scanState_t));
+    state->programCounter = programCounter;
+    state->inDataSection = inDataSection;
+    state->lineNumber = lineNumber;
+    state->head = head;
+    state->tail = tail;
+    memcpy(state->labels, labels, sizeof(labels));
+    memcpy(state->labelLocations, labelLocations, sizeof(labelLocations));
+    memcpy(state->dataSizes, dataSizes, sizeof(dataSizes));
+    state->labelCount = labelCount;
+    memcpy(state->scanstack, scanstack, sizeof(scanstack));
+    state->scanstackIndex = scanstackIndex;
+    memcpy(state->labelstack, labelstack, sizeof(labelstack));
+    return state;
+}
+
+void scanRestore(scanState_t *state) {
+    programCounter = state->programCounter;
+    inDataSection = state->inDataSection;
+    lineNumber = state->lineNumber;
+    head = state->head;
+    // an empty queue's tail points at head itself, which is the same global
+    tail = state->tail;
+    memcpy(labels, state->labels, sizeof(labels));
+    memcpy(labelLocations, state->labelLocations, sizeof(labelLocations));
+    memcpy(dataSizes, state->dataSizes, sizeof(dataSizes));
+    labelCount = state->labelCount;
+    memcpy(scanstack, state->scanstack, sizeof(scanstack));
+    scanstackIndex = state->scanstackIndex;
+    memcpy(labelstack, state->labelstack, sizeof(labelstack));
+    free(state);
+}
+
 int scanValid(const char **iter) {
     return **iter || !scanstackEmpty();
 }
@@ -0,0 +1,146 @@
+#include "bls12381.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "hex.h"
+
+static const char *g1GeneratorHex = "97f1d3a73197d7942695638c4fa9ac0fc3688c4f9774b905a14e3a3f171bac586c55e83ff97a1aeffb3af00adb22c6bb";
+static const char *g2GeneratorHex =
+    "93e02b6052719f607dacd3a088274f65596bd0d09920b61ab5da61bbdc7f5049334cf11213945d57e5ac7d055d042b7e"
+    "024aa2b2f08f0a91260805272dc51051c6e47ad4fa403b02b4510b647ae3d1770bac0326a805bbefd48056c8c121bdb8";
+// tau = 0x2a2ab1e5f00d5eed, as in tst/trusted_setup.txt
+static const uint8_t tau[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0x2a, 0x2a, 0xb1, 0xe5, 0xf0, 0x0d, 0x5e, 0xed,
+};
+static const char *tauG1Hex = "857724f08cc0c39cb3dfa57ee07e03e83228ae2c508338d685ae5f2dabe9d8a4136438b6137acd571a840d52d42825cf";
+static const char *tauG2Hex =
+    "8e27f5383e8032d3d66527c87bfd479d7fab795caa06f5c25fe234c73041341a748d4f3d6b0066e93f5c88cdafae8097"
+    "0bc779110aaf134109a6bcf6876989ce2034031fb6102cb2865b904b8da47601445d83db21e784085d8a4c8feefc6afa";
+static const char *infinityHex = "c00000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000";
+// x = 4 is on the curve but not in the prime order subgroup
+static const char *cofactorHex = "800000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000004";
+// x = p
+static const char *noncanonicalHex = "9a0111ea397fe69a4b1ba7b6434bacd764774b84f38512bf6730d2a0f6b0f6241eabfffeb153ffffb9feffffffffaaab";
+
+static void readHex(uint8_t *bytes, const char *hex, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = hexString16ToUint8(hex + i * 2);
+    }
+}
+
+void test_decompress() {
+    uint8_t compressed[96];
+    g1_t g1;
+    g2_t g2;
+
+    readHex(compressed, g1GeneratorHex, 48);
+    assert(g1Decompress(&g1, compressed));
+    assert(g1Equal(&g1, &g1Generator));
+
+    readHex(compressed, g2GeneratorHex, 96);
+    assert(g2Decompress(&g2, compressed));
+    assert(memcmp(&g2.x, &g2Generator.x, sizeof(fp2_t)) == 0);
+    assert(memcmp(&g2.y, &g2Generator.y, sizeof(fp2_t)) == 0);
+
+    readHex(compressed, infinityHex, 48);
+    assert(g1Decompress(&g1, compressed));
+    assert(g1.infinity);
+
+    readHex(compressed, cofactorHex, 48);
+    assert(!g1Decompress(&g1, compressed));
+    readHex(compressed, noncanonicalHex, 48);
+    assert(!g1Decompress(&g1, compressed));
+    // uncompressed flag
+    readHex(compressed, g1GeneratorHex, 48);
+    compressed[0] &= 0x7f;
+    assert(!g1Decompress(&g1, compressed));
+    // the other root
+    compressed[0] ^= 0xa0;
+    assert(g1Decompress(&g1, compressed));
+    g1_t negated;
+    g1Neg(&negated, &g1Generator);
+    assert(g1Equal(&g1, &negated));
+}
+
+void test_mul() {
+    uint8_t compressed[48];
+    g1_t expected, actual, sum;
+    readHex(compressed, tauG1Hex, 48);
+    assert(g1Decompress(&expected, compressed));
+
+    g1MulGenerator(&actual, tau);
+    assert(g1Equal(&expected, &actual));
+    g1Mul(&actual, &g1Generator, tau);
+    assert(g1Equal(&expected, &actual));
+
+    g1Neg(&actual, &actual);
+    g1Add(&sum, &expected, &actual);
+    assert(sum.infinity);
+
+    uint8_t two[32];
+    memset(two, 0, 32);
+    two[31] = 2;
+    g1Mul(&actual, &g1Generator, two);
+    g1Add(&sum, &g1Generator, &g1Generator);
+    assert(g1Equal(&sum, &actual));
+
+    // [tau]G1 + G1 + [2]G1
+    g1Add(&sum, &sum, &g1Generator);
+    g1Add(&sum, &sum, &expected);
+    g1LinearCombination(&actual, &g1Generator, &g1Generator, tau, two);
+    assert(g1Equal(&sum, &actual));
+}
+
+void test_pairing() {
+    uint8_t compressed[96];
+    g1_t tauG1, negatedGenerator;
+    g2_t tauG2;
+    readHex(compressed, tauG1Hex, 48);
+    assert(g1Decompress(&tauG1, compressed));
+    readHex(compressed, tauG2Hex, 96);
+    assert(g2Decompress(&tauG2, compressed));
+    g1Neg(&negatedGenerator, &g1Generator);
+
+    g2Prepared_t generatorPrepared, tauPrepared;
+    g2Prepare(&generatorPrepared, &g2Generator);
+    g2Prepare(&tauPrepared, &tauG2);
+
+    // e([tau]G1, G2) = e(G1, [tau]G2)
+    g1_t p[2] = {tauG1, negatedGenerator};
+    const g2Prepared_t *q[2] = {&generatorPrepared, &tauPrepared};
+    assert(pairingProductIsOne(p, q, 2));
+
+    // e(G1, G2) is not one
+    p[0] = g1Generator;
+    assert(!pairingProductIsOne(p, q, 1));
+    // e(G1, G2) e(-G1, [tau]G2) is not one
+    assert(!pairingProductIsOne(p, q, 2));
+    // e(G1, G2) e(-G1, G2) is one
+    q[1] = &generatorPrepared;
+    assert(pairingProductIsOne(p, q, 2));
+
+    // e(P, Q) e(P, Q) = e([2]P, Q)
+    g1_t doubled;
+    g1Add(&doubled, &tauG1, &tauG1);
+    g1Neg(p + 0, &doubled);
+    p[1] = tauG1;
+    g1_t three[3] = {tauG1, tauG1, p[0]};
+    const g2Prepared_t *same[3] = {&tauPrepared, &tauPrepared, &tauPrepared};
+    assert(pairingProductIsOne(three, same, 3));
+
+    // infinity pairs to one
+    g1_t infinity;
+    memset(&infinity, 0, sizeof(infinity));
+    infinity.infinity = true;
+    assert(pairingProductIsOne(&infinity, q, 1));
+}
+
+int main() {
+    bls12381Init();
+    test_decompress();
+    test_mul();
+    test_pairing();
+    return 0;
+}
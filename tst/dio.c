@@ -3,6 +3,11 @@
 
 
 #include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 void test_applyConfig_code() {
@@ -239,13 +244,427 @@ void test_applyConfig_tests() {
     evmFinalize();
 }
 
+void test_loadConfigsParallel() {
+    int rw[2];
+    pipe(rw);
+    int savedStderr = dup(2);
+    dup2(rw[1], 2);
+    close(rw[1]);
+    evmInit();
+    // echo finishes first but is printed second
+    char *const configFiles[] = {"tst/quine.json", "tst/missing.json", "tst/echo.json"};
+    int failed = loadConfigsParallel(configFiles, 3, false, 3);
+    dup2(savedStderr, 2);
+    close(savedStderr);
+    assert(failed);
+
+    char output[1024];
+    ssize_t red = read(rw[0], output, sizeof(output) - 1);
+    close(rw[0]);
+    assert(red > 0);
+    output[red] = 0;
+    const char expected[] =
+        "# tst/in/quine.evm\n"
+        "no calldata: \033[0;32mpass\033[0m\n"
+        "ignores calldata: \033[0;32mpass\033[0m\n"
+        "tst/missing.json: No such file or directory\n"
+        "# tst/in/echo.evm\n"
+        "echo: \033[0;32mpass\033[0m\n"
+        "space: \033[0;32mpass\033[0m\n"
+        "two spaces: \033[0;32mpass\033[0m\n"
+        "newline: \033[0;32mpass\033[0m\n";
+    assert(strcmp(output, expected) == 0);
+}
+
+void test_loadConfigsParallel_base() {
+    evmInit();
+    const char base[] =
+        "["
+        "    {"
+        "        \"address\":\"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "        \"code\":\"0x60015f54015f555f545f5260205ff3\","
+        "        \"storage\": {\"0x0\": \"0x41\"}"
+        "    }"
+        "]";
+    applyConfig(base);
+
+    // each worker increments its own copy of the counter
+    char configFile[] = "/tmp/dioXXXXXX";
+    int fd = mkstemp(configFile);
+    assert(fd != -1);
+    const char config[] =
+        "["
+        "    {"
+        "        \"tests\": ["
+        "            {"
+        "                \"to\": \"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "                \"output\": \"0x0000000000000000000000000000000000000000000000000000000000000042\""
+        "            }"
+        "        ]"
+        "    }"
+        "]";
+    assert(write(fd, config, sizeof(config) - 1) == sizeof(config) - 1);
+    close(fd);
+
+    int savedStderr = dup(2);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, 2);
+    close(devNull);
+    char *const configFiles[] = {configFile, configFile, configFile};
+    int failed = loadConfigsParallel(configFiles, 3, false, 2);
+    dup2(savedStderr, 2);
+    close(savedStderr);
+    unlink(configFile);
+    assert(!failed);
+
+    // the workers did not change the base state
+    address_t from;
+    val_t val;
+    val[0] = 0;
+    val[1] = 0;
+    val[2] = 0;
+    data_t input;
+    input.size = 0;
+    result_t result = txCall(from, 100000, AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0"), val, input, NULL);
+    assert(result.returnData.size == 32);
+    assert(result.returnData.content[31] == 0x42);
+
+    evmFinalize();
+}
+
+// returns the stderr of the run
+static char *loadConfigCaptured(char *const configFile) {
+    char outputFile[] = "/tmp/dioOutputXXXXXX";
+    int fd = mkstemp(outputFile);
+    assert(fd != -1);
+    unlink(outputFile);
+    int savedStderr = dup(2);
+    dup2(fd, 2);
+    char *const configFiles[] = {configFile};
+    int failed = loadConfigsParallel(configFiles, 1, false, 1);
+    dup2(savedStderr, 2);
+    close(savedStderr);
+    assert(!failed);
+    char *output = calloc(1024, 1);
+    assert(pread(fd, output, 1023, 0) > 0);
+    close(fd);
+    return output;
+}
+
+// entryPath receives the path of the last entry
+static uint32_t countEntries(const char *directory, char entryPath[PATH_MAX]) {
+    DIR *dir = opendir(directory);
+    uint32_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] != '.') {
+            count++;
+            assert(snprintf(entryPath, PATH_MAX, "%s/%s", directory, entry->d_name) < PATH_MAX);
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+void test_resultCache() {
+    evmInit();
+    const char base[] =
+        "["
+        "    {"
+        "        \"address\":\"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "        \"code\":\"0x60015f54015f555f545f5260205ff3\","
+        "        \"storage\": {\"0x0\": \"0x41\"}"
+        "    }"
+        "]";
+    applyConfig(base);
+
+    char configFile[] = "/tmp/dioXXXXXX";
+    int fd = mkstemp(configFile);
+    assert(fd != -1);
+    const char config[] =
+        "["
+        "    {"
+        "        \"tests\": ["
+        "            {"
+        "                \"name\": \"counted\","
+        "                \"to\": \"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "                \"output\": \"0x0000000000000000000000000000000000000000000000000000000000000042\""
+        "            }"
+        "        ]"
+        "    }"
+        "]";
+    assert(write(fd, config, sizeof(config) - 1) == sizeof(config) - 1);
+    close(fd);
+    char directory[] = "/tmp/dioResultsXXXXXX";
+    assert(mkdtemp(directory));
+    setResultCache(directory, "test", false);
+
+    char *output = loadConfigCaptured(configFile);
+    assert(strstr(output, "\ncounted: \033[0;32mpass\033[0m\n"));
+    free(output);
+    char entryPath[PATH_MAX];
+    assert(countEntries(directory, entryPath) == 1);
+
+    // replayed without running
+    FILE *entry = fopen(entryPath, "r+");
+    char contents[256];
+    size_t length = fread(contents, 1, sizeof(contents) - 1, entry);
+    contents[length] = '\0';
+    assert(strncmp(contents, "0\n", 2) == 0);
+    char *counted = strstr(contents, "counted");
+    assert(counted);
+    fseek(entry, counted - contents, SEEK_SET);
+    fputc('C', entry);
+    fclose(entry);
+    output = loadConfigCaptured(configFile);
+    assert(strstr(output, "\nCounted: \033[0;32mpass\033[0m\n"));
+    free(output);
+
+    // a different starting state misses
+    val_t balance;
+    balance[0] = 0;
+    balance[1] = 0;
+    balance[2] = 1;
+    evmMockBalance(AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0"), balance);
+    output = loadConfigCaptured(configFile);
+    assert(strstr(output, "\ncounted: \033[0;32mpass\033[0m\n"));
+    free(output);
+    assert(countEntries(directory, entryPath) == 2);
+
+    // rerun ignores the cached output
+    setResultCache(directory, "test", true);
+    balance[2] = 0;
+    evmMockBalance(AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0"), balance);
+    output = loadConfigCaptured(configFile);
+    assert(strstr(output, "\ncounted: \033[0;32mpass\033[0m\n"));
+    free(output);
+
+    setResultCache(NULL, NULL, false);
+    unlink(configFile);
+    char command[64];
+    snprintf(command, sizeof(command), "rm -r %s", directory);
+    assert(system(command) == 0);
+    evmFinalize();
+}
+
+void test_timing() {
+    evmInit();
+    const char base[] =
+        "["
+        "    {"
+        "        \"address\":\"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "        \"code\":\"0x60015f54015f555f545f5260205ff3\","
+        "        \"storage\": {\"0x0\": \"0x41\"}"
+        "    }"
+        "]";
+    applyConfig(base);
+
+    char configFile[] = "/tmp/dioXXXXXX";
+    int fd = mkstemp(configFile);
+    assert(fd != -1);
+    const char config[] =
+        "["
+        "    {"
+        "        \"tests\": ["
+        "            {"
+        "                \"name\": \"first\","
+        "                \"to\": \"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "                \"output\": \"0x0000000000000000000000000000000000000000000000000000000000000042\""
+        "            },"
+        "            {"
+        "                \"name\": \"second\","
+        "                \"to\": \"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "                \"output\": \"0x0000000000000000000000000000000000000000000000000000000000000043\""
+        "            }"
+        "        ]"
+        "    }"
+        "]";
+    assert(write(fd, config, sizeof(config) - 1) == sizeof(config) - 1);
+    close(fd);
+
+    // the repeated runs leave only the effects of the last
+    setTiming(true, 2, 10);
+    char *output = loadConfigCaptured(configFile);
+    assert(strstr(output, "\nfirst: \033[0;32mpass\033[0m\n    "));
+    assert(strstr(output, "\nsecond: \033[0;32mpass\033[0m\n    "));
+    assert(strstr(output, " over 10 runs\n"));
+    free(output);
+
+    setTiming(true, 0, 0);
+    output = loadConfigCaptured(configFile);
+    assert(strstr(output, "\nfirst: \033[0;32mpass\033[0m\n    "));
+    assert(strstr(output, " Mgas/s)\n"));
+    assert(!strstr(output, " runs\n"));
+    free(output);
+
+    setTiming(false, 0, 0);
+    unlink(configFile);
+    evmFinalize();
+}
+
+void test_serveRequests() {
+    evmInit();
+    const char base[] =
+        "["
+        "    {"
+        "        \"address\":\"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\","
+        "        \"code\":\"0x60015f54015f555f545f5260205ff3\","
+        "        \"storage\": {\"0x0\": \"0x41\"}"
+        "    }"
+        "]";
+    applyConfig(base);
+
+    const char requests[] =
+        "{\"name\":\"first\",\"to\":\"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\"}\n"
+        "\n"
+        "not json\n"
+        "{\"name\":\"second\",\"to\":\"0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0\"}\n"
+        "{\"input\":\"0x60015ff3\"}";
+    FILE *in = fmemopen((void *)requests, sizeof(requests) - 1, "r");
+    char *responses;
+    size_t responsesSize;
+    FILE *out = open_memstream(&responses, &responsesSize);
+    serveRequests(in, out, false);
+    fclose(in);
+    fclose(out);
+
+    // each request starts from the same world state
+    const char expected[] =
+        "{\"name\":\"first\",\"gasUsed\":26125,\"logs\":{},\"status\":\"0x0000000000000000000000000000000000000000000000000000000000000001\",\"returnData\":\"0x0000000000000000000000000000000000000000000000000000000000000042\"}\n"
+        "{\"error\":\"expected one JSON object per line\"}\n"
+        "{\"name\":\"second\",\"gasUsed\":26125,\"logs\":{},\"status\":\"0x0000000000000000000000000000000000000000000000000000000000000001\",\"returnData\":\"0x0000000000000000000000000000000000000000000000000000000000000042\"}\n"
+        "{\"gasUsed\":53274,\"logs\":{},\"status\":\"0x000000000000000000000000bd770416a3345f91e4b34576cb804a576fa48eb1\",\"returnData\":\"0x00\"}\n";
+    assert(strcmp(responses, expected) == 0);
+    free(responses);
+    evmFinalize();
+}
+
+void test_serveRequests_commit() {
+    evmInit();
+    const char requests[] =
+        "{\"name\":\"deploy\",\"input\":\"0x600f600a5f39600f5ff360015f54015f555f545f5260205ff3\"}\n"
+        "{\"name\":\"first\",\"to\":\"0xbd770416a3345f91e4b34576cb804a576fa48eb1\"}\n"
+        "{\"name\":\"second\",\"to\":\"0xbd770416a3345f91e4b34576cb804a576fa48eb1\"}\n";
+    FILE *in = fmemopen((void *)requests, sizeof(requests) - 1, "r");
+    char *responses;
+    size_t responsesSize;
+    FILE *out = open_memstream(&responses, &responsesSize);
+    requestStats_t stats = serveRequests(in, out, true);
+    fclose(in);
+    fclose(out);
+
+    // storage is kept between transactions, but is cold again for each
+    const char expected[] =
+        "{\"name\":\"deploy\",\"gasUsed\":56424,\"logs\":{},\"status\":\"0x000000000000000000000000bd770416a3345f91e4b34576cb804a576fa48eb1\",\"returnData\":\"0x60015f54015f555f545f5260205ff3\"}\n"
+        "{\"name\":\"first\",\"gasUsed\":43225,\"logs\":{},\"status\":\"0x0000000000000000000000000000000000000000000000000000000000000001\",\"returnData\":\"0x0000000000000000000000000000000000000000000000000000000000000001\"}\n"
+        "{\"name\":\"second\",\"gasUsed\":26125,\"logs\":{},\"status\":\"0x0000000000000000000000000000000000000000000000000000000000000001\",\"returnData\":\"0x0000000000000000000000000000000000000000000000000000000000000002\"}\n";
+    assert(strcmp(responses, expected) == 0);
+    assert(stats.transactions == 3);
+    assert(stats.gasUsed == 56424 + 43225 + 26125);
+    free(responses);
+    evmFinalize();
+}
+
+void test_serveRequests_recovery() {
+    evmInit();
+    const char base[] =
+        "["
+        "    {"
+        "        \"address\":\"0xc1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1\","
+        "        \"code\":\"0x435f5260205ff3\""
+        "    }"
+        "]";
+    applyConfig(base);
+
+    const char requests[] =
+        "{\"name\":\"tab\there\",\"blockNumber\":\"0x10\",\"to\":\"0xc1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1\"}\n"
+        "{\"name\":\"bad\",\"isolate\":maybe,\"to\":\"0xc1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1\"}\n"
+        "{\"name\":\"after\",\"to\":\"0xc1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1c1\"}\n";
+    FILE *in = fmemopen((void *)requests, sizeof(requests) - 1, "r");
+    char *responses;
+    size_t responsesSize;
+    FILE *out = open_memstream(&responses, &responsesSize);
+    int savedStderr = dup(2);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, 2);
+    close(devNull);
+    requestStats_t stats = serveRequests(in, out, true);
+    dup2(savedStderr, 2);
+    close(savedStderr);
+    fclose(in);
+    fclose(out);
+
+    // the malformed request is answered without stopping the server, and the block override does not outlive its request
+    const char expected[] =
+        "{\"name\":\"tab\\u0009here\",\"gasUsed\":21015,\"logs\":{},\"status\":\"0x0000000000000000000000000000000000000000000000000000000000000001\",\"returnData\":\"0x0000000000000000000000000000000000000000000000000000000000000010\"}\n"
+        "{\"error\":\"malformed request\"}\n"
+        "{\"name\":\"after\",\"gasUsed\":21015,\"logs\":{},\"status\":\"0x0000000000000000000000000000000000000000000000000000000000000001\",\"returnData\":\"0x00000000000000000000000000000000000000000000000000000000013a2228\"}\n";
+    assert(strcmp(responses, expected) == 0);
+    assert(stats.transactions == 2);
+    free(responses);
+    evmFinalize();
+}
+
+#define BATCH_SENDERS 1100
+
+static void countAccount(void *context, const address_t *address, const val_t balance, uint64_t nonce, const data_t *code) {
+    (*(uint32_t *)context)++;
+}
+
+static void countSlot(void *context, const address_t *address, const uint256_t *key, const uint256_t *value) {
+}
+
+void test_serveRequests_manySenders() {
+    evmInit();
+    char *requests;
+    size_t requestsSize;
+    FILE *batch = open_memstream(&requests, &requestsSize);
+    fputs("{\"input\":\"0x600f600a5f39600f5ff360015f54015f555f545f5260205ff3\"}\n", batch);
+    // each sender is a new account
+    for (uint32_t i = 0; i < BATCH_SENDERS; i++) {
+        fprintf(batch, "{\"from\":\"0xacacacacacacacacacacacacacacacac%08x\",\"to\":\"0xbd770416a3345f91e4b34576cb804a576fa48eb1\"}\n", i);
+    }
+    fclose(batch);
+    FILE *in = fmemopen(requests, requestsSize, "r");
+    char *responses;
+    size_t responsesSize;
+    FILE *out = open_memstream(&responses, &responsesSize);
+    requestStats_t stats = serveRequests(in, out, true);
+    fclose(in);
+    fclose(out);
+
+    assert(stats.transactions == BATCH_SENDERS + 1);
+    // the counter was incremented once per sender
+    const char last[] = "\"returnData\":\"0x000000000000000000000000000000000000000000000000000000000000044c\"}\n";
+    assert(responsesSize > sizeof(last));
+    assert(strcmp(responses + responsesSize - (sizeof(last) - 1), last) == 0);
+    // with the coinbase and the counter
+    uint32_t accounts = 0;
+    stateVisitor_t visitor;
+    visitor.context = &accounts;
+    visitor.account = countAccount;
+    visitor.storage = countSlot;
+    evmVisitState(&visitor);
+    assert(accounts == BATCH_SENDERS + 2);
+    free(requests);
+    free(responses);
+    evmFinalize();
+}
+
 int main() {
-    pathInit("bin/evm");
 
     test_applyConfig_code();
     test_applyConfig_storage();
     test_applyConfig_balance();
     test_applyConfig_construct();
+    test_loadConfigsParallel();
+    test_loadConfigsParallel_base();
+    test_resultCache();
+    test_timing();
+    test_serveRequests();
+    test_serveRequests_commit();
+    test_serveRequests_recovery();
+    test_serveRequests_manySenders();
 
     close(2);
     test_applyConfig_constructTest();
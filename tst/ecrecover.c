@@ -0,0 +1,177 @@
+#include "ecrecover.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// from tst/ecrecover.json
+static const char *signedHex =
+    "456e9aea5e197a1f1af7a3e85a3212fa4049a3ba34c2289b4c860fc0b0c64ef3"
+    "000000000000000000000000000000000000000000000000000000000000001c"
+    "9242685bf161793cc25603c231bc2f568eb630ea16aa137d2664ac80388256084"
+    "f8ae3bd7535248d0bd448298cc2e2071e56992d0774dc340c368ae950852ada";
+
+static void readInput(uint8_t input[128]) {
+    for (int i = 0; i < 128; i++) {
+        input[i] = hexString16ToUint8(signedHex + i * 2);
+    }
+}
+
+void test_recover() {
+    ecrecoverResetStats();
+    uint8_t input[128];
+    readInput(input);
+    address_t expected = AddressFromHex42("0x7156526fbd7a3c72969b54f64e42c10fbb768c8a");
+    address_t signer;
+
+    assert(ecrecover(input, &signer));
+    assert(AddressEqual(&expected, &signer));
+    ecrecoverStats_t stats = ecrecoverStats();
+    assert(stats.cacheHits == 0);
+    assert(stats.cacheMisses == 1);
+
+    bzero(&signer, sizeof(signer));
+    assert(ecrecover(input, &signer));
+    assert(AddressEqual(&expected, &signer));
+    stats = ecrecoverStats();
+    assert(stats.cacheHits == 1);
+    assert(stats.cacheMisses == 1);
+}
+
+void test_invalidV() {
+    ecrecoverResetStats();
+    uint8_t input[128];
+    readInput(input);
+    address_t signer;
+    input[63] = 29;
+    assert(!ecrecover(input, &signer));
+    input[63] = 28;
+    input[40] = 1;
+    assert(!ecrecover(input, &signer));
+    ecrecoverStats_t stats = ecrecoverStats();
+    assert(stats.cacheHits == 0);
+    assert(stats.cacheMisses == 0);
+}
+
+void test_eviction() {
+    ecrecoverResetStats();
+    uint8_t input[128];
+    readInput(input);
+    address_t signer;
+    assert(ecrecover(input, &signer));
+    assert(ecrecoverStats().cacheMisses == 0);
+
+    // r = 0 fails quickly
+    uint8_t junk[128];
+    bzero(junk, sizeof(junk));
+    junk[63] = 27;
+    for (uint32_t i = 0; i < 5000; i++) {
+        memcpy(junk, &i, sizeof(i));
+        assert(!ecrecover(junk, &signer));
+        if (i % 1000 == 0) {
+            // keep the valid signature recent
+            assert(ecrecover(input, &signer));
+        }
+    }
+    ecrecoverStats_t stats = ecrecoverStats();
+    assert(stats.cacheHits == 6);
+    assert(stats.cacheMisses == 5000);
+
+    // junk 0 was evicted
+    bzero(junk, sizeof(junk));
+    junk[63] = 27;
+    assert(!ecrecover(junk, &signer));
+    assert(ecrecoverStats().cacheMisses == 5001);
+}
+
+void test_recoverSenders() {
+    secp256k1_context *signer = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+    size_t count = 300;
+    txSignature_t *signatures = calloc(count, sizeof(txSignature_t));
+    address_t *expected = calloc(count, sizeof(address_t));
+    for (size_t i = 0; i < count; i++) {
+        uint8_t seckey[32];
+        bzero(seckey, 32);
+        seckey[30] = (i + 1) >> 8;
+        seckey[31] = i + 1;
+        signatures[i].hash[0] = i;
+        signatures[i].hash[31] = 0x5a;
+        secp256k1_ecdsa_recoverable_signature sig;
+        assert(secp256k1_ecdsa_sign_recoverable(signer, &sig, signatures[i].hash, seckey, NULL, NULL));
+        uint8_t rs[64];
+        int recid;
+        secp256k1_ecdsa_recoverable_signature_serialize_compact(signer, rs, &recid, &sig);
+        memcpy(signatures[i].r, rs, 32);
+        memcpy(signatures[i].s, rs + 32, 32);
+        switch (i % 3) {
+        case 0:
+            signatures[i].v = recid;
+            break;
+        case 1:
+            signatures[i].v = 27 + recid;
+            break;
+        case 2:
+            // EIP-155 mainnet
+            signatures[i].v = 37 + recid;
+            break;
+        }
+
+        secp256k1_pubkey pubkey;
+        assert(secp256k1_ec_pubkey_create(signer, &pubkey, seckey));
+        uint8_t pubkeyBytes[65];
+        size_t pubkeyLen = 65;
+        secp256k1_ec_pubkey_serialize(signer, pubkeyBytes, &pubkeyLen, &pubkey, SECP256K1_EC_UNCOMPRESSED);
+        uint8_t pubkeyHash[32];
+        keccak_256(pubkeyHash, 32, pubkeyBytes + 1, 64);
+        memcpy(expected[i].address, pubkeyHash + 12, 20);
+    }
+    secp256k1_context_destroy(signer);
+    // invalid
+    signatures[100].v = 29;
+    bzero(signatures[200].r, 32);
+    // EIP-155 for chain 5
+    signatures[50].v = 45 + signatures[50].v - 37;
+    // the same signature with s negated and the parity flipped recovers the same key, but EIP-2 rejects it
+    static const uint8_t order[32] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+        0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b, 0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41,
+    };
+    int borrow = 0;
+    for (int i = 31; i >= 0; i--) {
+        int diff = order[i] - signatures[150].s[i] - borrow;
+        signatures[150].s[i] = diff;
+        borrow = diff < 0;
+    }
+    signatures[150].v ^= 1;
+
+    address_t *senders = calloc(count, sizeof(address_t));
+    bool *valid = calloc(count, sizeof(bool));
+    for (uint16_t threads = 0; threads < 5; threads++) {
+        bzero(senders, count * sizeof(address_t));
+        txRecoverSenders(signatures, count, 1, senders, valid, threads);
+        for (size_t i = 0; i < count; i++) {
+            if (i == 50 || i == 100 || i == 150 || i == 200) {
+                assert(!valid[i]);
+                assert(AddressZero(senders + i));
+            } else {
+                assert(valid[i]);
+                assert(AddressEqual(expected + i, senders + i));
+            }
+        }
+    }
+    txRecoverSenders(signatures, 0, 1, senders, valid, 4);
+
+    free(signatures);
+    free(expected);
+    free(senders);
+    free(valid);
+}
+
+int main() {
+    ecrecoverInit();
+    test_recover();
+    test_invalidV();
+    test_eviction();
+    test_recoverSenders();
+    return 0;
+}
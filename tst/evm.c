@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -1465,6 +1466,101 @@ void test_deepCall() {
     evmFinalize();
 }
 
+// asserts that the contract at 0xee..ee, which returns the EXTCODEHASH of the address in its calldata, returns expected
+static void assertExtCodeHash(address_t address, const uint8_t expected[32]) {
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    address_t to = AddressFromHex42("0xeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeee");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+    uint8_t param[32];
+    bzero(param, 12);
+    memcpy(param + 12, address.address, 20);
+    data_t input;
+    input.content = param;
+    input.size = sizeof(param);
+    result_t result = txCall(from, 100000, to, value, input, NULL);
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 32);
+    assert(memcmp(result.returnData.content, expected, 32) == 0);
+}
+
+void test_extcodehash() {
+    evmInit();
+
+    op_t code[] = { PUSH0, CALLDATALOAD, EXTCODEHASH, PUSH0, MSTORE, PUSH1, 32, PUSH0, RETURN };
+    data_t codeData;
+    codeData.content = code;
+    codeData.size = sizeof(code);
+    address_t to = AddressFromHex42("0xeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeee");
+    evmMockCode(to, codeData);
+    uint8_t expected[32];
+    keccak_256(expected, 32, code, sizeof(code));
+    assertExtCodeHash(to, expected);
+
+    // an identical clone
+    address_t clone = AddressFromHex42("0xcccccccccccccccccccccccccccccccccccccccc");
+    evmMockCode(clone, codeData);
+    assertExtCodeHash(clone, expected);
+
+    // EIP-1052: empty accounts hash to zero and accounts without code to the hash of nothing
+    address_t empty = AddressFromHex42("0xdddddddddddddddddddddddddddddddddddddddd");
+    bzero(expected, 32);
+    assertExtCodeHash(empty, expected);
+    val_t balance;
+    balance[0] = balance[1] = 0;
+    balance[2] = 1;
+    evmMockBalance(empty, balance);
+    keccak_256(expected, 32, NULL, 0);
+    assertExtCodeHash(empty, expected);
+
+    data_t noCode;
+    noCode.content = NULL;
+    noCode.size = 0;
+    evmMockCode(to, noCode);
+    evmMockCode(clone, noCode);
+    evmFinalize();
+}
+
+void test_internedCodes() {
+    evmInit();
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+    data_t empty;
+    empty.content = NULL;
+    empty.size = 0;
+    // unlike the code of other tests
+    op_t code[] = { PUSH2, 0xc1, 0x0e, POP, PUSH1, 7, JUMP, JUMPDEST, STOP };
+    uint32_t interned = evmInternedCodes();
+
+    // clones share the analysis of their code
+    address_t clones[2] = {
+        AddressFromHex42("0xc10ec10ec10ec10ec10ec10ec10ec10ec10ec10e"),
+        AddressFromHex42("0xc20ec20ec20ec20ec20ec20ec20ec20ec20ec20e"),
+    };
+    for (uint8_t i = 0; i < 2; i++) {
+        data_t codeData;
+        codeData.size = sizeof(code);
+        codeData.content = malloc(sizeof(code));
+        memcpy(codeData.content, code, sizeof(code));
+        evmMockCode(clones[i], codeData);
+        result_t result = txCall(from, 100000, clones[i], value, empty, NULL);
+        assert(LOWER(LOWER(result.status)) == 1);
+        assert(evmInternedCodes() == interned + 1);
+    }
+
+    // initcode is analyzed by its frame
+    op_t jumpingInitcode[] = { PUSH2, 0xc3, 0x0e, POP, PUSH1, 7, JUMP, JUMPDEST, PUSH0, PUSH0, RETURN };
+    data_t initcode;
+    initcode.content = jumpingInitcode;
+    initcode.size = sizeof(jumpingInitcode);
+    result_t created = txCreate(from, 100000, value, initcode);
+    assert(!zero256(&created.status));
+    assert(evmInternedCodes() == interned + 1);
+
+    evmFinalize();
+}
+
 void test_revertStorage() {
     evmInit();
 
@@ -2404,6 +2500,46 @@ void test_stackOverflow() {
     evmFinalize();
 }
 
+void test_callDepthLimit() {
+    evmInit();
+
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    address_t to = AddressFromHex42("0xeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeee");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+
+    // MSTORE(0, ADD(1, MLOAD(0) after CALL(GAS, ADDRESS, 0, 0, 0, 0, 32))); RETURN(0, 32)
+    op_t code[] = {
+        PUSH1, 32, PUSH0, PUSH0, PUSH0, PUSH0, ADDRESS, GAS, CALL, POP,
+        PUSH0, MLOAD, PUSH1, 1, ADD, PUSH0, MSTORE, PUSH1, 32, PUSH0, RETURN
+    };
+    data_t codeData;
+    codeData.content = code;
+    codeData.size = sizeof(code);
+    evmMockCode(to, codeData);
+
+    data_t empty;
+    empty.content = NULL;
+    empty.size = 0;
+    assertStderr(
+        "Call depth limit reached\n",
+        result_t result = txCall(from, 0xffffffffffff, to, value, empty, NULL)
+    );
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 32);
+    uint256_t depth;
+    readu256BE(result.returnData.content, &depth);
+    // the frames at depths 0 through 1024
+    assert(UPPER(UPPER(depth)) == 0);
+    assert(LOWER(UPPER(depth)) == 0);
+    assert(UPPER(LOWER(depth)) == 0);
+    assert(LOWER(LOWER(depth)) == 1025);
+    evmFreeStateChanges(result.stateChanges);
+
+    evmMockCode(to, empty);
+    evmFinalize();
+}
+
 // JUMP to a 0x5b byte that is PUSH1 data → exceptional halt
 void test_jumpDestInsidePush() {
     evmInit();
@@ -2523,6 +2659,578 @@ void test_jumpForwardScan(op_t PUSHx) {
     evmFinalize();
 }
 
+static uint64_t duplicateGas(const data_t *input) {
+    return 7 * input->size;
+}
+
+static precompileResult_t duplicateExecute(const data_t *input, data_t *output) {
+    if (output->size < 2 * input->size) {
+        output->size = 2 * input->size;
+        return PRECOMPILE_OUTPUT_TOO_SMALL;
+    }
+    output->size = 2 * input->size;
+    memcpy(output->content, input->content, input->size);
+    memcpy(output->content + input->size, input->content, input->size);
+    return PRECOMPILE_SUCCEEDED;
+}
+
+static precompileResult_t failExecute(const data_t *input, data_t *output) {
+    return PRECOMPILE_FAILED;
+}
+
+void test_mockPrecompile() {
+    evmInit();
+    precompileHandler_t duplicate = {"duplicate", duplicateGas, duplicateExecute};
+    precompileHandler_t fail = {"fail", duplicateGas, failExecute};
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    address_t mock = AddressFromHex42("0x00000000000000000000000000000000000ca11e");
+    address_t sha256 = AddressFromHex42("0x0000000000000000000000000000000000000002");
+    val_t value;
+    value[0] = 0;
+    value[1] = 0;
+    value[2] = 0;
+    op_t callData[100];
+    memset(callData, 0x11, sizeof(callData));
+    data_t input;
+    input.content = callData;
+    input.size = sizeof(callData);
+    uint64_t gas = 100000;
+    uint64_t intrinsicGas = 21000 + 16 * sizeof(callData);
+
+    evmMockPrecompile(mock, duplicate);
+    result_t result = txCall(from, gas, mock, value, input, NULL);
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 200);
+    assert(memcmp(result.returnData.content, callData, 100) == 0);
+    assert(memcmp(result.returnData.content + 100, callData, 100) == 0);
+    assert(result.gasRemaining == gas - intrinsicGas - 700);
+
+    // builtin addresses can be replaced
+    evmMockPrecompile(sha256, fail);
+    result = txCall(from, gas, sha256, value, input, NULL);
+    assert(LOWER(LOWER(result.status)) == 0);
+    assert(result.returnData.size == 0);
+    assert(result.gasRemaining == 0);
+
+    // mocks last until evmInit
+    evmInit();
+    assertStderr("Unsupported precompile SHA2_256\n", result = txCall(from, gas, sha256, value, input, NULL));
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 0);
+    result = txCall(from, gas, mock, value, input, NULL);
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 0);
+    assert(result.gasRemaining == gas - intrinsicGas);
+
+    evmFinalize();
+}
+
+#define INSTANCE_THREADS 4
+#define INSTANCE_CALLS 200
+
+static void *countCalls(void *arg) {
+    evm_t *evm = arg;
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    address_t to = AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+    data_t empty;
+    empty.content = NULL;
+    empty.size = 0;
+    result_t result;
+    for (uint16_t i = 0; i < INSTANCE_CALLS; i++) {
+        result = txCall_r(evm, from, 100000, to, value, empty, NULL);
+        assert(LOWER(LOWER(result.status)) == 1);
+    }
+    assert(result.returnData.size == 32);
+    return (void *)(uintptr_t)result.returnData.content[31];
+}
+
+void test_instances() {
+    op_t code[] = {
+        PUSH0, SLOAD, PUSH1, 1, ADD,
+        DUP1, PUSH0, SSTORE,
+        PUSH0, MSTORE,
+        PUSH1, 32, PUSH0, RETURN,
+    };
+    address_t to = AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0");
+    evmInit();
+
+    evm_t *evms[INSTANCE_THREADS];
+    pthread_t threads[INSTANCE_THREADS];
+    for (uint8_t i = 0; i < INSTANCE_THREADS; i++) {
+        evms[i] = evmNew();
+        // each instance frees its code
+        data_t codeData;
+        codeData.size = sizeof(code);
+        codeData.content = malloc(sizeof(code));
+        memcpy(codeData.content, code, sizeof(code));
+        evmMockCode_r(evms[i], to, codeData);
+        // the counter of each instance starts at its index
+        uint256_t slot, start;
+        clear256(&slot);
+        clear256(&start);
+        LOWER(LOWER(start)) = i;
+        evmMockStorage_r(evms[i], to, &slot, &start);
+        assert(pthread_create(threads + i, NULL, countCalls, evms[i]) == 0);
+    }
+    for (uint8_t i = 0; i < INSTANCE_THREADS; i++) {
+        void *count;
+        pthread_join(threads[i], &count);
+        assert((uintptr_t)count == i + INSTANCE_CALLS);
+        evmFree(evms[i]);
+    }
+    evmFinalize();
+}
+
+static uint8_t callCounter(address_t to) {
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+    data_t empty;
+    empty.content = NULL;
+    empty.size = 0;
+    result_t result = txCall(from, 100000, to, value, empty, NULL);
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 32);
+    return result.returnData.content[31];
+}
+
+void test_snapshot() {
+    evmInit();
+    op_t code[] = {
+        PUSH0, SLOAD, PUSH1, 1, ADD,
+        DUP1, PUSH0, SSTORE,
+        PUSH0, MSTORE,
+        PUSH1, 32, PUSH0, RETURN,
+    };
+    address_t to = AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0");
+    data_t codeData;
+    codeData.size = sizeof(code);
+    codeData.content = malloc(sizeof(code));
+    memcpy(codeData.content, code, sizeof(code));
+    evmMockCode(to, codeData);
+
+    address_t from = AddressFromHex42("0x0000000000000000000000000000000000000000");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+    // 60015ff3
+    op_t returnStop[] = {
+        PUSH1, 1, PUSH0, RETURN,
+    };
+    data_t initcode;
+    initcode.content = returnStop;
+    initcode.size = sizeof(returnStop);
+
+    assert(evmSnapshot() == 0);
+    assert(callCounter(to) == 1);
+    assert(callCounter(to) == 2);
+
+    assert(evmSnapshot() == 1);
+    assert(callCounter(to) == 3);
+    result_t created = txCreate(from, 100000, value, initcode);
+    assert(!zero256(&created.status));
+    uint256_t createdAddress;
+    copy256(&createdAddress, &created.status);
+
+    // the creator nonce is restored so the same address is created again
+    evmRestore(1);
+    assert(callCounter(to) == 3);
+    created = txCreate(from, 100000, value, initcode);
+    assert(equal256(&created.status, &createdAddress));
+
+    evmRestore(0);
+    assert(callCounter(to) == 1);
+    evmRestore(0);
+    assert(callCounter(to) == 1);
+    created = txCreate(from, 100000, value, initcode);
+    assert(equal256(&created.status, &createdAddress));
+
+    // releasing keeps the current state
+    evmRelease(0);
+    assert(callCounter(to) == 2);
+
+    evmFinalize();
+}
+
+static uint64_t loadSlot(address_t to, uint64_t slot) {
+    uint8_t calldata[32];
+    bzero(calldata, 24);
+    for (uint8_t i = 0; i < 8; i++) {
+        calldata[31 - i] = slot >> (i * 8);
+    }
+    data_t input;
+    input.content = calldata;
+    input.size = sizeof(calldata);
+    address_t from = AddressFromHex42("0x0000000000000000000000000000000000000000");
+    val_t value;
+    value[0] = value[1] = value[2] = 0;
+    result_t result = txCall(from, 100000, to, value, input, NULL);
+    assert(result.returnData.size == 32);
+    uint64_t loaded = 0;
+    for (uint8_t i = 24; i < 32; i++) {
+        loaded = loaded << 8 | result.returnData.content[i];
+    }
+    return loaded;
+}
+
+void test_storageTable() {
+    evmInit();
+    op_t code[] = {
+        PUSH0, CALLDATALOAD, SLOAD,
+        PUSH0, MSTORE,
+        PUSH1, 32, PUSH0, RETURN,
+    };
+    address_t to = AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0");
+    data_t codeData;
+    codeData.size = sizeof(code);
+    codeData.content = malloc(sizeof(code));
+    memcpy(codeData.content, code, sizeof(code));
+    evmMockCode(to, codeData);
+
+    // grown past the reservation
+    evmReserveStorage(to, 100);
+    uint256_t key, stored;
+    for (uint64_t i = 0; i < 1000; i++) {
+        clear256(&key);
+        LOWER(LOWER(key)) = i * 0x10001;
+        clear256(&stored);
+        LOWER(LOWER(stored)) = i + 1;
+        evmMockStorage(to, &key, &stored);
+    }
+    assert(loadSlot(to, 0) == 1);
+    assert(loadSlot(to, 999 * 0x10001) == 1000);
+    assert(loadSlot(to, 1) == 0);
+
+    evmSnapshot();
+    clear256(&key);
+    LOWER(LOWER(stored)) = 7;
+    evmMockStorage(to, &key, &stored);
+    for (uint64_t i = 1000; i < 2000; i++) {
+        LOWER(LOWER(key)) = i * 0x10001;
+        evmMockStorage(to, &key, &stored);
+    }
+    assert(loadSlot(to, 0) == 7);
+    assert(loadSlot(to, 1999 * 0x10001) == 7);
+    evmRestore(0);
+    assert(loadSlot(to, 0) == 1);
+    assert(loadSlot(to, 500 * 0x10001) == 501);
+    assert(loadSlot(to, 1999 * 0x10001) == 0);
+    evmRelease(0);
+
+    evmFinalize();
+}
+
+#define MANY_ACCOUNTS 1100
+
+static address_t manyAccount(uint32_t i) {
+    address_t address = AddressFromHex42("0xacacacacacacacacacacacacacacacac00000000");
+    address.address[16] = i >> 24;
+    address.address[17] = i >> 16;
+    address.address[18] = i >> 8;
+    address.address[19] = i;
+    return address;
+}
+
+typedef struct accountTally {
+    uint32_t accounts;
+    // the sum of the mocked balances
+    uint64_t balances;
+} accountTally_t;
+
+static void tallyAccount(void *context, const address_t *address, const val_t balance, uint64_t nonce, const data_t *code) {
+    accountTally_t *tally = context;
+    tally->accounts++;
+    if (address->address[0] == 0xac) {
+        tally->balances += balance[2];
+    }
+}
+
+static void tallyStorage(void *context, const address_t *address, const uint256_t *key, const uint256_t *value) {
+}
+
+static accountTally_t tallyAccounts(evm_t *instance) {
+    accountTally_t tally;
+    bzero(&tally, sizeof(tally));
+    stateVisitor_t visitor;
+    visitor.context = &tally;
+    visitor.account = tallyAccount;
+    visitor.storage = tallyStorage;
+    evmVisitState_r(instance, &visitor);
+    return tally;
+}
+
+void test_manyAccounts() {
+    evm_t *instance = evmNew();
+    val_t balance;
+    balance[0] = balance[1] = 0;
+    for (uint32_t i = 0; i < MANY_ACCOUNTS; i++) {
+        balance[2] = i;
+        evmMockBalance_r(instance, manyAccount(i), balance);
+    }
+    // with the coinbase
+    accountTally_t tally = tallyAccounts(instance);
+    assert(tally.accounts == MANY_ACCOUNTS + 1);
+    assert(tally.balances == MANY_ACCOUNTS * (MANY_ACCOUNTS - 1) / 2);
+
+    // mocking again finds each account rather than adding it
+    for (uint32_t i = 0; i < MANY_ACCOUNTS; i++) {
+        balance[2] = 1;
+        evmMockBalance_r(instance, manyAccount(i), balance);
+    }
+    tally = tallyAccounts(instance);
+    assert(tally.accounts == MANY_ACCOUNTS + 1);
+    assert(tally.balances == MANY_ACCOUNTS);
+
+    // accounts added after a snapshot are found again after the restore adds them back
+    evmSnapshot_r(instance);
+    for (uint32_t i = MANY_ACCOUNTS; i < 3 * MANY_ACCOUNTS; i++) {
+        evmMockBalance_r(instance, manyAccount(i), balance);
+    }
+    assert(tallyAccounts(instance).accounts == 3 * MANY_ACCOUNTS + 1);
+    evmRestore_r(instance, 0);
+    assert(tallyAccounts(instance).accounts == MANY_ACCOUNTS + 1);
+    for (uint32_t i = 0; i < 2 * MANY_ACCOUNTS; i++) {
+        evmMockBalance_r(instance, manyAccount(i), balance);
+    }
+    tally = tallyAccounts(instance);
+    assert(tally.accounts == 2 * MANY_ACCOUNTS + 1);
+    assert(tally.balances == 2 * MANY_ACCOUNTS);
+    evmRelease_r(instance, 0);
+    evmFree(instance);
+}
+
+static uint64_t logWord(const receipt_t *receipt, uint8_t word) {
+    assert(receipt->stateChanges != NULL);
+    const logChanges_t *log = receipt->stateChanges->logChanges;
+    assert(log != NULL && log->data.size == 9 * 32);
+    uint64_t loaded = 0;
+    for (uint8_t i = 24; i < 32; i++) {
+        loaded = loaded << 8 | log->data.content[word * 32 + i];
+    }
+    return loaded;
+}
+
+void test_txSenders() {
+    // from tst/ecrecover.json
+    const char *signedHex =
+        "456e9aea5e197a1f1af7a3e85a3212fa4049a3ba34c2289b4c860fc0b0c64ef3"
+        "9242685bf161793cc25603c231bc2f568eb630ea16aa137d2664ac80388256084"
+        "f8ae3bd7535248d0bd448298cc2e2071e56992d0774dc340c368ae950852ada";
+    txSignature_t signatures[3];
+    for (uint8_t i = 0; i < 32; i++) {
+        signatures[0].hash[i] = hexString16ToUint8(signedHex + i * 2);
+        signatures[0].r[i] = hexString16ToUint8(signedHex + 64 + i * 2);
+        signatures[0].s[i] = hexString16ToUint8(signedHex + 128 + i * 2);
+    }
+    signatures[0].v = 28;
+    signatures[1] = signatures[0];
+    signatures[1].v = EVM_CHAIN_ID * 2 + 36;
+    // another chain
+    signatures[2] = signatures[0];
+    signatures[2].v = (EVM_CHAIN_ID + 1) * 2 + 36;
+
+    address_t senders[3];
+    bool valid[3];
+    txSenders(signatures, 3, senders, valid, 1);
+    address_t expected = AddressFromHex42("0x7156526fbd7a3c72969b54f64e42c10fbb768c8a");
+    assert(valid[0] && AddressEqual(&expected, senders + 0));
+    assert(valid[1] && AddressEqual(&expected, senders + 1));
+    assert(!valid[2] && AddressZero(senders + 2));
+}
+
+void test_executeBlock() {
+    evmInit();
+    op_t code[] = {
+        ORIGIN, BALANCE, MSIZE, MSTORE,
+        COINBASE, BALANCE, MSIZE, MSTORE,
+        GASPRICE, MSIZE, MSTORE,
+        BASEFEE, MSIZE, MSTORE,
+        GASLIMIT, MSIZE, MSTORE,
+        PREVRANDAO, MSIZE, MSTORE,
+        NUMBER, MSIZE, MSTORE,
+        TIMESTAMP, MSIZE, MSTORE,
+        COINBASE, MSIZE, MSTORE,
+        MSIZE, PUSH0, LOG0,
+    };
+    address_t to = AddressFromHex42("0xc0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0");
+    data_t codeData;
+    codeData.size = sizeof(code);
+    codeData.content = malloc(sizeof(code));
+    memcpy(codeData.content, code, sizeof(code));
+    evmMockCode(to, codeData);
+
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    val_t balance;
+    balance[0] = 0;
+    balance[1] = 1;
+    balance[2] = 0;
+    evmMockBalance(from, balance);
+
+    blockHeader_t header;
+    header.number = 100;
+    header.timestamp = 1234;
+    header.gasLimit = 100000;
+    header.baseFee = 7;
+    header.coinbase = AddressFromHex42("0xc0ffeec0ffeec0ffeec0ffeec0ffeec0ffeec0ff");
+    clear256(&header.prevRandao);
+    LOWER(LOWER(header.prevRandao)) = 0x5eed;
+
+    blockTransaction_t transactions[5];
+    bzero(transactions, sizeof(transactions));
+    for (uint8_t i = 0; i < 5; i++) {
+        transactions[i].from = from;
+        transactions[i].to = to;
+        transactions[i].gas = 30000;
+        transactions[i].maxFeePerGas = 10;
+        transactions[i].maxPriorityFeePerGas = 2;
+    }
+    // below the base fee
+    transactions[1].maxFeePerGas = 6;
+    // unfunded
+    transactions[2].from = AddressFromHex42("0x0000000000000000000000000000000000000001");
+    // above the remaining block gas
+    transactions[3].gas = 80000;
+    // priority fee capped by the max fee
+    transactions[4].maxFeePerGas = 8;
+
+    receipt_t receipts[5];
+    uint64_t blockGasUsed;
+    assertStderr(
+        "Skipping transaction 1: max fee 6 below base fee 7\n"
+        "Skipping transaction 2: insufficient balance for gas and value\n"
+        "Skipping transaction 3: gas 80000 exceeds remaining block gas 76027\n",
+        blockGasUsed = evmExecuteBlock(&header, transactions, 5, receipts)
+    );
+
+    assert(receipts[0].included);
+    assert(LOWER(LOWER(receipts[0].status)) == 1);
+    assert(receipts[0].gasUsed == 23973);
+    assert(receipts[0].cumulativeGasUsed == 23973);
+    // the gas is paid upfront
+    assert(logWord(receipts + 0, 0) == 0x100000000 - 30000 * 9);
+    assert(logWord(receipts + 0, 1) == 0);
+    assert(logWord(receipts + 0, 2) == 9);
+    assert(logWord(receipts + 0, 3) == 7);
+    assert(logWord(receipts + 0, 4) == 100000);
+    assert(logWord(receipts + 0, 5) == 0x5eed);
+    assert(logWord(receipts + 0, 6) == 100);
+    assert(logWord(receipts + 0, 7) == 1234);
+
+    for (uint8_t i = 1; i < 4; i++) {
+        assert(!receipts[i].included);
+        assert(receipts[i].gasUsed == 0);
+        assert(receipts[i].cumulativeGasUsed == 23973);
+        assert(receipts[i].stateChanges == NULL);
+    }
+
+    assert(receipts[4].included);
+    assert(receipts[4].gasUsed == 23973);
+    assert(receipts[4].cumulativeGasUsed == 47946);
+    assert(blockGasUsed == 47946);
+    // the unused gas was refunded and the base fee burned
+    assert(logWord(receipts + 4, 0) == 0x100000000 - 23973 * 9 - 30000 * 8);
+    assert(logWord(receipts + 4, 1) == 23973 * 2);
+    assert(logWord(receipts + 4, 2) == 8);
+
+    evmFreeStateChanges(receipts[0].stateChanges);
+    evmFreeStateChanges(receipts[4].stateChanges);
+    evmFinalize();
+}
+
+static address_t indexedAddress(uint8_t prefix, uint16_t index) {
+    address_t address;
+    bzero(address.address, 20);
+    address.address[0] = prefix;
+    address.address[18] = index >> 8;
+    address.address[19] = index;
+    return address;
+}
+
+#define SIMULATED 9
+
+typedef struct remoteState {
+    uint16_t rounds;
+    uint16_t requests;
+} remoteState_t;
+
+// contract i of 0xd0 returns the sum of its slots 0 and 1, holding i and 2i, except the last, which proxies contract 1
+static void fetchRemote(void *context, stateRequest_t *requests, uint32_t count) {
+    remoteState_t *remote = context;
+    remote->rounds++;
+    remote->requests += count;
+    op_t sum[] = {
+        PUSH0, SLOAD, PUSH1, 1, SLOAD, ADD, PUSH0, MSTORE, PUSH1, 32, PUSH0, RETURN,
+    };
+    op_t proxy[] = {
+        PUSH0, PUSH0, PUSH0, PUSH0, PUSH20,
+        0xd0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+        GAS, STATICCALL, POP,
+        RETURNDATASIZE, PUSH0, PUSH0, RETURNDATACOPY, RETURNDATASIZE, PUSH0, RETURN,
+    };
+    for (uint32_t i = 0; i < count; i++) {
+        stateRequest_t *request = requests + i;
+        uint8_t index = request->address.address[19];
+        if (request->address.address[0] != 0xd0) {
+            continue;
+        }
+        if (request->slot) {
+            LOWER(LOWER(request->value)) = (LOWER(LOWER(request->key)) + 1) * index;
+        } else if (index == SIMULATED) {
+            request->code.size = sizeof(proxy);
+            request->code.content = malloc(sizeof(proxy));
+            memcpy(request->code.content, proxy, sizeof(proxy));
+        } else {
+            request->code.size = sizeof(sum);
+            request->code.content = malloc(sizeof(sum));
+            memcpy(request->code.content, sum, sizeof(sum));
+        }
+    }
+}
+
+static void simulate(uint16_t width, remoteState_t *remote) {
+    evm_t *instance = evmNew();
+    uint8_t before[32], after[32];
+    evmStateDigest_r(instance, before);
+
+    blockTransaction_t transactions[SIMULATED];
+    bzero(transactions, sizeof(transactions));
+    for (uint16_t i = 0; i < SIMULATED; i++) {
+        transactions[i].from = indexedAddress(0xe0, 0);
+        transactions[i].to = indexedAddress(0xd0, i + 1);
+        transactions[i].gas = 100000;
+    }
+    result_t results[SIMULATED];
+    bzero(remote, sizeof(remoteState_t));
+    evmSimulate_r(instance, transactions, SIMULATED, results, width, fetchRemote, remote);
+
+    for (uint16_t i = 0; i < SIMULATED; i++) {
+        assert(LOWER(LOWER(results[i].status)) == 1);
+        assert(results[i].returnData.size == 32);
+        assert(results[i].returnData.content[31] == (i + 1 < SIMULATED ? 3 * (i + 1) : 3));
+        free(results[i].returnData.content);
+        evmFreeStateChanges(results[i].stateChanges);
+    }
+    evmStateDigest_r(instance, after);
+    assert(memcmp(before, after, 32) == 0);
+    evmFree(instance);
+}
+
+void test_simulate() {
+    remoteState_t remote;
+    // each miss is a round trip, though answers are kept for later transactions
+    simulate(1, &remote);
+    assert(remote.rounds == 26);
+    assert(remote.requests == 26);
+    // a width of 0 runs one at a time
+    simulate(0, &remote);
+    assert(remote.rounds == 26);
+    // the sender, then each contract, then each slot
+    simulate(SIMULATED, &remote);
+    assert(remote.rounds == 4);
+    assert(remote.requests == 26);
+}
+
 int main() {
     test_stop();
     test_mstoreReturn();
@@ -2548,6 +3256,8 @@ int main() {
     test_callBounce();
     test_coinbase();
     test_extcodecopy();
+    test_extcodehash();
+    test_internedCodes();
     test_deepCall();
     test_revertStorage();
     test_revertSload();
@@ -2558,6 +3268,7 @@ int main() {
     test_createRevertRollback();
     test_returnDataCopyOOB();
     test_stackOverflow();
+    test_callDepthLimit();
     test_jumpDestInsidePush();
     test_jumpiDestInsidePush();
     test_staticcallSstore();
@@ -2565,6 +3276,14 @@ int main() {
     test_createOutOfGas();
     test_create2();
     test_create2InsufficientBalance();
+    test_mockPrecompile();
+    test_instances();
+    test_snapshot();
+    test_storageTable();
+    test_manyAccounts();
+    test_txSenders();
+    test_executeBlock();
+    test_simulate();
 
     for (op_t PUSHx = PUSH0; PUSHx <= PUSH32; PUSHx++) {
         test_jumpForwardScan(PUSHx);
@@ -1,6 +1,7 @@
 #include "hex.h"
 
 #include <assert.h>
+#include <string.h>
 
 int main() {
     for (char a = 'a'; a <= 'f'; a++) {
@@ -16,5 +17,15 @@ int main() {
     const char thirtySix[] = "24";
     uint8_t parsedThirtySix = hexString16ToUint8(thirtySix);
     assert(parsedThirtySix == 36);
+
+    const char code[] = "0123456789abcdefABCDEF60fF5b";
+    uint8_t decoded[14];
+    for (size_t length = 0; length <= sizeof(decoded); length++) {
+        memset(decoded, 0xee, sizeof(decoded));
+        hexDecode(decoded, code, length);
+        for (size_t i = 0; i < sizeof(decoded); i++) {
+            assert(decoded[i] == (i < length ? hexString16ToUint8(code + i * 2) : 0xee));
+        }
+    }
     return 0;
 }
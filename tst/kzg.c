@@ -0,0 +1,108 @@
+#include "kzg.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hex.h"
+
+// p(x) = 0x1234567 + 0xdeadbeef x + 0x42 x^2 + 7 x^3 committed under tst/trusted_setup.txt
+static const char *inputHex =
+    "016cdeacbd541da4cafa8dcc936b764a01dd844f6f95b81b647199616a14c2a8"
+    "003a3b3c3d3e3f404142434445464748494a4b4c4d4e4f505152535455565758"
+    "1a4ff0f10fef9bf377098bd631e89ce21f9d09004f00784092164a0905f7236f"
+    "94df39c13b9579d445fc2d7dd915d8d7f10a732f114304f3eaf67f7219fb85507adfee659e17775f58bd047e515b3429"
+    "860a2e916789bbee6551042465de46818d1a5d77335a63817beaf018a5c65a1ac9457ada57d29e897ac39f04d48b600e";
+
+static void readInput(uint8_t input[192]) {
+    for (int i = 0; i < 192; i++) {
+        input[i] = hexString16ToUint8(inputHex + i * 2);
+    }
+}
+
+void test_loadTrustedSetup() {
+    assert(!kzgTrustedSetupLoaded());
+    // silence the expected complaints
+    int savedStderr = dup(2);
+    freopen("/dev/null", "w", stderr);
+    assert(!kzgLoadTrustedSetup("tst/missing_trusted_setup.txt"));
+    assert(!kzgLoadTrustedSetup("tst/kzg.json"));
+    fflush(stderr);
+    dup2(savedStderr, 2);
+    close(savedStderr);
+    assert(!kzgTrustedSetupLoaded());
+
+    uint8_t input[192];
+    readInput(input);
+    assert(!kzgVerifyPointEvaluation(input));
+
+    assert(kzgLoadTrustedSetup("tst/trusted_setup.txt"));
+    assert(kzgTrustedSetupLoaded());
+}
+
+void test_verify() {
+    kzgResetStats();
+    uint8_t input[192];
+    readInput(input);
+    assert(kzgVerifyPointEvaluation(input));
+    kzgStats_t stats = kzgStats();
+    assert(stats.verifications == 1);
+    assert(stats.verifyNanos > 0);
+
+    // wrong y
+    input[95] ^= 1;
+    assert(!kzgVerifyPointEvaluation(input));
+    readInput(input);
+
+    // wrong z
+    input[63] ^= 1;
+    assert(!kzgVerifyPointEvaluation(input));
+    readInput(input);
+
+    // y not a field element
+    memcpy(input + 64, kzgPointEvaluationReturn + 32, 32);
+    assert(!kzgVerifyPointEvaluation(input));
+    readInput(input);
+
+    // the commitment as its own proof
+    memcpy(input + 144, input + 96, 48);
+    assert(!kzgVerifyPointEvaluation(input));
+    readInput(input);
+
+    // versioned hash version
+    input[0] = 0x02;
+    assert(!kzgVerifyPointEvaluation(input));
+
+    assert(kzgStats().verifications == 6);
+}
+
+// the EIP-4844 point evaluation precompile vector that go-ethereum also tests, under the mainnet setup
+static const char *mainnetInputHex =
+    "01e798154708fe7789429634053cbf9f99b619f9f084048927333fce637f549b"
+    "564c0a11a0f704f4fc3e8acfe0f8245f0ad1347b378fbf96e206da11a5d36306"
+    "24d25032e67a7e6a4910df5834b8fe70e6bcfeeac0352434196bdf4b2485d5a1"
+    "8f59a8d2a1a625a17f3fea0fe5eb8c896db3764f3185481bc22f91b4aaffcca25f26936857bc3a7c2539ea8ec3a952b7"
+    "873033e038326e87ed3e1276fd140253fa08e9fc25fb2d9a98527fc22a2c9612fbeafdad446cbc7bcdbdcd780af2c16a";
+
+void test_mainnet() {
+    uint8_t input[192];
+    for (int i = 0; i < 192; i++) {
+        input[i] = hexString16ToUint8(mainnetInputHex + i * 2);
+    }
+    // only verifies under the mainnet setup
+    assert(!kzgVerifyPointEvaluation(input));
+    assert(kzgLoadTrustedSetup("tst/mainnet_trusted_setup_g2.txt"));
+    assert(kzgVerifyPointEvaluation(input));
+
+    // wrong y
+    input[95] ^= 1;
+    assert(!kzgVerifyPointEvaluation(input));
+}
+
+int main() {
+    test_loadTrustedSetup();
+    test_verify();
+    test_mainnet();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "data.h"
+#include "path.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// distinct mtimes, since rewrites within a test can land in the same clock tick
+static void writeSource(const char *path, const char *contents, time_t mtime) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd != -1);
+    assert(write(fd, contents, strlen(contents)) == (ssize_t)strlen(contents));
+    struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+    assert(futimens(fd, times) == 0);
+    close(fd);
+}
+
+static void assertCode(data_t actual, const char *expected) {
+    data_t wanted = assembleSource(expected, WRAP_NONE);
+    assert(DataEqual(&wanted, &actual));
+    free(wanted.content);
+    free(actual.content);
+}
+
+static uint32_t countEntries(const char *directory) {
+    DIR *dir = opendir(directory);
+    assert(dir);
+    uint32_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(dir);
+    return count;
+}
+
+void test_nested() {
+    writeSource("loop.evm", "top:\ntop JUMP\n", 1);
+    writeSource(
+        "outer.evm",
+        "done JUMP\ndone:\nCODECOPY(0, inner, #inner)\nRETURN(0, #inner)\n{ inner: assemble loop.evm }\n",
+        1
+    );
+    const char *inlined = "done JUMP\ndone:\nCODECOPY(0, inner, #inner)\nRETURN(0, #inner)\n{ inner: 0x5b600056 }\n";
+
+    // the enclosing scan keeps its labels across the nested assembly
+    assertCode(assemblePath("outer.evm"), inlined);
+    // cached
+    assertCode(assemblePath("outer.evm"), inlined);
+
+    // modifying the nested file invalidates the file assembling it
+    writeSource("loop.evm", "top:\nPUSH0 top JUMP\n", 2);
+    assertCode(assemblePath("outer.evm"), "done JUMP\ndone:\nCODECOPY(0, inner, #inner)\nRETURN(0, #inner)\n{ inner: 0x5b5f600056 }\n");
+
+    data_t constructor = defaultConstructorForPath("loop.evm");
+    data_t expected = assembleSource("top:\nPUSH0 top JUMP\n", WRAP_MIN_CONSTRUCTOR);
+    assert(DataEqual(&expected, &constructor));
+    free(expected.content);
+    free(constructor.content);
+}
+
+void test_diskCache() {
+    assert(mkdir("cache", 0755) == 0);
+    setenv("EVM_ASSEMBLY_CACHE", "cache", 1);
+    writeSource("caller.evm", "SELFDESTRUCT(CALLER)\n", 1);
+    assertCode(assemblePath("caller.evm"), "SELFDESTRUCT(CALLER)");
+    assert(countEntries("cache") == 1);
+
+    // entries are keyed by content, so a touched file is served from disk
+    DIR *dir = opendir("cache");
+    struct dirent *entry;
+    while ((entry = readdir(dir))->d_name[0] == '.');
+    char entryPath[128];
+    snprintf(entryPath, sizeof(entryPath), "cache/%s", entry->d_name);
+    closedir(dir);
+    writeSource(entryPath, "0\n00", 1);
+    writeSource("caller.evm", "SELFDESTRUCT(CALLER)\n", 2);
+    assertCode(assemblePath("caller.evm"), "STOP");
+
+    // new contents miss
+    writeSource("caller.evm", "SELFDESTRUCT(ORIGIN)\n", 3);
+    assertCode(assemblePath("caller.evm"), "SELFDESTRUCT(ORIGIN)");
+    assert(countEntries("cache") == 2);
+    unsetenv("EVM_ASSEMBLY_CACHE");
+}
+
+int main() {
+    char directory[] = "/tmp/evm-path-XXXXXX";
+    assert(mkdtemp(directory));
+    assert(chdir(directory) == 0);
+
+    test_nested();
+    test_diskCache();
+
+    char command[64];
+    snprintf(command, sizeof(command), "rm -r %s", directory);
+    assert(system(command) == 0);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include "image.h"
+#include "provider.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CONTRACT "0x7a2e6b4f0c1d3e5f7a9b8c6d4e2f0a1b3c5d7e9f"
+
+// returns the first slot and the balance
+static const char contractFile[] =
+    "account 0x3e8 0x1 0x5f545f524760205260405ff3\n"
+    "slot 0x0000000000000000000000000000000000000000000000000000000000000000 0x2a\n";
+
+static void writeContract(const char *dir) {
+    char path[PATH_MAX];
+    assert(snprintf(path, sizeof(path), "%s/" CONTRACT, dir) < PATH_MAX);
+    FILE *file = fopen(path, "w");
+    assert(file != NULL);
+    fputs(contractFile, file);
+    fclose(file);
+}
+
+static void removeDir(const char *dir) {
+    DIR *entries = opendir(dir);
+    assert(entries != NULL);
+    struct dirent *entry;
+    while ((entry = readdir(entries)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            char path[PATH_MAX];
+            assert(snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) < PATH_MAX);
+            unlink(path);
+        }
+    }
+    closedir(entries);
+    rmdir(dir);
+}
+
+static size_t countLines(const char *path) {
+    FILE *file = fopen(path, "r");
+    assert(file != NULL);
+    size_t lines = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(file);
+    return lines;
+}
+
+static void callContract(stateProvider_t *provider) {
+    evmSetStateProvider(provider);
+    evmInit();
+    address_t from = AddressFromHex42("0x4a6f6B9fF1fc974096f9063a45Fd12bD5B928AD1");
+    address_t to = AddressFromHex42(CONTRACT);
+    val_t value;
+    value[0] = 0;
+    value[1] = 0;
+    value[2] = 0;
+    data_t input;
+    input.size = 0;
+    input.content = NULL;
+    result_t result = txCall(from, 100000, to, value, input, NULL);
+    assert(LOWER(LOWER(result.status)) == 1);
+    assert(result.returnData.size == 64);
+    assert(result.returnData.content[31] == 0x2a);
+    assert(result.returnData.content[62] == 0x03);
+    assert(result.returnData.content[63] == 0xe8);
+    evmFreeStateChanges(result.stateChanges);
+    evmFinalize();
+    evmSetStateProvider(NULL);
+}
+
+void test_directoryProvider() {
+    char dir[] = "/tmp/providerXXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    writeContract(dir);
+    stateProvider_t provider = directoryProvider(dir);
+    callContract(&provider);
+    providerFree(&provider);
+    removeDir(dir);
+}
+
+void test_rpcProvider() {
+    char remote[] = "/tmp/providerRemoteXXXXXX";
+    assert(mkdtemp(remote) != NULL);
+    writeContract(remote);
+    char log[] = "/tmp/providerLogXXXXXX";
+    int fd = mkstemp(log);
+    assert(fd != -1);
+    close(fd);
+    char cache[] = "/tmp/providerCacheXXXXXX";
+    assert(mkdtemp(cache) != NULL);
+    // created by rpcProvider
+    rmdir(cache);
+    char command[256];
+    snprintf(command, sizeof(command), "sh tst/stand-in.sh %s %s", remote, log);
+
+    stateProvider_t provider = rpcProvider(command, cache);
+    callContract(&provider);
+    providerFree(&provider);
+    size_t requests = countLines(log);
+    assert(requests >= 2);
+    char cached[PATH_MAX];
+    assert(snprintf(cached, sizeof(cached), "%s/" CONTRACT, cache) < PATH_MAX);
+    assert(countLines(cached) == 2);
+
+    // answered from the cache without starting the command
+    provider = rpcProvider(command, cache);
+    callContract(&provider);
+    providerFree(&provider);
+    assert(countLines(log) == requests);
+
+    unlink(log);
+    removeDir(remote);
+    removeDir(cache);
+}
+
+void test_imageProvider() {
+    evmInit();
+    uint8_t code[] = {0x5f, 0x54, 0x5f, 0x52, 0x47, 0x60, 0x20, 0x52, 0x60, 0x40, 0x5f, 0xf3};
+    data_t codeData;
+    codeData.content = code;
+    codeData.size = sizeof(code);
+    val_t balance;
+    balance[0] = 0;
+    balance[1] = 0;
+    balance[2] = 0x3e8;
+    uint256_t key;
+    clear256(&key);
+    uint256_t value;
+    clear256(&value);
+    LOWER(LOWER(value)) = 0x2a;
+    // sharing its code
+    address_t twin = AddressFromHex42("0xeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeee");
+    address_t contract = AddressFromHex42(CONTRACT);
+    evmMockCode(twin, codeData);
+    evmMockCode(contract, codeData);
+    evmMockBalance(contract, balance);
+    evmMockNonce(contract, 1);
+    evmMockStorage(contract, &key, &value);
+    // omitted with its value
+    LOWER(LOWER(key)) = 1;
+    clear256(&value);
+    evmMockStorage(contract, &key, &value);
+
+    char path[] = "/tmp/providerImageXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    FILE *file = fdopen(fd, "w");
+    assert(evmWriteImage(file));
+    assert(fclose(file) == 0);
+    data_t empty;
+    empty.content = NULL;
+    empty.size = 0;
+    evmMockCode(twin, empty);
+    evmMockCode(contract, empty);
+    evmFinalize();
+
+    file = fopen(path, "r");
+    imageHeader_t header;
+    assert(fread(&header, sizeof(header), 1, file) == 1);
+    fclose(file);
+    // with the coinbase and its empty code
+    assert(header.accountCount == 3);
+    assert(header.codeCount == 2);
+    assert(header.slotCount == 1);
+    assert(header.codeBytes == sizeof(code));
+
+    stateProvider_t provider = imageProvider(path);
+    callContract(&provider);
+    providerFree(&provider);
+    unlink(path);
+}
+
+static void storedSlotIs(stateProvider_t *store, uint64_t key, uint64_t expected) {
+    address_t contract = AddressFromHex42(CONTRACT);
+    uint256_t slot;
+    clear256(&slot);
+    LOWER(LOWER(slot)) = key;
+    uint256_t value;
+    clear256(&value);
+    store->storage(store->context, &contract, &slot, &value);
+    assert(UPPER(UPPER(value)) == 0);
+    assert(LOWER(UPPER(value)) == 0);
+    assert(UPPER(LOWER(value)) == 0);
+    assert(LOWER(LOWER(value)) == expected);
+}
+
+// sets the slots from first to first + count - 1 to their key plus offset and commits them
+static void commitSlots(stateProvider_t *store, uint64_t first, uint64_t count, uint64_t offset) {
+    evmSetStateProvider(store);
+    evmInit();
+    address_t contract = AddressFromHex42(CONTRACT);
+    for (uint64_t i = first; i < first + count; i++) {
+        uint256_t key;
+        clear256(&key);
+        LOWER(LOWER(key)) = i;
+        uint256_t value;
+        clear256(&value);
+        LOWER(LOWER(value)) = i + offset;
+        evmMockStorage(contract, &key, &value);
+    }
+    storeCommit(store);
+    evmFinalize();
+    evmSetStateProvider(NULL);
+}
+
+void test_storeProvider() {
+    char dir[] = "/tmp/providerStoreXXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    char log[sizeof(dir) + 4];
+    snprintf(log, sizeof(log), "%s/log", dir);
+
+    stateProvider_t store = storeProvider(dir);
+    evmSetStateProvider(&store);
+    evmInit();
+    uint8_t code[] = {0x5f, 0x54, 0x5f, 0x52, 0x47, 0x60, 0x20, 0x52, 0x60, 0x40, 0x5f, 0xf3};
+    data_t codeData;
+    codeData.content = code;
+    codeData.size = sizeof(code);
+    val_t balance;
+    balance[0] = 0;
+    balance[1] = 0;
+    balance[2] = 0x3e8;
+    address_t contract = AddressFromHex42(CONTRACT);
+    evmMockCode(contract, codeData);
+    evmMockBalance(contract, balance);
+    evmMockNonce(contract, 1);
+    // so the image outweighs a few changes
+    uint8_t stops[1024];
+    bzero(stops, sizeof(stops));
+    data_t stopsData;
+    stopsData.content = stops;
+    stopsData.size = sizeof(stops);
+    address_t stopper = AddressFromHex42("0xeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeee");
+    evmMockCode(stopper, stopsData);
+    // the first commit writes the image
+    storeCommit(&store);
+    data_t empty;
+    empty.content = NULL;
+    empty.size = 0;
+    evmMockCode(contract, empty);
+    evmMockCode(stopper, empty);
+    evmFinalize();
+    evmSetStateProvider(NULL);
+    commitSlots(&store, 0, 2, 0x2a);
+    // and the line of the commit
+    assert(countLines(log) == 3);
+    providerFree(&store);
+
+    // replayed from the log, without the commit interrupted by a crash
+    FILE *file = fopen(log, "a");
+    fputs(CONTRACT " slot 0x1 0x0\n", file);
+    fputs(CONTRACT " slot 0x0 0x", file);
+    fclose(file);
+    store = storeProvider(dir);
+    assert(countLines(log) == 3);
+    callContract(&store);
+    storedSlotIs(&store, 1, 0x2b);
+    commitSlots(&store, 1, 1, -1);
+    storedSlotIs(&store, 1, 0);
+    assert(countLines(log) == 5);
+
+    // folded into the image once the log grows larger
+    commitSlots(&store, 2, 64, 1);
+    assert(countLines(log) == 0);
+    providerFree(&store);
+    char image[sizeof(dir) + 6];
+    snprintf(image, sizeof(image), "%s/image", dir);
+    file = fopen(image, "r");
+    imageHeader_t header;
+    assert(fread(&header, sizeof(header), 1, file) == 1);
+    fclose(file);
+    assert(header.slotCount == 65);
+
+    store = storeProvider(dir);
+    callContract(&store);
+    storedSlotIs(&store, 1, 0);
+    storedSlotIs(&store, 2, 3);
+    storedSlotIs(&store, 65, 66);
+    storedSlotIs(&store, 66, 0);
+    providerFree(&store);
+    removeDir(dir);
+}
+
+int main() {
+    test_directoryProvider();
+    test_rpcProvider();
+    test_imageProvider();
+    test_storeProvider();
+    return 0;
+}
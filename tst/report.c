@@ -0,0 +1,108 @@
+#include "report.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void writeReport(char *path, const char *tests[][4], size_t count) {
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    reportOpen(path);
+    for (size_t i = 0; i < count; i++) {
+        reportTest(tests[i][0], "tst/in/counter.evm", tests[i][1], strcmp(tests[i][2], "pass") == 0, atoi(tests[i][3]), 1000, 10);
+    }
+    reportClose();
+}
+
+void test_reportClose() {
+    char path[] = "/tmp/reportXXXXXX";
+    const char *tests[][4] = {
+        {"a.json", "first", "pass", "21000"},
+        {"a.json", "second", "fail", "22000"},
+    };
+    writeReport(path, tests, 2);
+    FILE *report = fopen(path, "r");
+    char contents[512];
+    size_t length = fread(contents, 1, sizeof(contents) - 1, report);
+    fclose(report);
+    contents[length] = '\0';
+    const char expected[] =
+        "[\n"
+        "{\"file\":\"a.json\",\"entry\":\"tst/in/counter.evm\",\"name\":\"first\",\"status\":\"pass\",\"gasUsed\":21000,\"nanos\":1000,\"ops\":10},\n"
+        "{\"file\":\"a.json\",\"entry\":\"tst/in/counter.evm\",\"name\":\"second\",\"status\":\"fail\",\"gasUsed\":22000,\"nanos\":1000,\"ops\":10}\n"
+        "]\n";
+    assert(strcmp(contents, expected) == 0);
+    unlink(path);
+}
+
+void test_reportCompare() {
+    char base[] = "/tmp/reportBaseXXXXXX";
+    const char *baseTests[][4] = {
+        {"a.json", "repeated", "pass", "21000"},
+        {"a.json", "repeated", "pass", "30000"},
+        {"b.json", "breaks", "pass", "21000"},
+        {"b.json", "removed", "pass", "21000"},
+    };
+    writeReport(base, baseTests, 4);
+
+    char same[] = "/tmp/reportSameXXXXXX";
+    writeReport(same, baseTests, 4);
+
+    // repeats are paired in order
+    char cheaper[] = "/tmp/reportCheaperXXXXXX";
+    const char *cheaperTests[][4] = {
+        {"a.json", "repeated", "pass", "21000"},
+        {"a.json", "repeated", "pass", "29000"},
+        {"b.json", "added", "pass", "21000"},
+        {"b.json", "breaks", "pass", "21000"},
+    };
+    writeReport(cheaper, cheaperTests, 4);
+
+    char costlier[] = "/tmp/reportCostlierXXXXXX";
+    const char *costlierTests[][4] = {
+        {"a.json", "repeated", "pass", "21000"},
+        {"a.json", "repeated", "pass", "30300"},
+        {"b.json", "breaks", "pass", "21000"},
+    };
+    writeReport(costlier, costlierTests, 3);
+
+    char broken[] = "/tmp/reportBrokenXXXXXX";
+    const char *brokenTests[][4] = {
+        {"b.json", "breaks", "fail", "21000"},
+    };
+    writeReport(broken, brokenTests, 1);
+
+    // the summaries go to stdout
+    fflush(stdout);
+    int savedStdout = dup(1);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, 1);
+    close(devNull);
+
+    assert(reportCompare(base, same, 10, 0) == 0);
+    assert(reportCompare(base, cheaper, 10, 0) == 0);
+    assert(reportCompare(base, costlier, 10, 0) != 0);
+    // 1%
+    assert(reportCompare(base, costlier, 10, 1) == 0);
+    assert(reportCompare(base, costlier, 10, 0.5) != 0);
+    assert(reportCompare(base, broken, 10, 100) != 0);
+
+    fflush(stdout);
+    dup2(savedStdout, 1);
+    close(savedStdout);
+
+    unlink(base);
+    unlink(same);
+    unlink(cheaper);
+    unlink(costlier);
+    unlink(broken);
+}
+
+int main() {
+    test_reportClose();
+    test_reportCompare();
+    return 0;
+}
@@ -63,7 +63,6 @@ void test_parseConstruct() {
 
 
 int main() {
-    pathInit("bin/evm");
     scanInit();
 
     const char *remaining;
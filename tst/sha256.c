@@ -0,0 +1,31 @@
+#include "sha256.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "hex.h"
+
+static void assertSha256(const char *message, size_t size, const char *expectedHex) {
+    uint8_t expected[32], actual[32];
+    for (int i = 0; i < 32; i++) {
+        expected[i] = hexString16ToUint8(expectedHex + i * 2);
+    }
+    sha256(actual, (const uint8_t *)message, size);
+    assert(memcmp(expected, actual, 32) == 0);
+}
+
+void test_sha256() {
+    assertSha256("", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    assertSha256("abc", 3, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    // the padding spills into a second block
+    const char *twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    assertSha256(twoBlocks, strlen(twoBlocks), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    char million[1000000];
+    memset(million, 'a', sizeof(million));
+    assertSha256(million, sizeof(million), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+int main() {
+    test_sha256();
+    return 0;
+}
@@ -0,0 +1,15 @@
+#!/bin/sh
+# answers the requests of rpcProvider from the provider files in $1, logging each request to $2
+dir=$1
+log=$2
+while read kind address key; do
+    echo "$kind $address $key" >> "$log"
+    case $kind in
+    account)
+        grep -m1 '^account ' "$dir/$address" 2> /dev/null || echo "account 0x0 0x0 0x"
+        ;;
+    slot)
+        grep -m1 "^slot $key " "$dir/$address" 2> /dev/null || echo "slot $key 0x0"
+        ;;
+    esac
+done